@@ -1,11 +1,29 @@
 {
+  "variables": {
+    "openafis_lto%": "<!(node -p \"process.env.OPENAFIS_LTO || 'false'\")",
+    "openafis_pgo%": "<!(node -p \"process.env.OPENAFIS_PGO || 'off'\")",
+    "openafis_pgo_dir%": "<!(node -p \"process.env.OPENAFIS_PGO_DIR || require('path').resolve('build-pgo')\")",
+    "openafis_count_allocations%": "<!(node -p \"process.env.OPENAFIS_COUNT_ALLOCATIONS || 'false'\")"
+  },
   "targets": [
     {
       "target_name": "openafis_addon",
       "sources": [
         "src/addon.cpp",
         "src/FingerprintMatcher.cpp",
-        "src/base64.cpp"
+        "src/ProbeCoalescer.cpp",
+        "src/ScanPool.cpp",
+        "src/CpuDispatch.cpp",
+        "src/base64.cpp",
+        "src/Crc32.cpp",
+        "src/StorageUtil.cpp",
+        "src/GallerySnapshot.cpp",
+        "src/EnrollmentJournal.cpp",
+        "src/MatchTrace.cpp",
+        "src/GalleryRegistry.cpp",
+        "src/FingerPosition.cpp",
+        "src/SharedGallerySegment.cpp",
+        "src/PackedMinutiae.cpp"
       ],
       "include_dirs": [
         "<!@(node -p \"require('node-addon-api').include\")",
@@ -14,8 +32,8 @@
       ],
       "cflags!": ["-fno-exceptions"],
       "cflags_cc!": ["-fno-exceptions"],
-      "cflags": ["-std=c++17", "-fPIC"],
-      "cflags_cc": ["-std=c++17", "-fPIC"],
+      "cflags": ["-std=c++17", "-fPIC", "-O3"],
+      "cflags_cc": ["-std=c++17", "-fPIC", "-O3"],
       "defines": ["NAPI_DISABLE_CPP_EXCEPTIONS"],
       "link_settings": {
         "libraries": ["-L/usr/local/lib", "-lopenafis"]
@@ -30,6 +48,60 @@
               }
             }
           }
+        ],
+        [
+          "OS=='linux'",
+          {
+            "link_settings": {
+              "libraries": ["-lrt"]
+            }
+          }
+        ],
+        [
+          "OS=='mac'",
+          {
+            "xcode_settings": {
+              "GCC_OPTIMIZATION_LEVEL": "3",
+              "CLANG_CXX_LANGUAGE_STANDARD": "c++17"
+            }
+          }
+        ],
+        [
+          "openafis_lto=='true'",
+          {
+            "cflags": ["-flto"],
+            "cflags_cc": ["-flto"],
+            "ldflags": ["-flto", "-O3"],
+            "defines": ["OPENAFIS_BUILD_LTO"],
+            "xcode_settings": {
+              "LLVM_LTO": "YES"
+            }
+          }
+        ],
+        [
+          "openafis_pgo=='generate'",
+          {
+            "cflags": ["-fprofile-generate=<(openafis_pgo_dir)"],
+            "cflags_cc": ["-fprofile-generate=<(openafis_pgo_dir)"],
+            "ldflags": ["-fprofile-generate=<(openafis_pgo_dir)"],
+            "defines": ["OPENAFIS_BUILD_PGO=1"]
+          }
+        ],
+        [
+          "openafis_pgo=='use'",
+          {
+            "cflags": ["-fprofile-use=<(openafis_pgo_dir)", "-fprofile-correction", "-Wno-missing-profile"],
+            "cflags_cc": ["-fprofile-use=<(openafis_pgo_dir)", "-fprofile-correction", "-Wno-missing-profile"],
+            "defines": ["OPENAFIS_BUILD_PGO=2"]
+          }
+        ],
+        [
+          "openafis_count_allocations=='true' and OS=='linux'",
+          {
+            "sources": ["src/AllocationCounter.cpp"],
+            "ldflags": ["-Wl,-Bsymbolic"],
+            "defines": ["OPENAFIS_COUNT_ALLOCATIONS"]
+          }
         ]
       ]
     }
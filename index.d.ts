@@ -55,3 +55,463 @@ export function findMatch(probeFingerprint: string, users: User[]): User | null;
  * @returns The matching user object or null if no match found
  */
 export function matchFingerprint(probeFingerprint: string, users: User[]): User | null;
+
+/**
+ * Result of matching a probe against the persistent gallery
+ */
+export interface GalleryMatchResult<T extends User = User> {
+  success: boolean;
+  isMatch?: boolean;
+  bestMatch?: string;
+  /** OpenAFIS similarity score (0-255) */
+  similarityScore?: number;
+  similarityPercentage?: number;
+  matchingTimeMs?: number;
+  threshold?: number;
+  loadedTemplates: number;
+  memoryUsage?: number;
+  concurrency?: number;
+  matchedObject?: T;
+  /** True when an identical probe was answered from the probe cache without scanning */
+  cached?: boolean;
+  /** Gallery templates in the finger position partitions the scan searched */
+  candidatesScanned?: number;
+  /** Number of probes served by the same coalesced pass (matchFingerprintBatched only) */
+  batchSize?: number;
+  /** The scan was stopped before it finished (matchFingerprintStream only) */
+  stoppedEarly?: boolean;
+  /** Per-phase timing breakdown (only while tracing is enabled, see configureTracing) */
+  trace?: MatchTrace;
+  error?: string;
+}
+
+/**
+ * Result of loading the persistent gallery
+ */
+export interface GalleryLoadResult {
+  success: boolean;
+  loadedTemplates: number;
+  memoryUsage: number;
+}
+
+/**
+ * Coalescing settings and counters
+ */
+export interface CoalescingStatus {
+  /** Maximum time a probe waits for others to join its batch */
+  windowMs: number;
+  /** A batch is dispatched as soon as it holds this many probes */
+  maxBatchSize: number;
+  probes: number;
+  batches: number;
+  largestBatch: number;
+}
+
+/**
+ * Load (or replace) the persistent gallery used by the async and batched entry points
+ * @param users - Array of user objects containing fingerprint property
+ */
+export function loadGallery(users: User[]): GalleryLoadResult;
+
+/**
+ * Result of an enrollment change to the persistent gallery
+ */
+export interface EnrollmentResult {
+  success: boolean;
+  /** True once the change has been committed to the gallery store's journal */
+  durable: boolean;
+  loadedTemplates: number;
+  error?: string;
+}
+
+/**
+ * Attach a durable store (snapshot + enrollment journal) to the persistent gallery and
+ * recover its contents. Later loadGallery/enrollFingerprint/removeFingerprint calls are journaled.
+ *
+ * The recovered gallery replaces the current one. Opening is refused (success: false
+ * with an error) while the gallery holds templates loaded before any store was
+ * attached, since they would be dropped: clear them with loadGallery([]) first and
+ * enroll them again once the store is open. Switching from one open store to another
+ * is allowed, as the first store keeps its templates.
+ * @param directory - Store directory (created if missing)
+ * @param options - Journal size / interval that trigger background compaction into a
+ *   snapshot, and the group commit window (0 = commit as soon as the writer is free)
+ */
+export function openGalleryStore(
+  directory: string,
+  options?: { compactionBytes?: number; compactionIntervalMs?: number; groupCommitWindowMs?: number }
+): GalleryLoadResult & { error?: string };
+
+/**
+ * Enroll one fingerprint into the persistent gallery; resolves once it is durable
+ * @param templateId - Unique template ID (returned as bestMatch)
+ * @param fingerprint - ISO 19794-2:2005 encoded fingerprint string
+ */
+export function enrollFingerprint(templateId: string, fingerprint: string): Promise<EnrollmentResult>;
+
+/**
+ * Remove (revoke) one template from the persistent gallery; resolves once it is durable
+ * @param templateId - Template ID passed to enrollFingerprint or loadGallery
+ */
+export function removeFingerprint(templateId: string): Promise<EnrollmentResult>;
+
+/**
+ * Match a probe against the persistent gallery on the libuv thread pool
+ * @param probeFingerprint - ISO 19794-2:2005 encoded fingerprint string
+ */
+export function matchFingerprintAsync<T extends User = User>(probeFingerprint: string): Promise<GalleryMatchResult<T>>;
+
+/**
+ * Match a probe against the persistent gallery, coalescing it with concurrent probes
+ * into one multi-probe pass over the gallery
+ * @param probeFingerprint - ISO 19794-2:2005 encoded fingerprint string
+ */
+export function matchFingerprintBatched<T extends User = User>(probeFingerprint: string): Promise<GalleryMatchResult<T>>;
+
+/**
+ * Best candidate so far of a streaming match
+ */
+export interface MatchProgressUpdate<T extends User = User> {
+  bestMatch: string;
+  similarityScore: number;
+  isMatch: boolean;
+  /** Candidates scored so far, across all scan workers */
+  candidatesScored: number;
+  /** Candidates the scan will score (the shortlist under the packed engine) */
+  candidatesTotal: number;
+  elapsedMs: number;
+  matchedObject?: T;
+}
+
+/**
+ * Match a probe against the persistent gallery, calling onProgress with every
+ * candidate that beats the best found so far (strictly increasing scores). The promise
+ * resolves with the final result after the last update. Returning false from onProgress
+ * stops the scan promptly: the workers check for it before every block of candidates.
+ * stopAtScore stops it as soon as a candidate reaches that score.
+ * @param probeFingerprint - ISO 19794-2:2005 encoded fingerprint string
+ */
+export function matchFingerprintStream<T extends User = User>(
+  probeFingerprint: string,
+  onProgress: (update: MatchProgressUpdate<T>) => boolean | void,
+  options?: { stopAtScore?: number }
+): Promise<GalleryMatchResult<T>>;
+
+/**
+ * Configure the coalescing window used by matchFingerprintBatched
+ * @param options - Window in milliseconds (e.g. 1-2) and maximum batch size
+ * @returns Current settings and coalescing counters
+ */
+export function configureCoalescing(options?: { windowMs?: number; maxBatchSize?: number }): CoalescingStatus;
+
+/**
+ * Probe cache settings and counters
+ */
+export interface ProbeCacheStatus {
+  capacity: number;
+  ttlMs: number;
+  entries: number;
+  /** Lookups that found the parsed probe */
+  hits: number;
+  /** Hits answered with the cached result (gallery unchanged) */
+  resultHits: number;
+  misses: number;
+  /** Incremented on every enrollment change; cached results from older versions are ignored */
+  galleryVersion: number;
+}
+
+/**
+ * Configure the probe cache of the persistent gallery (default: 1024 entries, 2000 ms TTL)
+ * @param options - capacity 0 disables the cache
+ * @returns Current settings and cache counters
+ */
+export function configureProbeCache(options?: { capacity?: number; ttlMs?: number }): ProbeCacheStatus;
+
+/**
+ * ISO 19794-2 finger position: 0 = unknown, 1-5 right thumb to little, 6-10 left thumb to little
+ */
+export type FingerPosition = 0 | 1 | 2 | 3 | 4 | 5 | 6 | 7 | 8 | 9 | 10;
+
+/**
+ * Finger position partitions of the persistent gallery
+ */
+export interface FingerPositionStatus {
+  /** Templates per position (index = position); multi-view templates count once per position */
+  partitions: number[];
+  /** Gallery positions searched for probe views at each position */
+  compatibility: Record<string, FingerPosition[]>;
+}
+
+/**
+ * Configure which gallery finger positions are searched for each probe position.
+ * By default a known position searches itself plus unknown-position templates and an
+ * unknown probe position searches the whole gallery. Changes are applied on a worker
+ * thread once in-flight scans have drained, all or none of them (invalid positions throw
+ * before anything changes); the promise resolves with the resulting map.
+ * @param options - reset restores the default map before compatibility is applied
+ */
+export function configureFingerPositions(options?: {
+  reset?: boolean;
+  compatibility?: Partial<Record<FingerPosition, FingerPosition[]>>;
+}): Promise<FingerPositionStatus>;
+
+/**
+ * Scan engine of the persistent gallery
+ */
+export interface ScanEngineStatus {
+  engine: 'reference' | 'packed';
+  /** Pre-filter candidates re-scored by OpenAFIS per probe (packed engine) */
+  shortlist: number;
+  /** Pre-filter kernel selected for this CPU: 'avx512', 'avx2' or 'scalar' */
+  kernel: string;
+}
+
+/**
+ * Select how 1:N scans of the persistent gallery search it. 'reference' scores every
+ * candidate with OpenAFIS; 'packed' ranks the gallery with a SIMD minutiae pre-filter and
+ * scores only the shortlist best candidates with OpenAFIS (default 64). Switching to
+ * 'packed' builds the pre-filter descriptors of the whole gallery on a worker thread
+ * while scans keep running; the promise resolves once the new engine is in use.
+ */
+export function configureScanEngine(options?: {
+  engine?: 'reference' | 'packed';
+  shortlist?: number;
+}): Promise<ScanEngineStatus>;
+
+/**
+ * How closely the packed engine reproduces the reference scan over sample probes
+ */
+export interface ScanEngineAccuracy {
+  /** Probes scanned by both engines */
+  probes: number;
+  /** Probes with the same best template and score under both engines */
+  agreements: number;
+  /** Probes the reference scan matched */
+  referenceMatches: number;
+  /** ...that the packed engine matched to the same template */
+  matchesFound: number;
+  /** matchesFound / referenceMatches */
+  recall: number;
+  referenceMs: number;
+  packedMs: number;
+}
+
+/**
+ * Scan probes (Base64, ideally with known mates enrolled) with both engines.
+ * Select the packed engine first; otherwise no probes are scanned.
+ */
+export function verifyScanEngine(probes: string[]): Promise<ScanEngineAccuracy>;
+
+/**
+ * Result of publishing the persistent gallery to shared memory
+ */
+export interface SharedGalleryPublishResult {
+  success: boolean;
+  name: string;
+  loadedTemplates: number;
+  capacityBytes: number;
+  error?: string;
+}
+
+/**
+ * Publish the persistent gallery to shared memory as its single writer. Every later
+ * loadGallery/enrollFingerprint/removeFingerprint reaches the attached galleries.
+ * @param name - "/name" for POSIX shared memory, any other string is a file path to map
+ * @param options - capacityBytes sizes the enrollment log (default 64 MiB)
+ */
+export function publishSharedGallery(name: string, options?: { capacityBytes?: number }): SharedGalleryPublishResult;
+
+/**
+ * Replace the persistent gallery with a published shared gallery. worker_threads of the
+ * publishing process share its gallery; other processes get a read-only replica that
+ * catches up before each match (on a worker thread for the async match functions).
+ * Results carry bestMatch only (no matchedObject).
+ *
+ * Memory: only worker_threads share one copy. Each replica process keeps its own parsed
+ * templates and raw records, about as much memory as the publisher's gallery
+ * (memoryUsage), plus the mapped log shared by all.
+ */
+export function attachSharedGallery(name: string): {
+  success: boolean;
+  /** True for a read-only replica of a gallery published by another process */
+  replica?: boolean;
+  loadedTemplates: number;
+  memoryUsage: number;
+  error?: string;
+};
+
+/**
+ * Stop sharing: the publisher removes the segment and keeps its gallery, an attached
+ * environment switches back to an empty private gallery
+ */
+export function detachSharedGallery(): { success: boolean; loadedTemplates: number };
+
+/**
+ * State of one named gallery
+ */
+export interface NamedGalleryInfo {
+  name: string;
+  /** False while the gallery is spilled to its snapshot */
+  resident: boolean;
+  templates: number;
+  /** Footprint in bytes: templates, raw records, descriptors and probe cache (as of eviction while spilled) */
+  memoryUsage: number;
+  /** 0 means unlimited */
+  quotaBytes: number;
+  evictions: number;
+  reloads: number;
+}
+
+/**
+ * Registry counters and galleries, most recently used first
+ */
+export interface GalleryRegistryStatus {
+  /** 0 means unlimited */
+  memoryBudgetBytes: number;
+  residentBytes: number;
+  residentGalleries: number;
+  evictions: number;
+  reloads: number;
+  galleries: NamedGalleryInfo[];
+}
+
+/**
+ * Result of an operation on a named gallery
+ */
+export interface NamedGalleryResult {
+  success: boolean;
+  gallery: string;
+  loadedTemplates: number;
+  memoryUsage: number;
+  isMatch?: boolean;
+  bestMatch?: string;
+  /** OpenAFIS similarity score (0-255) */
+  similarityScore?: number;
+  similarityPercentage?: number;
+  matchingTimeMs?: number;
+  cached?: boolean;
+  error?: string;
+}
+
+/**
+ * Configure the registry of named galleries (e.g. one per tenant)
+ * @param options - spillDirectory is required on the first call; least recently used galleries
+ *   are spilled there once their resident footprint exceeds memoryBudgetBytes. Named galleries
+ *   have no probe cache unless probeCache is given (ttlMs defaults to configureProbeCache's);
+ *   cached probes count towards quotas and the budget
+ * @returns Registry status once a lower budget has been enforced (spilling runs off the JS thread)
+ */
+export function configureGalleries(options?: {
+  spillDirectory?: string;
+  memoryBudgetBytes?: number;
+  probeCache?: { capacity?: number; ttlMs?: number };
+}): Promise<GalleryRegistryStatus>;
+
+/**
+ * Create an empty named gallery
+ * @param name - 1-128 characters of [A-Za-z0-9._-], not starting with '.'
+ * @param options - quotaBytes caps the gallery's footprint (0 = unlimited)
+ */
+export function createGallery(name: string, options?: { quotaBytes?: number; threshold?: number }): { success: boolean; error?: string };
+
+/**
+ * Drop a named gallery and delete its snapshot; resolves once in-flight operations on it have finished
+ */
+export function dropGallery(name: string): Promise<{ success: boolean; error?: string }>;
+
+/**
+ * Enroll one fingerprint into a named gallery (fails once the gallery would exceed its quota)
+ */
+export function enrollGalleryFingerprint(gallery: string, templateId: string, fingerprint: string): Promise<NamedGalleryResult>;
+
+/**
+ * Remove one template from a named gallery
+ */
+export function removeGalleryFingerprint(gallery: string, templateId: string): Promise<NamedGalleryResult>;
+
+/**
+ * Match a probe against a named gallery, reloading it from its snapshot if it was spilled
+ */
+export function matchGallery(gallery: string, probeFingerprint: string): Promise<NamedGalleryResult>;
+
+/**
+ * Build configuration and runtime kernel selection of the native addon
+ */
+export interface BuildInfo {
+  /** ISA level kernels dispatch to (after any OPENAFIS_ISA override) */
+  isa: 'scalar' | 'avx2' | 'avx512';
+  /** Highest ISA level reported by CPUID */
+  detectedIsa: 'scalar' | 'avx2' | 'avx512';
+  /** Variant selected for each dispatched kernel */
+  kernels: { base64: string; packedMinutiae: string };
+  lto: boolean;
+  pgo: 'off' | 'generate' | 'use';
+  /** True in allocation-counting builds (OPENAFIS_COUNT_ALLOCATIONS=true) */
+  allocationCounter: boolean;
+}
+
+/**
+ * Report how the addon was built and which kernel variants were selected at load time
+ */
+export function getBuildInfo(): BuildInfo;
+
+/**
+ * Diagnostic: score a probe descriptor against gallery descriptors (256-byte Buffers)
+ * with the packed pre-filter kernel selected at load time (see OPENAFIS_ISA). Returns
+ * 16 scores per block of 16 descriptors; the padding lanes of a partial last block score 0.
+ */
+export function scorePackedDescriptors(descriptors: Buffer[], probe: Buffer): Uint16Array;
+
+/**
+ * Per-phase timing breakdown of one match call
+ */
+export interface MatchTrace {
+  /** Correlates the result with its spans in exportTrace() */
+  matchId: number;
+  /** Base64 decoding of the probe */
+  decodeMs: number;
+  /** Probe cache lookup and ISO template parsing */
+  parseMs: number;
+  /** Enrolling the users array (matchFingerprint(probe, users) only) */
+  enrollMs: number;
+  /** 1:N gallery scan (for coalesced probes, the whole batch pass) */
+  scanMs: number;
+  /** Building the JS result object */
+  marshalMs: number;
+  /** Threads that scored part of the gallery (0 when served from the probe cache) */
+  threadsUsed: number;
+}
+
+/**
+ * Tracing state and span buffer counters
+ */
+export interface TracingStatus {
+  enabled: boolean;
+  /** Spans currently buffered for export */
+  spans: number;
+  /** Spans discarded because the buffer was full */
+  droppedSpans: number;
+}
+
+/**
+ * Enable or disable per-phase match tracing for this environment (main thread or
+ * worker thread): only its results carry `trace`. The span buffer is process-wide and
+ * reference-counted: the first environment to enable tracing starts a fresh buffer,
+ * later ones record into it (bufferSpans can only raise its capacity), and recording
+ * stops when the last one disables tracing or exits. exportTrace() therefore returns,
+ * and with clear empties, the spans of every tracing environment.
+ * @param options - bufferSpans caps the buffered spans (default 100000)
+ */
+export function configureTracing(options?: { enabled?: boolean; bufferSpans?: number }): TracingStatus;
+
+/**
+ * Export recorded spans as Chrome trace-event JSON (open in chrome://tracing or Perfetto)
+ * @param options - clear (default true) empties the span buffer after exporting
+ */
+export function exportTrace(options?: { clear?: boolean }): string;
+
+/**
+ * Number of native heap allocations made by the addon since it was loaded
+ * (only defined in allocation-counting builds, see BuildInfo.allocationCounter)
+ */
+export const getAllocationCount: (() => number) | undefined;
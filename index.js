@@ -1,4 +1,32 @@
-const { matchFingerprint } = require('./build/Release/openafis_addon');
+const {
+    matchFingerprint,
+    loadGallery,
+    openGalleryStore,
+    enrollFingerprint,
+    removeFingerprint,
+    matchFingerprintAsync,
+    matchFingerprintBatched,
+    matchFingerprintStream,
+    configureCoalescing,
+    configureProbeCache,
+    configureFingerPositions,
+    configureScanEngine,
+    verifyScanEngine,
+    publishSharedGallery,
+    attachSharedGallery,
+    detachSharedGallery,
+    configureGalleries,
+    createGallery,
+    dropGallery,
+    enrollGalleryFingerprint,
+    removeGalleryFingerprint,
+    matchGallery,
+    getBuildInfo,
+    scorePackedDescriptors,
+    configureTracing,
+    exportTrace,
+    getAllocationCount
+} = require('./build/Release/openafis_addon');
 
 /**
  * Match a probe fingerprint against an array of users
@@ -12,5 +40,31 @@ function findMatch(probeFingerprint, users) {
 
 module.exports = {
     findMatch,
-    matchFingerprint // Keep the original function name for backward compatibility
+    matchFingerprint, // Keep the original function name for backward compatibility
+    loadGallery,
+    openGalleryStore,
+    enrollFingerprint,
+    removeFingerprint,
+    matchFingerprintAsync,
+    matchFingerprintBatched,
+    matchFingerprintStream,
+    configureCoalescing,
+    configureProbeCache,
+    configureFingerPositions,
+    configureScanEngine,
+    verifyScanEngine,
+    publishSharedGallery,
+    attachSharedGallery,
+    detachSharedGallery,
+    configureGalleries,
+    createGallery,
+    dropGallery,
+    enrollGalleryFingerprint,
+    removeGalleryFingerprint,
+    matchGallery,
+    getBuildInfo,
+    scorePackedDescriptors,
+    configureTracing,
+    exportTrace,
+    getAllocationCount // Only defined in allocation-counting builds
 };
@@ -0,0 +1,369 @@
+// End-to-end load test for the HTTP integration path
+//
+// Starts a local matching server (in a child process, so the load generator
+// does not disturb its event loop) against a synthetic gallery, then drives it
+// with open-loop arrivals: requests are sent on a fixed schedule whether or not
+// earlier ones have completed, and latency is measured from the scheduled send
+// time so queueing delay is not hidden.
+//
+// Usage:
+//   node load-test.js [--mode sync|async|batched] [--rates 50,100,200]
+//                     [--duration 10] [--gallery 5000] [--probes 500]
+//                     [--window 1.5] [--batch 32] [--cache] [--compare]
+//
+// --compare runs every mode (sync, async, batched) at every rate and prints a
+// side-by-side table. The probe set is replayed many times per phase, so the
+// native probe cache is disabled unless --cache is given; otherwise most
+// requests would be cache hits and the run would not measure scans.
+
+const http = require('http');
+const { fork } = require('child_process');
+const { performance, monitorEventLoopDelay } = require('perf_hooks');
+
+const MODES = ['sync', 'async', 'batched'];
+
+/**
+ * Parse --key value / --flag command-line options
+ */
+function parseArgs(argv) {
+    const options = {
+        mode: 'async',
+        rates: [50, 100, 200],
+        duration: 10,
+        gallery: 5000,
+        probes: 500,
+        window: 1.5,
+        batch: 32,
+        cache: false,
+        compare: false
+    };
+
+    for (let i = 0; i < argv.length; i++) {
+        const arg = argv[i];
+        const next = () => argv[++i];
+        switch (arg) {
+            case '--mode': options.mode = next(); break;
+            case '--rates': options.rates = next().split(',').map(Number); break;
+            case '--duration': options.duration = Number(next()); break;
+            case '--gallery': options.gallery = Number(next()); break;
+            case '--probes': options.probes = Number(next()); break;
+            case '--window': options.window = Number(next()); break;
+            case '--batch': options.batch = Number(next()); break;
+            case '--cache': options.cache = true; break;
+            case '--compare': options.compare = true; break;
+            default:
+                throw new Error(`Unknown option: ${arg}`);
+        }
+    }
+
+    if (!options.compare && !MODES.includes(options.mode)) {
+        throw new Error(`--mode must be one of ${MODES.join(', ')}`);
+    }
+    return options;
+}
+
+/**
+ * Percentile of an ascending-sorted array
+ */
+function percentile(sorted, p) {
+    if (sorted.length === 0) {
+        return 0;
+    }
+    const index = Math.min(sorted.length - 1, Math.ceil((p / 100) * sorted.length) - 1);
+    return sorted[Math.max(0, index)];
+}
+
+// ---------------------------------------------------------------------------
+// Server (child process)
+// ---------------------------------------------------------------------------
+
+function runServer() {
+    const {
+        matchFingerprint,
+        loadGallery,
+        matchFingerprintAsync,
+        matchFingerprintBatched,
+        configureCoalescing,
+        configureProbeCache
+    } = require('./index');
+    const { makeGallery } = require('./synthetic-gallery');
+
+    const mode = process.env.LOAD_TEST_MODE;
+    const users = makeGallery(Number(process.env.LOAD_TEST_GALLERY));
+    const loaded = loadGallery(users);
+    if (process.env.LOAD_TEST_CACHE !== 'true') {
+        configureProbeCache({ capacity: 0 });
+    }
+    configureCoalescing({
+        windowMs: Number(process.env.LOAD_TEST_WINDOW),
+        maxBatchSize: Number(process.env.LOAD_TEST_BATCH)
+    });
+
+    const match = {
+        sync: probe => Promise.resolve(matchFingerprint(probe)),
+        async: probe => matchFingerprintAsync(probe),
+        batched: probe => matchFingerprintBatched(probe)
+    }[mode];
+
+    let lag = monitorEventLoopDelay({ resolution: 1 });
+    lag.enable();
+    let maxRss = process.memoryUsage().rss;
+    const rssSampler = setInterval(() => {
+        maxRss = Math.max(maxRss, process.memoryUsage().rss);
+    }, 50);
+    rssSampler.unref();
+
+    const server = http.createServer((req, res) => {
+        if (req.method === 'GET' && req.url === '/stats') {
+            res.writeHead(200, { 'Content-Type': 'application/json' });
+            res.end(JSON.stringify({
+                eventLoopLagP50Ms: lag.percentile(50) / 1e6,
+                eventLoopLagP99Ms: lag.percentile(99) / 1e6,
+                eventLoopLagMaxMs: lag.max / 1e6,
+                rssMb: process.memoryUsage().rss / (1024 * 1024),
+                maxRssMb: maxRss / (1024 * 1024),
+                coalescing: configureCoalescing()
+            }));
+            return;
+        }
+
+        if (req.method === 'POST' && req.url === '/stats/reset') {
+            lag.disable();
+            lag = monitorEventLoopDelay({ resolution: 1 });
+            lag.enable();
+            maxRss = process.memoryUsage().rss;
+            res.writeHead(204);
+            res.end();
+            return;
+        }
+
+        if (req.method === 'POST' && req.url === '/match') {
+            let body = '';
+            req.setEncoding('utf8');
+            req.on('data', chunk => { body += chunk; });
+            req.on('end', () => {
+                const { fingerprint } = JSON.parse(body);
+                match(fingerprint).then(result => {
+                    res.writeHead(200, { 'Content-Type': 'application/json' });
+                    res.end(JSON.stringify({
+                        isMatch: result.isMatch,
+                        bestMatch: result.bestMatch,
+                        similarityScore: result.similarityScore
+                    }));
+                }, error => {
+                    res.writeHead(500);
+                    res.end(error.message);
+                });
+            });
+            return;
+        }
+
+        res.writeHead(404);
+        res.end();
+    });
+
+    server.listen(0, '127.0.0.1', () => {
+        process.send({ type: 'ready', port: server.address().port, loaded: loaded.loadedTemplates });
+    });
+}
+
+// ---------------------------------------------------------------------------
+// Load generator (parent process)
+// ---------------------------------------------------------------------------
+
+function startServer(mode, options) {
+    return new Promise((resolve, reject) => {
+        // The native layer logs every enrollment to stdout; keep it out of the report
+        const child = fork(__filename, [], {
+            env: {
+                ...process.env,
+                LOAD_TEST_ROLE: 'server',
+                LOAD_TEST_MODE: mode,
+                LOAD_TEST_GALLERY: String(options.gallery),
+                LOAD_TEST_WINDOW: String(options.window),
+                LOAD_TEST_BATCH: String(options.batch),
+                LOAD_TEST_CACHE: String(options.cache)
+            },
+            stdio: ['ignore', 'ignore', 'inherit', 'ipc']
+        });
+        child.once('message', message => resolve({ child, ...message }));
+        child.once('exit', code => reject(new Error(`Server exited with code ${code}`)));
+    });
+}
+
+function request(agent, port, method, urlPath, body) {
+    return new Promise((resolve, reject) => {
+        const req = http.request({ agent, host: '127.0.0.1', port, method, path: urlPath }, res => {
+            let data = '';
+            res.setEncoding('utf8');
+            res.on('data', chunk => { data += chunk; });
+            res.on('end', () => resolve({ status: res.statusCode, body: data }));
+        });
+        req.on('error', reject);
+        if (body !== undefined) {
+            req.setHeader('Content-Type', 'application/json');
+            req.end(body);
+        } else {
+            req.end();
+        }
+    });
+}
+
+/**
+ * Drive one open-loop phase at a fixed arrival rate
+ */
+function runPhase(agent, port, rate, durationSec, probes) {
+    const total = Math.max(1, Math.round(rate * durationSec));
+    const intervalMs = 1000 / rate;
+    const bodies = probes.map(probe => JSON.stringify({ fingerprint: probe.fingerprint }));
+    const latencies = [];
+    let errors = 0;
+    let hits = 0;
+    let genuine = 0;
+    let sent = 0;
+    let completed = 0;
+
+    return new Promise(resolve => {
+        const start = performance.now();
+
+        const finish = () => {
+            if (++completed === total) {
+                const elapsedSec = (performance.now() - start) / 1000;
+                latencies.sort((a, b) => a - b);
+                resolve({
+                    rate,
+                    requests: total,
+                    errors,
+                    throughput: (total - errors) / elapsedSec,
+                    p50: percentile(latencies, 50),
+                    p99: percentile(latencies, 99),
+                    p999: percentile(latencies, 99.9),
+                    rank1: genuine > 0 ? hits / genuine : null
+                });
+            }
+        };
+
+        const fire = (index, scheduled) => {
+            const probe = probes[index % probes.length];
+            request(agent, port, 'POST', '/match', bodies[index % bodies.length]).then(res => {
+                latencies.push(performance.now() - scheduled);
+                if (res.status !== 200) {
+                    errors++;
+                } else if (probe.expectedId !== null) {
+                    genuine++;
+                    const result = JSON.parse(res.body);
+                    if (result.isMatch && result.bestMatch === probe.expectedId) {
+                        hits++;
+                    }
+                }
+                finish();
+            }, () => {
+                errors++;
+                finish();
+            });
+        };
+
+        // Send everything that is due, independent of completions
+        const tick = () => {
+            const now = performance.now();
+            while (sent < total && start + sent * intervalMs <= now) {
+                fire(sent, start + sent * intervalMs);
+                sent++;
+            }
+            if (sent < total) {
+                setTimeout(tick, Math.max(0, start + sent * intervalMs - performance.now()));
+            }
+        };
+        tick();
+    });
+}
+
+async function runMode(mode, options, probes) {
+    const { child, port, loaded } = await startServer(mode, options);
+    const agent = new http.Agent({ keepAlive: true, maxSockets: Infinity });
+    const rows = [];
+
+    try {
+        console.log(`\n🚀 ${mode}: gallery ${loaded} templates, server on port ${port}`);
+        printHeader();
+
+        // Warm-up so the first phase does not pay for page faults and lazy initialization
+        await runPhase(agent, port, Math.min(options.rates[0], 20), 1, probes);
+
+        for (const rate of options.rates) {
+            await request(agent, port, 'POST', '/stats/reset');
+            const phase = await runPhase(agent, port, rate, options.duration, probes);
+            const stats = JSON.parse((await request(agent, port, 'GET', '/stats')).body);
+            const row = { mode, ...phase, ...stats };
+            rows.push(row);
+            printRow(row);
+        }
+    } finally {
+        agent.destroy();
+        child.kill();
+    }
+
+    return rows;
+}
+
+function printHeader() {
+    console.log(
+        'mode     rate/s  done/s   p50 ms   p99 ms  p999 ms  lag p99  lag max  maxRSS MB  rank-1  errors'
+    );
+}
+
+function printRow(row) {
+    const fmt = (value, width, digits = 1) => value.toFixed(digits).padStart(width);
+    console.log(
+        row.mode.padEnd(8) +
+        fmt(row.rate, 7, 0) +
+        fmt(row.throughput, 8) +
+        fmt(row.p50, 9, 2) +
+        fmt(row.p99, 9, 2) +
+        fmt(row.p999, 9, 2) +
+        fmt(row.eventLoopLagP99Ms, 9, 2) +
+        fmt(row.eventLoopLagMaxMs, 9, 2) +
+        fmt(row.maxRssMb, 11) +
+        (row.rank1 === null ? '     n/a' : fmt(row.rank1 * 100, 7) + '%') +
+        String(row.errors).padStart(8)
+    );
+}
+
+async function main() {
+    const options = parseArgs(process.argv.slice(2));
+    const { makeGallery, makeProbes } = require('./synthetic-gallery');
+
+    // Same seed as the server, so probes are re-captures of its enrolled users
+    const probes = makeProbes(makeGallery(options.gallery), options.probes);
+    const modes = options.compare ? MODES : [options.mode];
+
+    console.log('📊 OpenAFIS HTTP load test');
+    console.log(`   Gallery: ${options.gallery}, probes: ${options.probes}, ` +
+                `rates: ${options.rates.join('/')} req/s, ${options.duration}s per rate`);
+    console.log(`   Coalescing: window ${options.window} ms, max batch ${options.batch}`);
+    console.log(`   Probe cache: ${options.cache ? 'enabled' : 'disabled'}`);
+
+    const rows = [];
+    for (const mode of modes) {
+        rows.push(...await runMode(mode, options, probes));
+    }
+
+    if (modes.length > 1) {
+        console.log('\n📋 Comparison');
+        printHeader();
+        for (const rate of options.rates) {
+            rows.filter(row => row.rate === rate).forEach(printRow);
+        }
+    }
+}
+
+if (process.env.LOAD_TEST_ROLE === 'server') {
+    runServer();
+} else if (require.main === module) {
+    main().catch(error => {
+        console.error('💥 Load test failed:', error.message);
+        process.exit(1);
+    });
+}
+
+module.exports = { percentile, runPhase };
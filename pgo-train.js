@@ -0,0 +1,52 @@
+// PGO training run: exercises the hot matching paths on a synthetic workload
+//
+// Used by `npm run build:pgo`, which builds an instrumented addon
+// (OPENAFIS_PGO=generate), runs this script to record a profile, then
+// rebuilds with OPENAFIS_PGO=use.
+
+const {
+    matchFingerprint,
+    loadGallery,
+    matchFingerprintAsync,
+    matchFingerprintBatched,
+    configureCoalescing,
+    configureProbeCache,
+    getBuildInfo
+} = require('./index');
+const { makeGallery, makeProbes } = require('./synthetic-gallery');
+
+const GALLERY_SIZE = Number(process.env.PGO_GALLERY_SIZE || 2000);
+const PROBE_COUNT = Number(process.env.PGO_PROBES || 200);
+
+async function train() {
+    console.log('🏋️  PGO training run');
+    console.log('   Build:', JSON.stringify(getBuildInfo()));
+
+    const users = makeGallery(GALLERY_SIZE);
+    const probes = makeProbes(users, PROBE_COUNT);
+
+    // Per-call enrollment path (base64 decode + ISO parse dominate here)
+    for (const probe of probes.slice(0, 10)) {
+        matchFingerprint(probe.fingerprint, users.slice(0, 200));
+    }
+
+    loadGallery(users);
+    // Probes repeat across the phases below; train the scan, not probe cache hits
+    configureProbeCache({ capacity: 0 });
+
+    for (const probe of probes.slice(0, 50)) {
+        matchFingerprint(probe.fingerprint);
+    }
+
+    await Promise.all(probes.map(probe => matchFingerprintAsync(probe.fingerprint)));
+
+    configureCoalescing({ windowMs: 2, maxBatchSize: 32 });
+    await Promise.all(probes.map(probe => matchFingerprintBatched(probe.fingerprint)));
+
+    console.log('✅ Training workload complete:', JSON.stringify(configureCoalescing()));
+}
+
+train().catch(error => {
+    console.error('💥 PGO training failed:', error.message);
+    process.exit(1);
+});
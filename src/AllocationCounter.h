@@ -0,0 +1,20 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <cstdint>
+
+namespace openafis {
+
+/**
+ * @brief Number of global operator new calls made by the addon since it was loaded
+ *
+ * Only available in builds with OPENAFIS_COUNT_ALLOCATIONS (OPENAFIS_COUNT_ALLOCATIONS=true
+ * node-gyp rebuild), which replaces the global allocation operators. The addon is then
+ * linked with -Bsymbolic so its own code (including statically linked OpenAFIS) binds to
+ * the counting operators while Node and V8 keep theirs.
+ */
+uint64_t allocationCount();
+
+} // namespace openafis
+
+#endif // ALLOCATION_COUNTER_H
@@ -0,0 +1,59 @@
+#include "CpuDispatch.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace openafis {
+
+IsaLevel detectIsaLevel() {
+#if OPENAFIS_X86_DISPATCH
+    static const IsaLevel level = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+            return IsaLevel::AVX512;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            return IsaLevel::AVX2;
+        }
+        return IsaLevel::Scalar;
+    }();
+    return level;
+#else
+    return IsaLevel::Scalar;
+#endif
+}
+
+IsaLevel selectedIsaLevel() {
+    static const IsaLevel level = [] {
+        IsaLevel detected = detectIsaLevel();
+        const char* requested = std::getenv("OPENAFIS_ISA");
+        if (requested == nullptr) {
+            return detected;
+        }
+        
+        IsaLevel cap = detected;
+        if (std::strcmp(requested, "scalar") == 0) {
+            cap = IsaLevel::Scalar;
+        } else if (std::strcmp(requested, "avx2") == 0) {
+            cap = IsaLevel::AVX2;
+        } else if (std::strcmp(requested, "avx512") == 0) {
+            cap = IsaLevel::AVX512;
+        }
+        // The override can only lower the level; it never enables unsupported code
+        return static_cast<int>(cap) < static_cast<int>(detected) ? cap : detected;
+    }();
+    return level;
+}
+
+const char* isaLevelName(IsaLevel level) {
+    switch (level) {
+        case IsaLevel::AVX512:
+            return "avx512";
+        case IsaLevel::AVX2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
+
+} // namespace openafis
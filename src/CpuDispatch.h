@@ -0,0 +1,42 @@
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+// Per-function ISA variants are only built where the compiler supports target attributes
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define OPENAFIS_X86_DISPATCH 1
+#else
+#define OPENAFIS_X86_DISPATCH 0
+#endif
+
+namespace openafis {
+
+/**
+ * @brief Instruction set levels that hot kernels are compiled for
+ */
+enum class IsaLevel {
+    Scalar = 0,  // Portable baseline
+    AVX2 = 1,    // x86-64 with AVX2
+    AVX512 = 2   // x86-64 with AVX-512 F/BW
+};
+
+/**
+ * @brief Highest ISA level supported by this CPU (queried once via CPUID)
+ */
+IsaLevel detectIsaLevel();
+
+/**
+ * @brief ISA level kernels dispatch to
+ *
+ * Equal to detectIsaLevel() unless lowered through the OPENAFIS_ISA environment
+ * variable ("scalar", "avx2" or "avx512"), which is useful for A/B runs.
+ */
+IsaLevel selectedIsaLevel();
+
+/**
+ * @brief Human-readable name of an ISA level ("scalar", "avx2", "avx512")
+ */
+const char* isaLevelName(IsaLevel level);
+
+} // namespace openafis
+
+#endif // CPU_DISPATCH_H
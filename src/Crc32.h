@@ -0,0 +1,20 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace openafis {
+
+/**
+ * @brief CRC-32 (IEEE 802.3 polynomial) of a byte range
+ * @param data Bytes to checksum
+ * @param length Number of bytes
+ * @param crc Running value when checksumming in several pieces (start with 0)
+ * @return Updated checksum
+ */
+uint32_t crc32(const void* data, size_t length, uint32_t crc = 0);
+
+} // namespace openafis
+
+#endif // CRC32_H
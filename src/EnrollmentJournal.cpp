@@ -0,0 +1,329 @@
+#include "EnrollmentJournal.h"
+#include "Crc32.h"
+#include "GallerySnapshot.h"
+#include "StorageUtil.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace openafis {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// u32 payload length + u32 CRC-32
+constexpr size_t kFrameHeaderBytes = 8;
+// u64 sequence + u8 operation + u32 id length + u32 data length
+constexpr size_t kMinPayloadBytes = 17;
+
+/**
+ * @brief Decode one payload; returns false if it is malformed
+ */
+bool decodePayload(const uint8_t* payload, size_t length, EnrollmentJournal::Entry& entry) {
+    if (length < kMinPayloadBytes) {
+        return false;
+    }
+
+    entry.sequence = readU64(payload);
+    entry.operation = static_cast<EnrollmentJournal::Operation>(payload[8]);
+
+    const uint32_t id_length = readU32(payload + 9);
+    if (id_length > kMaxRecordIdBytes || 13 + id_length + 4 > length) {
+        return false;
+    }
+    entry.id.assign(reinterpret_cast<const char*>(payload + 13), id_length);
+
+    const uint32_t data_length = readU32(payload + 13 + id_length);
+    if (13 + id_length + 4 + static_cast<size_t>(data_length) != length) {
+        return false;
+    }
+    const uint8_t* data = payload + 13 + id_length + 4;
+    entry.data.assign(data, data + data_length);
+
+    return entry.operation == EnrollmentJournal::Operation::Enroll ||
+           entry.operation == EnrollmentJournal::Operation::Remove ||
+           entry.operation == EnrollmentJournal::Operation::Clear;
+}
+
+} // namespace
+
+EnrollmentJournal::EnrollmentJournal()
+    : file_(nullptr), window_(0), appended_sequence_(0), durable_sequence_(0), bytes_(0),
+      writing_(false), failed_(false), stopping_(false) {}
+
+EnrollmentJournal::~EnrollmentJournal() {
+    close();
+}
+
+bool EnrollmentJournal::replay(const std::string& path, uint64_t after,
+                               const std::function<void(const Entry&)>& apply, uint64_t& last_sequence) {
+    last_sequence = after;
+
+    std::error_code ec;
+    if (!fs::exists(path, ec)) {
+        return true;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open journal: " << path << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+
+    size_t offset = 0;
+    Entry entry;
+    while (offset + kFrameHeaderBytes <= contents.size()) {
+        const uint32_t payload_length = readU32(&contents[offset]);
+        const uint32_t checksum = readU32(&contents[offset + 4]);
+        if (offset + kFrameHeaderBytes + payload_length > contents.size()) {
+            break; // Torn write at the tail
+        }
+
+        const uint8_t* payload = &contents[offset + kFrameHeaderBytes];
+        if (crc32(payload, payload_length) != checksum || !decodePayload(payload, payload_length, entry)) {
+            break; // Corrupt entry: nothing after it can be trusted
+        }
+
+        if (entry.sequence > after) {
+            if (entry.sequence != last_sequence + 1) {
+                // Intact entries that skip numbers mean committed changes went missing
+                std::cerr << "Journal " << path << ": sequence gap (expected " << (last_sequence + 1)
+                          << ", found " << entry.sequence << ")" << std::endl;
+                return false;
+            }
+            apply(entry);
+        }
+        last_sequence = std::max(last_sequence, entry.sequence);
+        offset += kFrameHeaderBytes + payload_length;
+    }
+
+    if (offset != contents.size()) {
+        std::cerr << "Journal " << path << ": discarding " << (contents.size() - offset)
+                  << " bytes of incomplete or corrupt entries" << std::endl;
+        fs::resize_file(path, offset, ec);
+        if (ec) {
+            std::cerr << "Failed to truncate journal: " << ec.message() << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool EnrollmentJournal::open(const std::string& path, uint64_t last_sequence,
+                             std::chrono::microseconds group_commit_window) {
+    close();
+
+    FILE* file = std::fopen(path.c_str(), "ab");
+    if (file == nullptr) {
+        std::cerr << "Failed to open journal for appending: " << path << std::endl;
+        return false;
+    }
+
+    std::error_code ec;
+    const auto size = fs::file_size(path, ec);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+    file_ = file;
+    window_ = group_commit_window;
+    pending_.clear();
+    appended_sequence_ = last_sequence;
+    durable_sequence_ = last_sequence;
+    bytes_ = ec ? 0 : static_cast<size_t>(size);
+    writing_ = false;
+    failed_ = false;
+    stopping_ = false;
+    writer_ = std::thread(&EnrollmentJournal::run, this);
+    return true;
+}
+
+void EnrollmentJournal::close() {
+    // A failed rotation leaves no file but a running writer, so the writer decides what to stop
+    if (!writer_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_cv_.notify_all();
+    writer_.join();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_ != nullptr) {
+        std::fclose(file_);
+        file_ = nullptr;
+    }
+    durable_cv_.notify_all();
+}
+
+bool EnrollmentJournal::failed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failed_;
+}
+
+bool EnrollmentJournal::isOpen() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return file_ != nullptr && !stopping_;
+}
+
+uint64_t EnrollmentJournal::append(Operation operation, const std::string& id, const uint8_t* data, size_t length) {
+    std::vector<uint8_t> payload;
+    payload.reserve(kMinPayloadBytes + id.size() + length);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (file_ == nullptr || stopping_) {
+        return 0;
+    }
+
+    const uint64_t sequence = ++appended_sequence_;
+    appendU64(payload, sequence);
+    payload.push_back(static_cast<uint8_t>(operation));
+    appendU32(payload, static_cast<uint32_t>(id.size()));
+    payload.insert(payload.end(), id.begin(), id.end());
+    appendU32(payload, static_cast<uint32_t>(length));
+    if (length > 0) {
+        payload.insert(payload.end(), data, data + length);
+    }
+
+    appendU32(pending_, static_cast<uint32_t>(payload.size()));
+    appendU32(pending_, crc32(payload.data(), payload.size()));
+    pending_.insert(pending_.end(), payload.begin(), payload.end());
+    bytes_ += kFrameHeaderBytes + payload.size();
+
+    lock.unlock();
+    work_cv_.notify_one();
+    return sequence;
+}
+
+bool EnrollmentJournal::waitDurable(uint64_t sequence) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    durable_cv_.wait(lock, [&] { return durable_sequence_ >= sequence || failed_ || file_ == nullptr; });
+    return durable_sequence_ >= sequence && !failed_;
+}
+
+bool EnrollmentJournal::sync() {
+    return waitDurable(lastSequence());
+}
+
+bool EnrollmentJournal::rotate(const std::string& retired_path) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (file_ == nullptr) {
+        return false;
+    }
+
+    // Let the writer drain everything queued so far
+    durable_cv_.wait(lock, [this] { return (pending_.empty() && !writing_) || failed_; });
+    if (failed_) {
+        return false;
+    }
+
+    std::fclose(file_);
+    file_ = nullptr;
+
+    std::error_code ec;
+    bool retired = false;
+    if (fs::exists(retired_path, ec)) {
+        const auto retired_size = fs::file_size(retired_path, ec);
+        const bool sized = !ec;
+        bool ok = sized;
+        if (ok && fs::file_size(path_, ec) > 0 && !ec) {
+            std::ifstream current(path_, std::ios::binary);
+            std::ofstream folded(retired_path, std::ios::binary | std::ios::app);
+            folded << current.rdbuf();
+            folded.close();
+            ok = folded.good();
+        }
+        FILE* sync_handle = ok ? std::fopen(retired_path.c_str(), "ab") : nullptr;
+        ok = ok && sync_handle != nullptr && syncFile(sync_handle);
+        if (sync_handle != nullptr) {
+            std::fclose(sync_handle);
+        }
+        if (ok) {
+            fs::remove(path_, ec);
+            retired = true;
+        } else {
+            std::cerr << "Failed to fold journal into " << retired_path << std::endl;
+            // Drop a partial copy; the entries are still in the current journal
+            if (sized) {
+                fs::resize_file(retired_path, retired_size, ec);
+            }
+        }
+    } else {
+        fs::rename(path_, retired_path, ec);
+        if (ec) {
+            std::cerr << "Failed to retire journal: " << ec.message() << std::endl;
+        } else {
+            retired = true;
+        }
+    }
+
+    // Continue in a fresh file, or in the same one if it could not be retired
+    file_ = std::fopen(path_.c_str(), "ab");
+    if (file_ == nullptr) {
+        std::cerr << "Failed to reopen journal: " << path_ << std::endl;
+        failed_ = true;
+        durable_cv_.notify_all();
+        return false;
+    }
+    if (!retired) {
+        return false;
+    }
+    bytes_ = 0;
+    return syncDirectory(parentDirectory(path_));
+}
+
+uint64_t EnrollmentJournal::lastSequence() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return appended_sequence_;
+}
+
+size_t EnrollmentJournal::sizeBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+void EnrollmentJournal::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::vector<uint8_t> batch;
+
+    while (true) {
+        work_cv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+        if (pending_.empty()) {
+            break; // Stopping and fully committed
+        }
+
+        // Give concurrent enrollments a chance to join this commit
+        if (window_.count() > 0 && !stopping_) {
+            work_cv_.wait_for(lock, window_, [this] { return stopping_; });
+        }
+
+        batch.swap(pending_);
+        const uint64_t target = appended_sequence_;
+        writing_ = true;
+        FILE* file = file_;
+        lock.unlock();
+
+        bool ok = std::fwrite(batch.data(), 1, batch.size(), file) == batch.size() && syncFile(file);
+        batch.clear();
+
+        lock.lock();
+        writing_ = false;
+        if (ok) {
+            durable_sequence_ = target;
+        } else {
+            std::cerr << "Failed to commit journal entries to " << path_ << std::endl;
+            failed_ = true;
+        }
+        durable_cv_.notify_all();
+    }
+}
+
+} // namespace openafis
@@ -0,0 +1,148 @@
+#ifndef ENROLLMENT_JOURNAL_H
+#define ENROLLMENT_JOURNAL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace openafis {
+
+/**
+ * @brief Append-only, checksummed write-ahead log of gallery changes
+ *
+ * Each entry is framed as u32 payload length, u32 CRC-32 of the payload, then
+ * the payload (u64 sequence, u8 operation, u32 id length, id, u32 data length,
+ * data). Appends are buffered and a background writer commits everything queued
+ * so far with a single write + fsync (group commit), so concurrent enrollments
+ * share the cost of durability.
+ */
+class EnrollmentJournal {
+public:
+    /**
+     * @brief Journaled gallery operations
+     */
+    enum class Operation : uint8_t {
+        Enroll = 1,  // Add template (id, ISO record)
+        Remove = 2,  // Remove template (id)
+        Clear = 3    // Remove every template
+    };
+    
+    /**
+     * @brief Decoded journal entry
+     */
+    struct Entry {
+        uint64_t sequence;
+        Operation operation;
+        std::string id;
+        std::vector<uint8_t> data;
+    };
+    
+    EnrollmentJournal();
+    
+    /**
+     * @brief Commit outstanding appends and close the file
+     */
+    ~EnrollmentJournal();
+    
+    EnrollmentJournal(const EnrollmentJournal&) = delete;
+    EnrollmentJournal& operator=(const EnrollmentJournal&) = delete;
+    
+    /**
+     * @brief Replay a journal file, truncating a torn or corrupt tail
+     * @param path Journal file (a missing file is an empty journal)
+     * @param after Entries with a sequence number at or below this are skipped
+     * @param apply Called for every entry to replay, in order
+     * @param last_sequence Receives the highest valid sequence number seen (at least after)
+     * @return false if the file exists but cannot be read or repaired, or if the entries
+     *         after `after` do not continue it without a gap in their sequence numbers
+     */
+    static bool replay(const std::string& path, uint64_t after,
+                       const std::function<void(const Entry&)>& apply, uint64_t& last_sequence);
+    
+    /**
+     * @brief Open a journal for appending and start the writer thread
+     * @param path Journal file
+     * @param last_sequence Sequence number of the last entry already applied
+     * @param group_commit_window Extra time the writer waits for more appends before committing
+     * @return true if the file could be opened
+     */
+    bool open(const std::string& path, uint64_t last_sequence, std::chrono::microseconds group_commit_window);
+    
+    /**
+     * @brief Commit outstanding appends, stop the writer and close the file
+     */
+    void close();
+    
+    bool isOpen() const;
+    
+    /**
+     * @brief Whether a write or a rotation failed; later appends are no longer durable
+     */
+    bool failed() const;
+    
+    /**
+     * @brief Queue an entry for the next group commit
+     * @return Sequence number assigned to the entry (0 if the journal is not open)
+     */
+    uint64_t append(Operation operation, const std::string& id, const uint8_t* data = nullptr, size_t length = 0);
+    
+    /**
+     * @brief Block until the entry with this sequence number is on stable storage
+     * @return false if the journal failed to write
+     */
+    bool waitDurable(uint64_t sequence);
+    
+    /**
+     * @brief Block until every appended entry is on stable storage
+     */
+    bool sync();
+    
+    /**
+     * @brief Move the committed journal aside and continue in a fresh, empty file
+     *
+     * If retired_path already exists (an earlier compaction did not finish), the
+     * current contents are appended to it so no entry is ever dropped.
+     * The caller must prevent concurrent appends while rotating.
+     * @return false if the journal could not be retired; appends then continue in the
+     *         current file, unless it could not be reopened either (see failed())
+     */
+    bool rotate(const std::string& retired_path);
+    
+    /**
+     * @brief Sequence number of the last appended entry
+     */
+    uint64_t lastSequence() const;
+    
+    /**
+     * @brief Size of the current journal file including queued appends
+     */
+    size_t sizeBytes() const;
+
+private:
+    void run();
+    
+    std::string path_;
+    FILE* file_;
+    std::chrono::microseconds window_;
+    std::vector<uint8_t> pending_;
+    uint64_t appended_sequence_;
+    uint64_t durable_sequence_;
+    size_t bytes_;
+    bool writing_;
+    bool failed_;
+    bool stopping_;
+    mutable std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable durable_cv_;
+    std::thread writer_;
+};
+
+} // namespace openafis
+
+#endif // ENROLLMENT_JOURNAL_H
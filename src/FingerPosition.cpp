@@ -0,0 +1,75 @@
+#include "FingerPosition.h"
+
+namespace openafis {
+
+namespace {
+
+// ISO 19794-2:2005 layout: 24-byte record header (view count at byte 22), then per view
+// position, view/impression, quality, minutiae count, 6 bytes per minutia and a
+// big-endian u16 extended data length followed by that much extended data
+constexpr size_t kRecordHeaderBytes = 24;
+constexpr size_t kViewHeaderBytes = 4;
+constexpr size_t kMinutiaBytes = 6;
+constexpr size_t kExtendedLengthBytes = 2;
+
+} // namespace
+
+bool readFingerPositions(const uint8_t* data, size_t length, std::vector<uint8_t>& positions) {
+    positions.clear();
+    if (data == nullptr || length < kRecordHeaderBytes) {
+        return false;
+    }
+
+    const size_t views = data[22];
+    size_t offset = kRecordHeaderBytes;
+    for (size_t view = 0; view < views; view++) {
+        if (offset + kViewHeaderBytes > length) {
+            return false;
+        }
+        const uint8_t position = data[offset];
+        positions.push_back(position < kFingerPositions ? position : kUnknownFingerPosition);
+
+        offset += kViewHeaderBytes + data[offset + 3] * kMinutiaBytes;
+        if (offset + kExtendedLengthBytes > length) {
+            return false;
+        }
+        offset += kExtendedLengthBytes + ((static_cast<size_t>(data[offset]) << 8) | data[offset + 1]);
+    }
+    return true;
+}
+
+FingerCompatibility::FingerCompatibility() {
+    reset();
+}
+
+void FingerCompatibility::reset() {
+    compatible_[kUnknownFingerPosition] = kAllFingerPositions;
+    for (uint8_t position = 1; position < kFingerPositions; position++) {
+        compatible_[position] = fingerBit(position) | fingerBit(kUnknownFingerPosition);
+    }
+}
+
+bool FingerCompatibility::set(uint8_t probe_position, const std::vector<uint8_t>& gallery_positions) {
+    if (probe_position >= kFingerPositions) {
+        return false;
+    }
+    FingerMask mask = 0;
+    for (uint8_t position : gallery_positions) {
+        if (position >= kFingerPositions) {
+            return false;
+        }
+        mask |= fingerBit(position);
+    }
+    compatible_[probe_position] = mask;
+    return true;
+}
+
+FingerMask FingerCompatibility::gallery(const uint8_t* probe_positions, size_t count) const {
+    FingerMask mask = 0;
+    for (size_t i = 0; i < count; i++) {
+        mask |= compatible_[probe_positions[i]];
+    }
+    return mask;
+}
+
+} // namespace openafis
@@ -0,0 +1,72 @@
+#ifndef FINGER_POSITION_H
+#define FINGER_POSITION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace openafis {
+
+// ISO 19794-2 finger positions: 0 = unknown, 1-5 right thumb..little, 6-10 left thumb..little
+constexpr size_t kFingerPositions = 11;
+constexpr uint8_t kUnknownFingerPosition = 0;
+
+// Set of finger positions, bit n = position n
+using FingerMask = uint16_t;
+constexpr FingerMask kAllFingerPositions = (1u << kFingerPositions) - 1;
+
+inline FingerMask fingerBit(uint8_t position) {
+    return static_cast<FingerMask>(1u << position);
+}
+
+/**
+ * @brief Read the finger position of every view of an ISO 19794-2:2005 record
+ *
+ * Positions outside 0-10 (multi-finger plain captures) are reported as unknown.
+ * @param positions Receives one position per view, in record order
+ * @return false if the record is too short for the views its header declares
+ */
+bool readFingerPositions(const uint8_t* data, size_t length, std::vector<uint8_t>& positions);
+
+/**
+ * @brief Which gallery finger positions a probe view at a given position is compared with
+ *
+ * By default a known position matches the same position plus gallery views of
+ * unknown position, and an unknown probe position matches everything.
+ */
+class FingerCompatibility {
+public:
+    FingerCompatibility();
+
+    /**
+     * @brief Restore the default map
+     */
+    void reset();
+
+    /**
+     * @brief Set the gallery positions searched for probe views at probe_position
+     * @return false if a position is out of range
+     */
+    bool set(uint8_t probe_position, const std::vector<uint8_t>& gallery_positions);
+
+    /**
+     * @brief Gallery positions searched for one probe view position
+     */
+    FingerMask gallery(uint8_t probe_position) const { return compatible_[probe_position]; }
+
+    /**
+     * @brief Gallery positions searched for a whole probe
+     */
+    FingerMask gallery(const uint8_t* probe_positions, size_t count) const;
+
+    bool compatible(uint8_t probe_position, uint8_t gallery_position) const {
+        return (compatible_[probe_position] & fingerBit(gallery_position)) != 0;
+    }
+
+private:
+    FingerMask compatible_[kFingerPositions];
+};
+
+} // namespace openafis
+
+#endif // FINGER_POSITION_H
@@ -1,18 +1,195 @@
 #include "FingerprintMatcher.h"
-#include "MatchMany.h"
+#include "EnrollmentJournal.h"
+#include "FingerPosition.h"
+#include "GallerySnapshot.h"
+#include "MatchSimilarity.h"
+#include "MatchTrace.h"
+#include "PackedMinutiae.h"
+#include "ScanPool.h"
+#include "SharedGallerySegment.h"
 #include "TemplateISO19794_2_2005.h"
 #include "Fingerprint.h"
 #include "Log.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <mutex>
 #include <unordered_map>
 #include <memory>
 #include <iostream>
+#include <thread>
 
 namespace openafis {
 
 using TemplateType = OpenAFIS::TemplateISO19794_2_2005<std::string, OpenAFIS::Fingerprint>;
 using Templates = std::vector<TemplateType>;
+using Clock = TraceRecorder::Clock;
+
+// Number of gallery templates scored against every probe of a batch before moving on
+constexpr size_t kBatchBlockSize = 64;
+
+// Parsed probe templates kept per thread for reuse (covers a full coalesced batch)
+constexpr size_t kMaxArenaProbes = 64;
+
+// Blocks of packed candidates pre-filtered per kernel call (scores stay on the worker's stack)
+constexpr size_t kPrefilterChunk = 32;
+
+// Best (score, candidate) seen for one probe
+using BestMatch = std::pair<uint8_t, const TemplateType*>;
+
+// Pre-filter score and gallery index of a packed candidate
+using ScoredCandidate = std::pair<uint16_t, uint32_t>;
+
+/**
+ * @brief A probe template with the finger position of each of its fingerprints
+ */
+struct ProbeView {
+    const TemplateType* probe;
+    const uint8_t* positions;
+    const MinutiaeDescriptor* descriptor;   // Packed engine input; nullptr scans the probe with the reference engine
+};
+
+/**
+ * @brief Finger position of every fingerprint parsed from a record
+ *
+ * Falls back to unknown positions when the record's views do not line up with
+ * the parsed fingerprints, so such templates are searched like before.
+ */
+void viewPositions(const uint8_t* data, size_t length, size_t fingerprint_count, std::vector<uint8_t>& positions) {
+    if (!readFingerPositions(data, length, positions) || positions.size() != fingerprint_count) {
+        positions.assign(fingerprint_count, kUnknownFingerPosition);
+    }
+}
+
+namespace {
+
+/**
+ * @brief Per-thread probe templates and scan scratch, reused across calls
+ *
+ * Buffers only ever grow, so once a thread has served a few matches its
+ * parse / scan / merge path no longer touches the heap.
+ */
+struct ThreadArena {
+    std::vector<std::shared_ptr<TemplateType>> probes;
+    std::vector<uint8_t> record;                 // Header-repaired record bytes
+    std::vector<uint8_t> file_record;            // Probe record read by match1toNFromFile
+    std::vector<BestMatch> partial;              // Per-worker bests (workers x probes)
+    std::vector<BestMatch> best;                 // Merged bests (one per probe)
+    std::vector<uint8_t> positions;              // Finger positions of the current probe(s)
+    std::vector<uint32_t> candidates;            // Gallery indices of a multi-partition search
+    std::vector<std::shared_ptr<const TemplateType>> batch_probes;
+    std::vector<ProbeView> batch_views;
+    std::vector<uint8_t> batch_positions;        // Positions of every batch probe, back to back
+    std::vector<size_t> batch_offsets;           // Where each batch probe's positions start
+    std::vector<size_t> batch_slots;
+    std::vector<MinutiaeDescriptor> batch_descriptors;
+    std::vector<uint8_t> batch_described;        // Whether each batch probe's descriptor is valid
+    MinutiaeDescriptor descriptor;               // Descriptor of the current probe
+    std::vector<uint8_t> wide_probe;             // Descriptor widened for the packed kernels
+    std::vector<ScoredCandidate> shortlist;      // Per-worker pre-filter heaps, then the merged shortlist
+    std::vector<size_t> shortlist_counts;        // Per worker: heap size, candidates pre-filtered
+    
+    ThreadArena() {
+        probes.reserve(kMaxArenaProbes);
+    }
+    
+    /**
+     * @brief A probe template no caller or cache entry is using any more
+     */
+    std::shared_ptr<TemplateType> acquireProbe() {
+        for (const auto& probe : probes) {
+            if (probe.use_count() == 1) {
+                return probe;
+            }
+        }
+        auto probe = std::make_shared<TemplateType>("__temp_probe__");
+        if (probes.size() < kMaxArenaProbes) {
+            probes.push_back(probe);
+        }
+        return probe;
+    }
+};
+
+ThreadArena& threadArena() {
+    thread_local ThreadArena arena;
+    return arena;
+}
+
+// OpenAFIS keeps its pair/graph scratch inside MatchSimilarity; one per thread is reused by every scan
+OpenAFIS::MatchSimilarity& threadSimilarity() {
+    thread_local OpenAFIS::MatchSimilarity similarity;
+    return similarity;
+}
+
+/**
+ * @brief Best candidate reported so far by a streaming scan, shared by its workers
+ *
+ * Workers compare against the published best score without locking and only take
+ * the lock for a candidate that beats it, so the callback sees strictly increasing
+ * scores, one call at a time, and a scan that rarely improves pays almost nothing.
+ */
+class ScanProgress {
+public:
+    ScanProgress(const MatchProgressCallback& callback, uint8_t threshold, const std::atomic<bool>* cancel)
+        : callback_(callback), threshold_(threshold), started_(Clock::now()), cancel_(cancel), best_(-1), scored_(0),
+          total_(0), stopped_(false) {}
+    
+    /**
+     * @brief Whether the callback or the caller stopped the scan (polled by the workers every block)
+     */
+    bool stopped() const {
+        return stopped_.load(std::memory_order_relaxed) ||
+               (cancel_ != nullptr && cancel_->load(std::memory_order_relaxed));
+    }
+    
+    void setTotal(size_t total) { total_.store(total, std::memory_order_relaxed); }
+    
+    void addScored(size_t count) { scored_.fetch_add(count, std::memory_order_relaxed); }
+    
+    /**
+     * @brief Report a candidate to the callback if it beats every candidate reported so far
+     */
+    void offer(uint8_t score, const TemplateId& template_id) {
+        if (static_cast<int>(score) <= best_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (static_cast<int>(score) <= best_.load(std::memory_order_relaxed) || stopped()) {
+            return;
+        }
+        best_.store(score, std::memory_order_relaxed);
+        
+        MatchProgress progress;
+        progress.similarity_score = score;
+        progress.matched_template_id = template_id;
+        progress.is_match = score >= threshold_;
+        progress.candidates_scored = scored_.load(std::memory_order_relaxed);
+        progress.candidates_total = total_.load(std::memory_order_relaxed);
+        progress.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - started_);
+        if (!callback_(progress)) {
+            stopped_.store(true, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    const MatchProgressCallback& callback_;
+    const uint8_t threshold_;
+    const Clock::time_point started_;
+    const std::atomic<bool>* cancel_;
+    std::mutex mutex_;
+    std::atomic<int> best_;
+    std::atomic<size_t> scored_;
+    std::atomic<size_t> total_;
+    std::atomic<bool> stopped_;
+};
+
+} // namespace
 
 /**
  * @brief Private implementation class for FingerprintMatcher
@@ -20,32 +197,856 @@ using Templates = std::vector<TemplateType>;
 class FingerprintMatcher::Impl {
 public:
     Templates enrolled_templates;
-    OpenAFIS::MatchMany<TemplateType> matcher;
+    // ID handles parallel to enrolled_templates, shared with every result that names them
+    std::vector<TemplateId> enrolled_ids;
+    // Finger position of every fingerprint, and the set of positions, parallel to enrolled_templates
+    std::vector<std::vector<uint8_t>> enrolled_positions;
+    std::vector<FingerMask> enrolled_masks;
+    // Indices of the templates holding a view at each finger position (ascending)
+    std::array<std::vector<uint32_t>, kFingerPositions> partitions;
+    FingerCompatibility finger_compatibility;
+    // Minutiae descriptors parallel to enrolled_templates, packed for the SIMD pre-filter
+    // (built only while the packed engine is selected)
+    PackedGallery packed_gallery;
+    ScanEngineOptions scan_engine;
+    // Descriptors built by prepareScanEngine() beside running scans, for configureScanEngine() to adopt
+    std::mutex staging_mutex;
+    PackedGallery staged_gallery;
+    uint64_t staged_version;     // gallery_version the staged descriptors were built from
+    bool staged;
+    std::atomic<size_t> memory_bytes;
+    // enrolled_templates.size(), readable while the gallery is being changed
+    std::atomic<size_t> template_count;
+    // Memory kept beside the parsed templates (records, IDs, positions, descriptors)
+    std::atomic<size_t> side_bytes;
     uint8_t similarity_threshold;
+    uint64_t gallery_version;
+    ProbeCache<TemplateType> probe_cache;
+    
+    // Raw records parallel to enrolled_templates, kept for snapshots and the journal
+    std::vector<GalleryRecord> enrolled_records;
+    // Guards enrolled_records and journal appends against the compaction thread
+    mutable std::mutex store_mutex;
+    EnrollmentJournal journal;
+    std::string store_directory;
+    JournalOptions journal_options;
+    // Set once a template enters the gallery without a journal to record it
+    bool unstored_templates;
+    std::thread compactor;
+    std::mutex compactor_mutex;
+    std::condition_variable compactor_cv;
+    bool compactor_stopping;
+    
+    // Shared memory publication (writer) or replica (reader) of the gallery
+    SharedGallerySegment shared_segment;
+    uint64_t shared_epoch;
+    size_t shared_offset;
+    std::atomic<uint64_t> shared_generation;   // Segment generation as of the last refresh
+    
+    Impl(uint8_t threshold)
+        : staged_version(0), staged(false), memory_bytes(0), template_count(0), side_bytes(0), similarity_threshold(threshold),
+          gallery_version(0), unstored_templates(false), compactor_stopping(false),
+          shared_epoch(0), shared_offset(0), shared_generation(0) {
+        // Initialize OpenAFIS logging
+        OpenAFIS::Log::init();
+    }
+    
+    ~Impl() {
+        stopCompactor();
+        journal.close();
+    }
+    
+    std::string snapshotPath() const { return store_directory + "/gallery.snapshot"; }
+    std::string journalPath() const { return store_directory + "/gallery.journal"; }
+    std::string retiredJournalPath() const { return store_directory + "/gallery.journal.old"; }
+    
+    /**
+     * @brief Find template by ID
+     */
+    Templates::iterator findTemplate(const std::string& template_id) {
+        return std::find_if(enrolled_templates.begin(), enrolled_templates.end(),
+            [&template_id](const TemplateType& t) {
+                return t.id() == template_id;
+            });
+    }
+    
+    /**
+     * @brief Find template by ID (const version)
+     */
+    Templates::const_iterator findTemplate(const std::string& template_id) const {
+        return std::find_if(enrolled_templates.begin(), enrolled_templates.end(),
+            [&template_id](const TemplateType& t) {
+                return t.id() == template_id;
+            });
+    }
+    
+    /**
+     * @brief Parse raw ISO data into a template, repairing a wrong header length field
+     */
+    static bool loadRecord(TemplateType& target, const uint8_t* data, size_t length) {
+        if (data == nullptr || length < 12) {
+            return false;
+        }
+        
+        // ISO 19794-2 length field (bytes 8-11 after 8-byte magic, big-endian)
+        uint32_t header_length = (data[8] << 24) | (data[9] << 16) | (data[10] << 8) | data[11];
+        if (header_length == length) {
+            return target.load(data, length);
+        }
+        
+        std::vector<uint8_t>& corrected_data = threadArena().record;
+        corrected_data.assign(data, data + length);
+        corrected_data[8] = (length >> 24) & 0xFF;
+        corrected_data[9] = (length >> 16) & 0xFF;
+        corrected_data[10] = (length >> 8) & 0xFF;
+        corrected_data[11] = length & 0xFF;
+        return target.load(corrected_data.data(), corrected_data.size());
+    }
+    
+    /**
+     * @brief Parse a probe into a recycled template (probe cache first, then the thread arena)
+     *
+     * A recycled template still holds the previous probe's fingerprints, so it is reset
+     * to an empty one before loading; copy-assignment keeps its fingerprint storage.
+     * @return nullptr if the record does not parse
+     */
+    std::shared_ptr<TemplateType> parseProbe(const uint8_t* data, size_t length) {
+        static const TemplateType blank("__temp_probe__");
+        
+        std::shared_ptr<TemplateType> probe = probe_cache.reclaim();
+        if (!probe) {
+            probe = threadArena().acquireProbe();
+        }
+        *probe = blank;
+        if (!loadRecord(*probe, data, length) || probe->fingerprints().empty()) {
+            return nullptr;
+        }
+        return probe;
+    }
+    
+    /**
+     * @brief Gallery templates to search for a set of finger positions
+     *
+     * A single partition is scanned in place; several are merged into the calling
+     * thread's arena, each template taken from the lowest wanted partition it is in.
+     * @param candidates Set to the template indices, or nullptr for the whole gallery
+     * @return Number of templates to search
+     */
+    size_t selectCandidates(FingerMask wanted, const uint32_t*& candidates) const {
+        FingerMask present = 0;
+        for (size_t position = 0; position < kFingerPositions; position++) {
+            if (!partitions[position].empty()) {
+                present |= fingerBit(static_cast<uint8_t>(position));
+            }
+        }
+        
+        wanted &= present;
+        if (wanted == present) {
+            candidates = nullptr;
+            return enrolled_templates.size();
+        }
+        if (wanted == 0) {
+            candidates = nullptr;
+            return 0;
+        }
+        if ((wanted & (wanted - 1)) == 0) {
+            const std::vector<uint32_t>& partition = partitions[lowestPosition(wanted)];
+            candidates = partition.data();
+            return partition.size();
+        }
+        
+        std::vector<uint32_t>& merged = threadArena().candidates;
+        merged.clear();
+        for (size_t position = 0; position < kFingerPositions; position++) {
+            if ((wanted & fingerBit(static_cast<uint8_t>(position))) == 0) {
+                continue;
+            }
+            for (uint32_t index : partitions[position]) {
+                if (lowestPosition(enrolled_masks[index] & wanted) == position) {
+                    merged.push_back(index);
+                }
+            }
+        }
+        // Scan in gallery order, so equal scores resolve to the same template as the full scan
+        std::sort(merged.begin(), merged.end());
+        candidates = merged.data();
+        return merged.size();
+    }
+    
+    static size_t lowestPosition(FingerMask mask) {
+        size_t position = 0;
+        while ((mask & 1) == 0) {
+            mask >>= 1;
+            position++;
+        }
+        return position;
+    }
+    
+    /**
+     * @brief Score probes against the gallery partitions their finger positions select
+     *
+     * Each worker owns a contiguous range of the candidates and walks it in blocks,
+     * scoring every probe against a block before moving on so the candidates stay
+     * cache-resident. Scratch comes from the calling thread's arena. While tracing,
+     * every worker records its own span so stragglers show up in the trace.
+     * @param best Receives one (score, candidate) per probe
+     * @param scanned Receives the number of gallery templates searched
+     * @param progress Streaming scan (single probe) the workers report improvements to, or nullptr
+     * @return Number of threads that scored part of the gallery
+     */
+    uint32_t scanGallery(const ProbeView* probes, size_t probe_count, BestMatch* best, size_t& scanned,
+                         ScanEngine engine, ScanProgress* progress = nullptr) const {
+        if (engine == ScanEngine::Packed) {
+            // Probes are pre-filtered one at a time; a probe without a descriptor falls back to the reference scan
+            uint32_t threads = 0;
+            scanned = 0;
+            for (size_t p = 0; p < probe_count; p++) {
+                size_t probe_scanned = 0;
+                const uint32_t probe_threads = probes[p].descriptor != nullptr
+                    ? scanPacked(probes[p], best[p], probe_scanned, progress)
+                    : scanGallery(&probes[p], 1, &best[p], probe_scanned, ScanEngine::Reference, progress);
+                threads = std::max(threads, probe_threads);
+                scanned = std::max(scanned, probe_scanned);
+            }
+            return threads;
+        }
+        
+        ScanPool& pool = ScanPool::shared();
+        TraceRecorder& recorder = TraceRecorder::instance();
+        const Templates& gallery = enrolled_templates;
+        
+        FingerMask wanted = 0;
+        for (size_t p = 0; p < probe_count; p++) {
+            wanted |= finger_compatibility.gallery(probes[p].positions, probes[p].probe->fingerprints().size());
+        }
+        const uint32_t* candidates = nullptr;
+        const size_t candidate_count = selectCandidates(wanted, candidates);
+        scanned = candidate_count;
+        if (progress != nullptr) {
+            progress->setTotal(candidate_count * probe_count);
+        }
+        
+        const size_t workers = std::max<size_t>(1, std::min(pool.workers(), candidate_count));
+        const bool tracing = recorder.active();
+        const uint64_t match_id = TraceRecorder::currentMatchId();
+        
+        std::vector<BestMatch>& partial = threadArena().partial;
+        partial.assign(workers * probe_count, BestMatch(0, nullptr));
+        BestMatch* partial_data = partial.data();
+        
+        auto task = [&](size_t worker) {
+            if (worker >= workers) {
+                return;
+            }
+            const Clock::time_point started = tracing ? Clock::now() : Clock::time_point();
+            OpenAFIS::MatchSimilarity& similarity = threadSimilarity();
+            const size_t begin = candidate_count * worker / workers;
+            const size_t end = candidate_count * (worker + 1) / workers;
+            BestMatch* local = partial_data + worker * probe_count;
+            
+            for (size_t block = begin; block < end; block += kBatchBlockSize) {
+                if (progress != nullptr && progress->stopped()) {
+                    break;
+                }
+                const size_t block_end = std::min(end, block + kBatchBlockSize);
+                for (size_t p = 0; p < probe_count; p++) {
+                    for (size_t i = block; i < block_end; i++) {
+                        const size_t c = candidates != nullptr ? candidates[i] : i;
+                        uint8_t score = 0;
+                        if (!bestPairScore(similarity, probes[p], gallery[c], enrolled_positions[c].data(), score)) {
+                            continue;
+                        }
+                        if (local[p].second == nullptr || score > local[p].first) {
+                            local[p] = {score, &gallery[c]};
+                            if (progress != nullptr) {
+                                progress->offer(score, enrolled_ids[c]);
+                            }
+                        }
+                    }
+                }
+                if (progress != nullptr) {
+                    progress->addScored((block_end - block) * probe_count);
+                }
+            }
+            if (tracing) {
+                recorder.record("scan.worker", started, Clock::now(), match_id, static_cast<int32_t>(worker));
+            }
+        };
+        pool.run(task);
+        
+        for (size_t p = 0; p < probe_count; p++) {
+            BestMatch overall = partial_data[p];
+            for (size_t w = 1; w < workers; w++) {
+                const BestMatch& candidate = partial_data[w * probe_count + p];
+                if (candidate.second != nullptr && (overall.second == nullptr || candidate.first > overall.first)) {
+                    overall = candidate;
+                }
+            }
+            best[p] = overall;
+        }
+        return static_cast<uint32_t>(workers);
+    }
+    
+    /**
+     * @brief Ordering of pre-filter candidates: higher score first, then lower gallery index
+     */
+    static bool betterCandidate(const ScoredCandidate& a, const ScoredCandidate& b) {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    }
+    
+    /**
+     * @brief Packed engine scan of one probe: SIMD pre-filter over every block, OpenAFIS on the shortlist
+     *
+     * Each worker pre-filters a contiguous range of blocks, keeping its best
+     * candidates in a heap whose front is the weakest. The merged shortlist is then
+     * re-scored by the workers with the reference similarity; ties resolve to the
+     * lowest gallery index, as in the reference scan.
+     */
+    uint32_t scanPacked(const ProbeView& probe, BestMatch& best, size_t& scanned, ScanProgress* progress) const {
+        ScanPool& pool = ScanPool::shared();
+        TraceRecorder& recorder = TraceRecorder::instance();
+        ThreadArena& arena = threadArena();
+        const Templates& gallery = enrolled_templates;
+        const FingerMask wanted = finger_compatibility.gallery(probe.positions, probe.probe->fingerprints().size());
+        const size_t blocks = packed_gallery.blocks();
+        const size_t shortlist = std::max<size_t>(1, scan_engine.shortlist);
+        const bool tracing = recorder.active();
+        const uint64_t match_id = TraceRecorder::currentMatchId();
+        
+        widenProbe(*probe.descriptor, arena.wide_probe);
+        const uint8_t* wide = arena.wide_probe.data();
+        
+        const size_t workers = std::max<size_t>(1, std::min(pool.workers(), blocks));
+        arena.shortlist.resize(workers * shortlist);
+        arena.shortlist_counts.assign(workers * 2, 0);
+        ScoredCandidate* heaps = arena.shortlist.data();
+        size_t* counts = arena.shortlist_counts.data();
+        
+        auto prefilter = [&](size_t worker) {
+            if (worker >= workers) {
+                return;
+            }
+            const Clock::time_point started = tracing ? Clock::now() : Clock::time_point();
+            const size_t begin = blocks * worker / workers;
+            const size_t end = blocks * (worker + 1) / workers;
+            ScoredCandidate* heap = heaps + worker * shortlist;
+            size_t heap_size = 0;
+            size_t candidates = 0;
+            uint16_t scores[kPrefilterChunk * kPackedLanes];
+            
+            for (size_t chunk = begin; chunk < end; chunk += kPrefilterChunk) {
+                // Only a caller's cancellation can stop the scan this early
+                if (progress != nullptr && progress->stopped()) {
+                    break;
+                }
+                const size_t chunk_end = std::min(end, chunk + kPrefilterChunk);
+                packed_gallery.score(wide, chunk, chunk_end, scores);
+                const size_t first = chunk * kPackedLanes;
+                const size_t last = std::min(gallery.size(), chunk_end * kPackedLanes);
+                for (size_t c = first; c < last; c++) {
+                    if ((enrolled_masks[c] & wanted) == 0) {
+                        continue;
+                    }
+                    candidates++;
+                    const ScoredCandidate entry(scores[c - first], static_cast<uint32_t>(c));
+                    if (heap_size < shortlist) {
+                        heap[heap_size++] = entry;
+                        std::push_heap(heap, heap + heap_size, betterCandidate);
+                    } else if (betterCandidate(entry, heap[0])) {
+                        std::pop_heap(heap, heap + heap_size, betterCandidate);
+                        heap[heap_size - 1] = entry;
+                        std::push_heap(heap, heap + heap_size, betterCandidate);
+                    }
+                }
+            }
+            counts[worker * 2] = heap_size;
+            counts[worker * 2 + 1] = candidates;
+            if (tracing) {
+                recorder.record("scan.prefilter", started, Clock::now(), match_id, static_cast<int32_t>(worker));
+            }
+        };
+        pool.run(prefilter);
+        
+        // Gather the worker heaps at the front of the buffer and keep the overall best
+        size_t total = 0;
+        scanned = 0;
+        for (size_t w = 0; w < workers; w++) {
+            std::copy(heaps + w * shortlist, heaps + w * shortlist + counts[w * 2], heaps + total);
+            total += counts[w * 2];
+            scanned += counts[w * 2 + 1];
+        }
+        if (total > shortlist) {
+            std::nth_element(heaps, heaps + shortlist, heaps + total, betterCandidate);
+            total = shortlist;
+        }
+        
+        if (progress != nullptr) {
+            progress->setTotal(total);
+        }
+        
+        const size_t rescore_workers = std::max<size_t>(1, std::min(pool.workers(), total));
+        std::vector<BestMatch>& partial = arena.partial;
+        partial.assign(rescore_workers, BestMatch(0, nullptr));
+        BestMatch* partial_data = partial.data();
+        
+        auto rescore = [&](size_t worker) {
+            if (worker >= rescore_workers) {
+                return;
+            }
+            const Clock::time_point started = tracing ? Clock::now() : Clock::time_point();
+            OpenAFIS::MatchSimilarity& similarity = threadSimilarity();
+            BestMatch& local = partial_data[worker];
+            for (size_t i = total * worker / rescore_workers; i < total * (worker + 1) / rescore_workers; i++) {
+                if (progress != nullptr && progress->stopped()) {
+                    break;
+                }
+                const uint32_t c = heaps[i].second;
+                uint8_t score = 0;
+                const bool compatible = bestPairScore(similarity, probe, gallery[c], enrolled_positions[c].data(), score);
+                if (progress != nullptr) {
+                    progress->addScored(1);
+                }
+                if (!compatible) {
+                    continue;
+                }
+                if (local.second == nullptr || score > local.first || (score == local.first && &gallery[c] < local.second)) {
+                    local = {score, &gallery[c]};
+                    if (progress != nullptr) {
+                        progress->offer(score, enrolled_ids[c]);
+                    }
+                }
+            }
+            if (tracing) {
+                recorder.record("scan.rescore", started, Clock::now(), match_id, static_cast<int32_t>(worker));
+            }
+        };
+        if (total > 0) {
+            pool.run(rescore);
+        }
+        
+        best = partial_data[0];
+        for (size_t w = 1; w < rescore_workers; w++) {
+            const BestMatch& candidate = partial_data[w];
+            if (candidate.second != nullptr &&
+                (best.second == nullptr || candidate.first > best.first ||
+                 (candidate.first == best.first && candidate.second < best.second))) {
+                best = candidate;
+            }
+        }
+        return static_cast<uint32_t>(std::max(workers, rescore_workers));
+    }
+    
+    /**
+     * @brief Descriptor of a probe record for the packed engine
+     * @return nullptr under the reference engine or if the record's minutiae cannot be read
+     */
+    const MinutiaeDescriptor* describeProbe(const uint8_t* data, size_t length) const {
+        MinutiaeDescriptor& descriptor = threadArena().descriptor;
+        if (scan_engine.engine != ScanEngine::Packed || !describeMinutiae(data, length, true, descriptor)) {
+            return nullptr;
+        }
+        return &descriptor;
+    }
+    
+    /**
+     * @brief Best similarity over every probe/candidate fingerprint pair with compatible finger positions
+     * @return false if no pair is compatible (the candidate is not a match for this probe)
+     */
+    bool bestPairScore(OpenAFIS::MatchSimilarity& similarity, const ProbeView& probe,
+                       const TemplateType& candidate, const uint8_t* candidate_positions, uint8_t& best) const {
+        const auto& probe_fingerprints = probe.probe->fingerprints();
+        const auto& candidate_fingerprints = candidate.fingerprints();
+        bool compared = false;
+        best = 0;
+        for (size_t p = 0; p < probe_fingerprints.size(); p++) {
+            for (size_t c = 0; c < candidate_fingerprints.size(); c++) {
+                if (!finger_compatibility.compatible(probe.positions[p], candidate_positions[c])) {
+                    continue;
+                }
+                uint8_t score = 0;
+                similarity.compute(score, probe_fingerprints[p], candidate_fingerprints[c]);
+                best = std::max(best, score);
+                compared = true;
+            }
+        }
+        return compared;
+    }
+    
+    /**
+     * @brief Fill a result from a best score / candidate pair and the scan it came from
+     */
+    void fillResult(MatchResult& result, uint8_t score, const TemplateType* candidate, size_t scanned,
+                    Clock::time_point scan_start, Clock::time_point scan_end, uint32_t threads_used) const {
+        result.similarity_score = score;
+        result.candidates_scanned = scanned;
+        if (candidate != nullptr) {
+            result.matched_template_id = enrolled_ids[candidate - enrolled_templates.data()];
+        }
+        result.match_time = std::chrono::duration_cast<std::chrono::milliseconds>(scan_end - scan_start);
+        result.is_match = (result.similarity_score >= similarity_threshold);
+        result.phases.scan = std::chrono::duration_cast<std::chrono::microseconds>(scan_end - scan_start);
+        result.phases.threads_used = threads_used;
+    }
+    
+    /**
+     * @brief Serve a probe from the cache, or hand back its parsed template for a scan
+     * @return true if result was filled from a cached 1:N result
+     */
+    bool lookupProbe(const uint8_t* data, size_t length, MatchResult& result,
+                     std::shared_ptr<const TemplateType>& probe) {
+        const Clock::time_point start = Clock::now();
+        const bool answered = lookupOrParse(data, length, result, probe);
+        const Clock::time_point end = Clock::now();
+        
+        result.phases.parse = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+        TraceRecorder::instance().record("parse", start, end, TraceRecorder::currentMatchId());
+        return answered;
+    }
+    
+    /**
+     * @brief Untimed body of lookupProbe
+     */
+    bool lookupOrParse(const uint8_t* data, size_t length, MatchResult& result,
+                       std::shared_ptr<const TemplateType>& probe) {
+        ProbeCache<TemplateType>::Hit hit;
+        if (probe_cache.lookup(data, length, hit)) {
+            if (hit.has_result && hit.gallery_version == gallery_version) {
+                probe_cache.countResultHit();
+                result.similarity_score = hit.similarity_score;
+                result.matched_template_id = hit.matched_template_id;
+                result.match_time = std::chrono::milliseconds(0);
+                result.is_match = (result.similarity_score >= similarity_threshold);
+                result.from_cache = true;
+                return true;
+            }
+            probe = hit.probe;
+            return false;
+        }
+        
+        probe = parseProbe(data, length);
+        return false;
+    }
+    
+    /**
+     * @brief Scan the gallery for one probe and fill its result
+     * @param positions Finger position of each probe fingerprint
+     * @param descriptor Minutiae descriptor for the packed engine (nullptr for a reference scan)
+     * @param progress Streaming scan to report improvements to, or nullptr
+     */
+    void scanOne(const TemplateType& probe, const uint8_t* positions, const MinutiaeDescriptor* descriptor,
+                 MatchResult& result, ScanProgress* progress = nullptr) const {
+        const ProbeView view = {&probe, positions, descriptor};
+        BestMatch best;
+        size_t scanned = 0;
+        const Clock::time_point start = Clock::now();
+        const uint32_t threads = scanGallery(&view, 1, &best, scanned, scan_engine.engine, progress);
+        const Clock::time_point end = Clock::now();
+        
+        fillResult(result, best.first, best.second, scanned, start, end, threads);
+        result.stopped_early = progress != nullptr && progress->stopped();
+        TraceRecorder::instance().record("scan", start, end, TraceRecorder::currentMatchId());
+    }
+    
+    /**
+     * @brief Memory a template costs beside its parsed form (approximate, for budgets)
+     */
+    static size_t sideBytes(const GalleryRecord& record, size_t views) {
+        return sizeof(GalleryRecord) + record.id.size() + record.data.size() +       // enrolled_records
+               sizeof(TemplateId) + sizeof(std::string) + record.id.size() +       // enrolled_ids
+               sizeof(std::vector<uint8_t>) + views + sizeof(FingerMask) +         // positions and mask
+               views * sizeof(uint32_t);                                           // partition entries
+    }
+    
+    /**
+     * @brief Append the descriptor of a record to a packed gallery
+     */
+    static void packInto(PackedGallery& gallery, const GalleryRecord& record) {
+        MinutiaeDescriptor descriptor;
+        describeMinutiae(record.data.data(), record.data.size(), false, descriptor);
+        gallery.append(descriptor);
+    }
+    
+    /**
+     * @brief Pack the descriptor of a record for the packed engine
+     */
+    void packDescriptor(const GalleryRecord& record) {
+        packInto(packed_gallery, record);
+        side_bytes += kDescriptorBytes;
+    }
+    
+    /**
+     * @brief Switch to the staged descriptors if they were built from the current gallery
+     * @return false (and the stale descriptors are dropped) if the gallery changed since
+     */
+    bool adoptStaged() {
+        std::lock_guard<std::mutex> staging_lock(staging_mutex);
+        const bool fresh = staged && staged_version == gallery_version;
+        if (fresh) {
+            std::lock_guard<std::mutex> lock(store_mutex);
+            side_bytes -= packed_gallery.size() * kDescriptorBytes;
+            packed_gallery = std::move(staged_gallery);
+            side_bytes += packed_gallery.size() * kDescriptorBytes;
+        }
+        staged_gallery = PackedGallery();
+        staged = false;
+        return fresh;
+    }
+    
+    /**
+     * @brief Build the packed gallery from the enrolled records, or release it
+     */
+    void repack(bool packed) {
+        std::lock_guard<std::mutex> lock(store_mutex);
+        side_bytes -= packed_gallery.size() * kDescriptorBytes;
+        packed_gallery.clear();
+        if (packed) {
+            packed_gallery.reserve(enrolled_records.size());
+            for (const auto& record : enrolled_records) {
+                packDescriptor(record);
+            }
+        }
+    }
+    
+    /**
+     * @brief Add a parsed template with its raw record, journaling the enrollment
+     */
+    void addTemplate(TemplateType&& parsed, const uint8_t* data, size_t length, bool journaled) {
+        std::lock_guard<std::mutex> lock(store_mutex);
+        enrolled_records.push_back({parsed.id(), std::vector<uint8_t>(data, data + length)});
+        enrolled_ids.emplace_back(parsed.id());
+        
+        std::vector<uint8_t> positions;
+        viewPositions(data, length, parsed.fingerprints().size(), positions);
+        FingerMask mask = 0;
+        for (uint8_t position : positions) {
+            mask |= fingerBit(position);
+        }
+        for (size_t position = 0; position < kFingerPositions; position++) {
+            if (mask & fingerBit(static_cast<uint8_t>(position))) {
+                partitions[position].push_back(static_cast<uint32_t>(enrolled_templates.size()));
+            }
+        }
+        enrolled_positions.push_back(std::move(positions));
+        enrolled_masks.push_back(mask);
+        if (scan_engine.engine == ScanEngine::Packed) {
+            packDescriptor(enrolled_records.back());
+        }
+        
+        memory_bytes += parsed.bytes();
+        side_bytes += sideBytes(enrolled_records.back(), enrolled_positions.back().size());
+        enrolled_templates.emplace_back(std::move(parsed));
+        template_count = enrolled_templates.size();
+        gallery_version++;
+        if (journaled && journal.append(EnrollmentJournal::Operation::Enroll, enrolled_records.back().id,
+                                        data, length) != 0) {
+            notifyCompactorIfDue();
+        } else if (journaled) {
+            unstored_templates = true;
+        }
+        publishChange(EnrollmentJournal::Operation::Enroll, enrolled_records.back().id, data, length);
+    }
+    
+    /**
+     * @brief Remove a template by ID, journaling the removal
+     */
+    bool eraseTemplate(const std::string& template_id, bool journaled) {
+        std::lock_guard<std::mutex> lock(store_mutex);
+        auto it = findTemplate(template_id);
+        if (it == enrolled_templates.end()) {
+            return false;
+        }
+        const auto index = it - enrolled_templates.begin();
+        side_bytes -= sideBytes(enrolled_records[index], enrolled_positions[index].size());
+        enrolled_records.erase(enrolled_records.begin() + index);
+        enrolled_ids.erase(enrolled_ids.begin() + index);
+        enrolled_positions.erase(enrolled_positions.begin() + index);
+        enrolled_masks.erase(enrolled_masks.begin() + index);
+        if (static_cast<size_t>(index) < packed_gallery.size()) {
+            packed_gallery.erase(static_cast<size_t>(index));
+            side_bytes -= kDescriptorBytes;
+        }
+        memory_bytes -= it->bytes();
+        enrolled_templates.erase(it);
+        template_count = enrolled_templates.size();
+        rebuildPartitions();
+        gallery_version++;
+        if (journaled && journal.append(EnrollmentJournal::Operation::Remove, template_id) != 0) {
+            notifyCompactorIfDue();
+        }
+        publishChange(EnrollmentJournal::Operation::Remove, template_id);
+        return true;
+    }
+    
+    /**
+     * @brief Re-index the finger position partitions after templates moved
+     */
+    void rebuildPartitions() {
+        for (auto& partition : partitions) {
+            partition.clear();
+        }
+        for (size_t index = 0; index < enrolled_masks.size(); index++) {
+            for (size_t position = 0; position < kFingerPositions; position++) {
+                if (enrolled_masks[index] & fingerBit(static_cast<uint8_t>(position))) {
+                    partitions[position].push_back(static_cast<uint32_t>(index));
+                }
+            }
+        }
+    }
+    
+    /**
+     * @brief Remove every template, journaling the clear
+     */
+    void clearAll(bool journaled) {
+        std::lock_guard<std::mutex> lock(store_mutex);
+        enrolled_templates.clear();
+        enrolled_records.clear();
+        enrolled_ids.clear();
+        enrolled_positions.clear();
+        enrolled_masks.clear();
+        packed_gallery.clear();
+        rebuildPartitions();
+        memory_bytes = 0;
+        template_count = 0;
+        side_bytes = 0;
+        gallery_version++;
+        unstored_templates = false;
+        if (journaled) {
+            journal.append(EnrollmentJournal::Operation::Clear, std::string());
+        }
+        publishChange(EnrollmentJournal::Operation::Clear, std::string());
+    }
+    
+    /**
+     * @brief Append a change to the published shared gallery (caller holds store_mutex)
+     */
+    void publishChange(EnrollmentJournal::Operation operation, const std::string& template_id,
+                       const uint8_t* data = nullptr, size_t length = 0) {
+        if (!shared_segment.isWriter() || shared_segment.append(operation, template_id, data, length)) {
+            return;
+        }
+        // The log is full: start it over as the live gallery
+        if (!shared_segment.rewrite(enrolled_records)) {
+            std::cerr << "Shared gallery " << shared_segment.name()
+                      << " is full; replicas are stale until it is published with more capacity" << std::endl;
+        }
+    }
+    
+    /**
+     * @brief Refuse an enrollment change on a shared gallery replica
+     */
+    bool rejectOnReplica(const char* operation) const {
+        if (!shared_segment.isReader()) {
+            return false;
+        }
+        std::cerr << "Cannot " << operation << ": gallery is a read-only replica of shared gallery "
+                  << shared_segment.name() << std::endl;
+        return true;
+    }
+    
+    /**
+     * @brief Parse and add a stored record without logging or journaling (recovery path)
+     */
+    bool restoreRecord(const std::string& template_id, const std::vector<uint8_t>& data) {
+        if (findTemplate(template_id) != enrolled_templates.end()) {
+            return false;
+        }
+        TemplateType parsed(template_id);
+        if (!loadRecord(parsed, data.data(), data.size()) || parsed.fingerprints().empty()) {
+            std::cerr << "Skipping unparseable stored template '" << template_id << "'" << std::endl;
+            return false;
+        }
+        addTemplate(std::move(parsed), data.data(), data.size(), false);
+        return true;
+    }
+    
+    /**
+     * @brief Apply one replayed journal entry
+     */
+    void applyEntry(const EnrollmentJournal::Entry& entry) {
+        switch (entry.operation) {
+            case EnrollmentJournal::Operation::Enroll:
+                restoreRecord(entry.id, entry.data);
+                break;
+            case EnrollmentJournal::Operation::Remove:
+                eraseTemplate(entry.id, false);
+                break;
+            case EnrollmentJournal::Operation::Clear:
+                clearAll(false);
+                break;
+        }
+    }
+    
+    /**
+     * @brief Copy the raw records under the store lock
+     */
+    std::vector<GalleryRecord> copyRecords() const {
+        std::lock_guard<std::mutex> lock(store_mutex);
+        return enrolled_records;
+    }
+    
+    /**
+     * @brief Snapshot the gallery and retire the journal entries it covers
+     */
+    bool compact() {
+        std::vector<GalleryRecord> records;
+        uint64_t sequence = 0;
+        {
+            // Appends are blocked while the journal is rotated, so the copy and the sequence agree
+            std::lock_guard<std::mutex> lock(store_mutex);
+            if (!journal.isOpen()) {
+                return false;
+            }
+            records = enrolled_records;
+            sequence = journal.lastSequence();
+            if (!journal.rotate(retiredJournalPath())) {
+                return false;
+            }
+        }
+        
+        if (!writeGallerySnapshot(snapshotPath(), sequence, records)) {
+            return false; // The retired journal is kept and replayed on the next start
+        }
+        
+        std::error_code ec;
+        std::filesystem::remove(retiredJournalPath(), ec);
+        return true;
+    }
     
-    Impl(uint8_t threshold) : similarity_threshold(threshold) {
-        // Initialize OpenAFIS logging
-        OpenAFIS::Log::init();
+    void notifyCompactorIfDue() {
+        if (journal.sizeBytes() >= journal_options.compaction_bytes) {
+            compactor_cv.notify_one();
+        }
     }
     
-    /**
-     * @brief Find template by ID
-     */
-    Templates::iterator findTemplate(const std::string& template_id) {
-        return std::find_if(enrolled_templates.begin(), enrolled_templates.end(),
-            [&template_id](const TemplateType& t) {
-                return t.id() == template_id;
-            });
+    void startCompactor() {
+        compactor_stopping = false;
+        compactor = std::thread([this] {
+            std::unique_lock<std::mutex> lock(compactor_mutex);
+            while (!compactor_stopping) {
+                compactor_cv.wait_for(lock, journal_options.compaction_interval);
+                if (compactor_stopping) {
+                    break;
+                }
+                if (journal.sizeBytes() >= journal_options.compaction_bytes) {
+                    lock.unlock();
+                    if (!compact()) {
+                        std::cerr << "Background journal compaction failed" << std::endl;
+                    }
+                    lock.lock();
+                }
+            }
+        });
     }
     
-    /**
-     * @brief Find template by ID (const version)
-     */
-    Templates::const_iterator findTemplate(const std::string& template_id) const {
-        return std::find_if(enrolled_templates.begin(), enrolled_templates.end(),
-            [&template_id](const TemplateType& t) {
-                return t.id() == template_id;
-            });
+    void stopCompactor() {
+        {
+            std::lock_guard<std::mutex> lock(compactor_mutex);
+            compactor_stopping = true;
+        }
+        compactor_cv.notify_all();
+        if (compactor.joinable()) {
+            compactor.join();
+        }
     }
 };
 
@@ -56,6 +1057,10 @@ FingerprintMatcher::FingerprintMatcher(uint8_t similarity_threshold)
 FingerprintMatcher::~FingerprintMatcher() = default;
 
 bool FingerprintMatcher::loadTemplate(const std::string& template_id, const std::string& file_path) {
+    if (pImpl->rejectOnReplica("load a template")) {
+        return false;
+    }
+    
     try {
         // Check if template with this ID already exists
         if (pImpl->findTemplate(template_id) != pImpl->enrolled_templates.end()) {
@@ -78,8 +1083,12 @@ bool FingerprintMatcher::loadTemplate(const std::string& template_id, const std:
             return false;
         }
         
+        // Keep the raw record for snapshots and the journal
+        std::ifstream file(file_path, std::ios::binary);
+        std::vector<uint8_t> record((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        
         // Add to enrolled templates
-        pImpl->enrolled_templates.emplace_back(std::move(new_template));
+        pImpl->addTemplate(std::move(new_template), record.data(), record.size(), true);
         
         std::cout << "Successfully loaded template '" << template_id 
                   << "' with " << pImpl->enrolled_templates.back().fingerprints().size() 
@@ -93,6 +1102,10 @@ bool FingerprintMatcher::loadTemplate(const std::string& template_id, const std:
 }
 
 bool FingerprintMatcher::loadTemplate(const std::string& template_id, const uint8_t* data, size_t length) {
+    if (pImpl->rejectOnReplica("load a template")) {
+        return false;
+    }
+    
     try {
         // Check if template with this ID already exists
         if (pImpl->findTemplate(template_id) != pImpl->enrolled_templates.end()) {
@@ -106,37 +1119,22 @@ bool FingerprintMatcher::loadTemplate(const std::string& template_id, const uint
         // Create new template
         TemplateType new_template(template_id);
         
-        if (length >= 8) {
+        if (length >= 12) {
             std::cout << "Header: " << std::hex;
             for (int i = 0; i < 8; i++) {
                 std::cout << static_cast<int>(data[i]) << " ";
             }
             std::cout << std::dec << std::endl;
             
-            // Check ISO 19794-2 length field (bytes 8-11 after 8-byte magic, big-endian)
             uint32_t header_length = (data[8] << 24) | (data[9] << 16) | (data[10] << 8) | data[11];
             std::cout << "Header length field: " << header_length << ", Actual length: " << length << std::endl;
-            
             if (header_length != length) {
                 std::cout << "WARNING: Length mismatch - trying to fix header" << std::endl;
-                // Create a copy of the data with corrected length
-                std::vector<uint8_t> corrected_data(data, data + length);
-                corrected_data[8] = (length >> 24) & 0xFF;
-                corrected_data[9] = (length >> 16) & 0xFF;
-                corrected_data[10] = (length >> 8) & 0xFF;
-                corrected_data[11] = length & 0xFF;
-                
-                // Try loading with corrected data
-                if (!new_template.load(corrected_data.data(), corrected_data.size())) {
-                    std::cerr << "Failed to load template even with corrected header" << std::endl;
-                    return false;
-                }
-            } else {
-                // Normal loading
-                if (!new_template.load(data, length)) {
-                    std::cerr << "Failed to load template from raw data" << std::endl;
-                    return false;
-                }
+            }
+            
+            if (!Impl::loadRecord(new_template, data, length)) {
+                std::cerr << "Failed to load template from raw data" << std::endl;
+                return false;
             }
         } else {
             // Data too short
@@ -151,7 +1149,7 @@ bool FingerprintMatcher::loadTemplate(const std::string& template_id, const uint
         }
         
         // Add to enrolled templates
-        pImpl->enrolled_templates.emplace_back(std::move(new_template));
+        pImpl->addTemplate(std::move(new_template), data, length, true);
         
         std::cout << "Successfully loaded template '" << template_id 
                   << "' with " << pImpl->enrolled_templates.back().fingerprints().size() 
@@ -164,6 +1162,227 @@ bool FingerprintMatcher::loadTemplate(const std::string& template_id, const uint
     }
 }
 
+bool FingerprintMatcher::removeTemplate(const std::string& template_id) {
+    if (pImpl->rejectOnReplica("remove a template")) {
+        return false;
+    }
+    return pImpl->eraseTemplate(template_id, true);
+}
+
+bool FingerprintMatcher::saveSnapshot(const std::string& path) const {
+    uint64_t sequence = pImpl->journal.lastSequence();
+    return writeGallerySnapshot(path, sequence, pImpl->copyRecords());
+}
+
+bool FingerprintMatcher::loadSnapshot(const std::string& path) {
+    if (pImpl->rejectOnReplica("load a snapshot")) {
+        return false;
+    }
+    if (pImpl->journal.isOpen()) {
+        std::cerr << "Cannot load a snapshot while a journal is attached" << std::endl;
+        return false;
+    }
+    
+    uint64_t sequence = 0;
+    std::vector<GalleryRecord> records;
+    if (!readGallerySnapshot(path, sequence, records)) {
+        return false;
+    }
+    
+    pImpl->clearAll(false);
+    for (const auto& record : records) {
+        pImpl->restoreRecord(record.id, record.data);
+    }
+    pImpl->unstored_templates = !pImpl->enrolled_templates.empty();
+    std::cout << "Loaded " << pImpl->enrolled_templates.size() << " template(s) from snapshot " << path << std::endl;
+    return true;
+}
+
+bool FingerprintMatcher::openJournal(const std::string& directory, const JournalOptions& options) {
+    if (pImpl->rejectOnReplica("open a journal")) {
+        return false;
+    }
+    if (hasUnstoredTemplates()) {
+        std::cerr << "Cannot open a journal over " << pImpl->enrolled_templates.size()
+                  << " template(s) that no store records; clear the gallery first" << std::endl;
+        return false;
+    }
+    closeJournal();
+    
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec) {
+        std::cerr << "Failed to create store directory " << directory << ": " << ec.message() << std::endl;
+        return false;
+    }
+    
+    pImpl->store_directory = directory;
+    pImpl->journal_options = options;
+    
+    // Base state: the latest snapshot, if any
+    uint64_t sequence = 0;
+    std::vector<GalleryRecord> records;
+    if (std::filesystem::exists(pImpl->snapshotPath(), ec) &&
+        !readGallerySnapshot(pImpl->snapshotPath(), sequence, records)) {
+        return false; // Refuse to start from an empty gallery over a corrupt snapshot
+    }
+    
+    pImpl->clearAll(false);
+    for (const auto& record : records) {
+        pImpl->restoreRecord(record.id, record.data);
+    }
+    
+    // Changes since the snapshot: a retired journal left by an interrupted compaction, then the live one
+    auto apply = [this](const EnrollmentJournal::Entry& entry) { pImpl->applyEntry(entry); };
+    const bool had_retired = std::filesystem::exists(pImpl->retiredJournalPath(), ec);
+    uint64_t last_sequence = sequence;
+    if (!EnrollmentJournal::replay(pImpl->retiredJournalPath(), sequence, apply, last_sequence) ||
+        !EnrollmentJournal::replay(pImpl->journalPath(), last_sequence, apply, last_sequence)) {
+        return false;
+    }
+    
+    if (!pImpl->journal.open(pImpl->journalPath(), last_sequence, options.group_commit_window)) {
+        return false;
+    }
+    
+    std::cout << "Recovered " << pImpl->enrolled_templates.size() << " template(s) from " << directory
+              << " (journal sequence " << last_sequence << ")" << std::endl;
+    
+    // Finish a compaction that was interrupted before its snapshot landed
+    if (had_retired && !pImpl->compact()) {
+        std::cerr << "Failed to complete interrupted journal compaction" << std::endl;
+    }
+    
+    pImpl->startCompactor();
+    return true;
+}
+
+void FingerprintMatcher::closeJournal() {
+    pImpl->stopCompactor();
+    pImpl->journal.close();
+}
+
+bool FingerprintMatcher::syncJournal() {
+    return pImpl->journal.isOpen() && pImpl->journal.sync();
+}
+
+bool FingerprintMatcher::hasUnstoredTemplates() const {
+    return pImpl->unstored_templates && !pImpl->enrolled_templates.empty();
+}
+
+bool FingerprintMatcher::journalFailed() const {
+    return pImpl->journal.failed();
+}
+
+bool FingerprintMatcher::compactJournal() {
+    return pImpl->compact();
+}
+
+bool FingerprintMatcher::publishSharedGallery(const std::string& name, size_t capacity) {
+    if (pImpl->rejectOnReplica("publish")) {
+        return false;
+    }
+    // Publishing the same name again keeps it (and its replicas); a new name retires the old one
+    if (pImpl->shared_segment.isWriter() && pImpl->shared_segment.name() != name) {
+        detachSharedGallery();
+    }
+    
+    std::lock_guard<std::mutex> lock(pImpl->store_mutex);
+    if (!pImpl->shared_segment.create(name, capacity)) {
+        return false;
+    }
+    if (!pImpl->shared_segment.rewrite(pImpl->enrolled_records)) {
+        std::cerr << "Shared gallery " << name << " is too small for " << pImpl->enrolled_records.size()
+                  << " template(s)" << std::endl;
+        pImpl->shared_segment.close();
+        return false;
+    }
+    std::cout << "Published " << pImpl->enrolled_records.size() << " template(s) to shared gallery " << name
+              << std::endl;
+    return true;
+}
+
+bool FingerprintMatcher::attachSharedGallery(const std::string& name) {
+    if (pImpl->journal.isOpen()) {
+        std::cerr << "Cannot attach a shared gallery while a journal is attached" << std::endl;
+        return false;
+    }
+    detachSharedGallery();
+    if (!pImpl->shared_segment.attach(name)) {
+        return false;
+    }
+    
+    // An epoch the segment cannot have makes the first refresh replay the whole log
+    pImpl->clearAll(false);
+    pImpl->shared_epoch = std::numeric_limits<uint64_t>::max();
+    pImpl->shared_offset = 0;
+    if (!refreshSharedGallery()) {
+        pImpl->shared_segment.close();
+        return false;
+    }
+    std::cout << "Attached shared gallery " << name << " with " << pImpl->enrolled_templates.size()
+              << " template(s)" << std::endl;
+    return true;
+}
+
+bool FingerprintMatcher::sharedGalleryChanged() const {
+    return pImpl->shared_segment.isReader() &&
+           pImpl->shared_segment.generation() != pImpl->shared_generation.load(std::memory_order_relaxed);
+}
+
+bool FingerprintMatcher::refreshSharedGallery() {
+    SharedGallerySegment& segment = pImpl->shared_segment;
+    if (!segment.isReader()) {
+        return false;
+    }
+    
+    uint64_t generation = segment.generation();
+    std::vector<EnrollmentJournal::Entry> entries;
+    bool replaced = false;
+    if (!segment.read(pImpl->shared_epoch, pImpl->shared_offset, entries, replaced)) {
+        // The writer may have grown the segment past our mapping: map it again and retry once
+        const std::string name = segment.name();
+        if (!segment.remap()) {
+            return false;
+        }
+        generation = segment.generation();
+        if (!segment.read(pImpl->shared_epoch, pImpl->shared_offset, entries, replaced)) {
+            std::cerr << "Failed to read shared gallery " << name << std::endl;
+            return false;
+        }
+    }
+    
+    if (replaced) {
+        pImpl->clearAll(false);
+    }
+    for (const auto& entry : entries) {
+        pImpl->applyEntry(entry);
+    }
+    pImpl->shared_generation.store(generation, std::memory_order_relaxed);
+    return true;
+}
+
+void FingerprintMatcher::detachSharedGallery() {
+    SharedGallerySegment& segment = pImpl->shared_segment;
+    if (!segment.isOpen()) {
+        return;
+    }
+    const std::string name = segment.name();
+    const bool writer = segment.isWriter();
+    {
+        std::lock_guard<std::mutex> lock(pImpl->store_mutex);
+        segment.close();
+    }
+    // Replicas keep their mappings; new ones can no longer attach
+    if (writer) {
+        SharedGallerySegment::unlink(name);
+    }
+}
+
+bool FingerprintMatcher::isSharedGalleryReplica() const {
+    return pImpl->shared_segment.isReader();
+}
+
 MatchResult FingerprintMatcher::match1to1(const std::string& probe_id, const std::string& candidate_id) {
     MatchResult result;
     
@@ -183,21 +1402,20 @@ MatchResult FingerprintMatcher::match1to1(const std::string& probe_id, const std
         // Record start time
         auto start_time = std::chrono::high_resolution_clock::now();
         
-        // Perform matching using OpenAFIS
-        OpenAFIS::MatchSimilarity matcher;
+        // Perform matching using OpenAFIS (per-thread scratch)
         uint8_t similarity_score = 0;
         
         // Match first fingerprint from each template
-        matcher.compute(similarity_score, 
-                       probe_it->fingerprints()[0], 
-                       candidate_it->fingerprints()[0]);
+        threadSimilarity().compute(similarity_score, 
+                                   probe_it->fingerprints()[0], 
+                                   candidate_it->fingerprints()[0]);
         
         // Record end time
         auto end_time = std::chrono::high_resolution_clock::now();
         
         // Fill result
         result.similarity_score = similarity_score;
-        result.matched_template_id = candidate_id;
+        result.matched_template_id = pImpl->enrolled_ids[candidate_it - pImpl->enrolled_templates.begin()];
         result.match_time = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
         result.is_match = (similarity_score >= pImpl->similarity_threshold);
         
@@ -223,22 +1441,17 @@ MatchResult FingerprintMatcher::match1toN(const std::string& probe_id) {
             throw FingerprintMatcherException("Probe template not found: " + probe_id);
         }
         
-        // Record start time
-        auto start_time = std::chrono::high_resolution_clock::now();
-        
-        // Perform 1:N matching using OpenAFIS
-        auto match_result = pImpl->matcher.oneMany(*probe_it, pImpl->enrolled_templates);
-        
-        // Record end time
-        auto end_time = std::chrono::high_resolution_clock::now();
-        
-        // Fill result
-        result.similarity_score = match_result.first;
-        if (match_result.second != nullptr) {
-            result.matched_template_id = match_result.second->id();
+        // Perform 1:N matching on the shared scan pool
+        const size_t index = static_cast<size_t>(probe_it - pImpl->enrolled_templates.begin());
+        MinutiaeDescriptor enrolled;
+        const MinutiaeDescriptor* descriptor = nullptr;
+        if (pImpl->scan_engine.engine == ScanEngine::Packed) {
+            const GalleryRecord& record = pImpl->enrolled_records[index];
+            if (describeMinutiae(record.data.data(), record.data.size(), false, enrolled)) {
+                descriptor = &enrolled;
+            }
         }
-        result.match_time = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-        result.is_match = (result.similarity_score >= pImpl->similarity_threshold);
+        pImpl->scanOne(*probe_it, pImpl->enrolled_positions[index].data(), descriptor, result);
         
     } catch (const std::exception& e) {
         std::cerr << "Error in 1:N matching: " << e.what() << std::endl;
@@ -256,47 +1469,198 @@ MatchResult FingerprintMatcher::match1toNFromFile(const std::string& probe_file_
             throw FingerprintMatcherException("No templates enrolled for matching");
         }
         
-        // Load probe template temporarily
-        TemplateType probe_template("__temp_probe__");
-        if (!probe_template.load(probe_file_path)) {
+        // Read the record into the thread's buffer and parse it into a recycled probe template
+        std::vector<uint8_t>& record = threadArena().file_record;
+        std::ifstream file(probe_file_path, std::ios::binary | std::ios::ate);
+        if (!file) {
             throw FingerprintMatcherException("Failed to load probe template: " + probe_file_path);
         }
+        record.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(record.data()), static_cast<std::streamsize>(record.size()));
         
-        if (probe_template.fingerprints().empty()) {
+        std::shared_ptr<TemplateType> probe_template =
+            file ? pImpl->parseProbe(record.data(), record.size()) : nullptr;
+        if (!probe_template) {
             throw FingerprintMatcherException("Probe template contains no fingerprints: " + probe_file_path);
         }
         
-        // Record start time
-        auto start_time = std::chrono::high_resolution_clock::now();
+        // Perform 1:N matching on the shared scan pool
+        std::vector<uint8_t>& positions = threadArena().positions;
+        viewPositions(record.data(), record.size(), probe_template->fingerprints().size(), positions);
+        pImpl->scanOne(*probe_template, positions.data(), pImpl->describeProbe(record.data(), record.size()), result);
         
-        // Perform 1:N matching using OpenAFIS
-        auto match_result = pImpl->matcher.oneMany(probe_template, pImpl->enrolled_templates);
+    } catch (const std::exception& e) {
+        std::cerr << "Error in 1:N matching with file: " << e.what() << std::endl;
+        result = MatchResult(); // Reset to default values
+    }
+    
+    return result;
+}
+
+MatchResult FingerprintMatcher::match1toN(const uint8_t* data, size_t length) {
+    MatchResult result;
+    
+    try {
+        if (pImpl->enrolled_templates.empty()) {
+            throw FingerprintMatcherException("No templates enrolled for matching");
+        }
         
-        // Record end time
-        auto end_time = std::chrono::high_resolution_clock::now();
+        std::shared_ptr<const TemplateType> probe_template;
+        if (pImpl->lookupProbe(data, length, result, probe_template)) {
+            return result;
+        }
+        if (!probe_template) {
+            throw FingerprintMatcherException("Failed to load probe template from raw data");
+        }
         
-        // Fill result
-        result.similarity_score = match_result.first;
-        if (match_result.second != nullptr) {
-            result.matched_template_id = match_result.second->id();
+        std::vector<uint8_t>& positions = threadArena().positions;
+        viewPositions(data, length, probe_template->fingerprints().size(), positions);
+        pImpl->scanOne(*probe_template, positions.data(), pImpl->describeProbe(data, length), result);
+        pImpl->probe_cache.store(data, length, probe_template, pImpl->gallery_version,
+                                 result.similarity_score, result.matched_template_id);
+        
+    } catch (const std::exception& e) {
+        std::cerr << "Error in 1:N matching with raw data: " << e.what() << std::endl;
+        result = MatchResult(); // Reset to default values
+    }
+    
+    return result;
+}
+
+MatchResult FingerprintMatcher::match1toNStream(const uint8_t* data, size_t length,
+                                              const MatchProgressCallback& on_progress,
+                                              const std::atomic<bool>* cancel) {
+    MatchResult result;
+    
+    try {
+        if (pImpl->enrolled_templates.empty()) {
+            throw FingerprintMatcherException("No templates enrolled for matching");
+        }
+        
+        ScanProgress progress(on_progress, pImpl->similarity_threshold, cancel);
+        std::shared_ptr<const TemplateType> probe_template;
+        if (pImpl->lookupProbe(data, length, result, probe_template)) {
+            if (!result.matched_template_id.empty()) {
+                progress.offer(result.similarity_score, result.matched_template_id);
+            }
+            return result;
+        }
+        if (!probe_template) {
+            throw FingerprintMatcherException("Failed to load probe template from raw data");
+        }
+        
+        std::vector<uint8_t>& positions = threadArena().positions;
+        viewPositions(data, length, probe_template->fingerprints().size(), positions);
+        pImpl->scanOne(*probe_template, positions.data(), pImpl->describeProbe(data, length), result, &progress);
+        if (!result.stopped_early) {
+            pImpl->probe_cache.store(data, length, probe_template, pImpl->gallery_version,
+                                     result.similarity_score, result.matched_template_id);
         }
-        result.match_time = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-        result.is_match = (result.similarity_score >= pImpl->similarity_threshold);
         
     } catch (const std::exception& e) {
-        std::cerr << "Error in 1:N matching with file: " << e.what() << std::endl;
+        std::cerr << "Error in streaming 1:N matching: " << e.what() << std::endl;
         result = MatchResult(); // Reset to default values
     }
     
     return result;
 }
 
+std::vector<MatchResult> FingerprintMatcher::match1toNBatch(const std::vector<std::vector<uint8_t>>& probes) {
+    std::vector<MatchResult> results(probes.size());
+    ThreadArena& arena = threadArena();
+    
+    // While tracing, spans of this pass are correlated under one batch ID
+    const uint64_t caller_match_id = TraceRecorder::currentMatchId();
+    if (TraceRecorder::instance().active()) {
+        TraceRecorder::setCurrentMatchId(TraceRecorder::nextMatchId());
+    }
+    
+    // Parsed probes are borrowed from the arena / cache only for the duration of the call
+    std::vector<std::shared_ptr<const TemplateType>>& parsed = arena.batch_probes;
+    std::vector<ProbeView>& views = arena.batch_views;
+    std::vector<uint8_t>& positions = arena.batch_positions;
+    std::vector<size_t>& offsets = arena.batch_offsets;
+    std::vector<size_t>& slots = arena.batch_slots;
+    std::vector<MinutiaeDescriptor>& descriptors = arena.batch_descriptors;
+    std::vector<uint8_t>& described = arena.batch_described;
+    parsed.clear();
+    views.clear();
+    positions.clear();
+    offsets.clear();
+    slots.clear();
+    descriptors.clear();
+    described.clear();
+    
+    try {
+        if (pImpl->enrolled_templates.empty()) {
+            throw FingerprintMatcherException("No templates enrolled for matching");
+        }
+        
+        // Parse (or fetch) all probes up front; slots maps parsed probes back to their input position.
+        // Probes with a cached result for this gallery version are answered without scanning.
+        for (size_t i = 0; i < probes.size(); i++) {
+            std::shared_ptr<const TemplateType> probe_template;
+            if (pImpl->lookupProbe(probes[i].data(), probes[i].size(), results[i], probe_template)) {
+                continue;
+            }
+            if (probe_template) {
+                // Positions of every probe share one buffer; views point into it once it stops growing
+                std::vector<uint8_t>& probe_positions = arena.positions;
+                viewPositions(probes[i].data(), probes[i].size(), probe_template->fingerprints().size(), probe_positions);
+                offsets.push_back(positions.size());
+                positions.insert(positions.end(), probe_positions.begin(), probe_positions.end());
+                const MinutiaeDescriptor* descriptor = pImpl->describeProbe(probes[i].data(), probes[i].size());
+                descriptors.push_back(descriptor != nullptr ? *descriptor : MinutiaeDescriptor());
+                described.push_back(descriptor != nullptr);
+                views.push_back({probe_template.get(), nullptr, nullptr});
+                parsed.push_back(std::move(probe_template));
+                slots.push_back(i);
+            }
+        }
+        
+        if (!parsed.empty()) {
+            for (size_t p = 0; p < views.size(); p++) {
+                views[p].positions = positions.data() + offsets[p];
+                views[p].descriptor = described[p] ? &descriptors[p] : nullptr;
+            }
+            arena.best.resize(parsed.size());
+            size_t scanned = 0;
+            const Clock::time_point start = Clock::now();
+            const uint32_t threads = pImpl->scanGallery(views.data(), views.size(), arena.best.data(), scanned,
+                                                        pImpl->scan_engine.engine);
+            const Clock::time_point end = Clock::now();
+            TraceRecorder::instance().record("scan.batch", start, end, TraceRecorder::currentMatchId());
+            
+            for (size_t p = 0; p < parsed.size(); p++) {
+                MatchResult& result = results[slots[p]];
+                pImpl->fillResult(result, arena.best[p].first, arena.best[p].second, scanned, start, end, threads);
+                const auto& probe_bytes = probes[slots[p]];
+                pImpl->probe_cache.store(probe_bytes.data(), probe_bytes.size(), parsed[p], pImpl->gallery_version,
+                                         result.similarity_score, result.matched_template_id);
+            }
+        }
+        
+    } catch (const std::exception& e) {
+        std::cerr << "Error in batched 1:N matching: " << e.what() << std::endl;
+        std::fill(results.begin(), results.end(), MatchResult());
+    }
+    
+    // Hand the probe templates back to the arena
+    parsed.clear();
+    TraceRecorder::setCurrentMatchId(caller_match_id);
+    return results;
+}
+
 size_t FingerprintMatcher::getEnrolledCount() const {
-    return pImpl->enrolled_templates.size();
+    return pImpl->template_count.load(std::memory_order_relaxed);
 }
 
 void FingerprintMatcher::clearTemplates() {
-    pImpl->enrolled_templates.clear();
+    if (pImpl->rejectOnReplica("clear the gallery")) {
+        return;
+    }
+    pImpl->clearAll(true);
     std::cout << "All templates cleared" << std::endl;
 }
 
@@ -310,15 +1674,157 @@ uint8_t FingerprintMatcher::getSimilarityThreshold() const {
 }
 
 size_t FingerprintMatcher::getConcurrency() const {
-    return pImpl->matcher.concurrency();
+    return ScanPool::shared().workers();
 }
 
-size_t FingerprintMatcher::getMemoryUsage() const {
-    size_t total_bytes = 0;
-    for (const auto& template_obj : pImpl->enrolled_templates) {
-        total_bytes += template_obj.bytes();
+void FingerprintMatcher::configureProbeCache(size_t capacity, std::chrono::milliseconds ttl) {
+    pImpl->probe_cache.configure(capacity, ttl);
+}
+
+ProbeCacheStats FingerprintMatcher::getProbeCacheStats() const {
+    return pImpl->probe_cache.stats();
+}
+
+uint64_t FingerprintMatcher::getGalleryVersion() const {
+    return pImpl->gallery_version;
+}
+
+bool FingerprintMatcher::setFingerCompatibility(uint8_t probe_position, const std::vector<uint8_t>& gallery_positions) {
+    if (!pImpl->finger_compatibility.set(probe_position, gallery_positions)) {
+        std::cerr << "Invalid finger position in compatibility map (expected 0-10)" << std::endl;
+        return false;
+    }
+    // Cached results were searched with the previous map
+    pImpl->gallery_version++;
+    return true;
+}
+
+void FingerprintMatcher::resetFingerCompatibility() {
+    pImpl->finger_compatibility.reset();
+    pImpl->gallery_version++;
+}
+
+std::vector<uint8_t> FingerprintMatcher::getFingerCompatibility(uint8_t probe_position) const {
+    std::vector<uint8_t> gallery_positions;
+    if (probe_position >= kFingerPositions) {
+        return gallery_positions;
+    }
+    const FingerMask mask = pImpl->finger_compatibility.gallery(probe_position);
+    for (uint8_t position = 0; position < kFingerPositions; position++) {
+        if (mask & fingerBit(position)) {
+            gallery_positions.push_back(position);
+        }
+    }
+    return gallery_positions;
+}
+
+std::vector<size_t> FingerprintMatcher::getFingerPartitionSizes() const {
+    std::vector<size_t> sizes;
+    for (const auto& partition : pImpl->partitions) {
+        sizes.push_back(partition.size());
+    }
+    return sizes;
+}
+
+void FingerprintMatcher::prepareScanEngine(const ScanEngineOptions& options) {
+    if (options.engine != ScanEngine::Packed || pImpl->scan_engine.engine == ScanEngine::Packed) {
+        return;
+    }
+    
+    PackedGallery gallery;
+    const uint64_t version = pImpl->gallery_version;
+    gallery.reserve(pImpl->enrolled_records.size());
+    for (const auto& record : pImpl->enrolled_records) {
+        Impl::packInto(gallery, record);
+    }
+    
+    std::lock_guard<std::mutex> lock(pImpl->staging_mutex);
+    pImpl->staged_gallery = std::move(gallery);
+    pImpl->staged_version = version;
+    pImpl->staged = true;
+}
+
+bool FingerprintMatcher::configureScanEngine(const ScanEngineOptions& options, bool prepared_only) {
+    // Descriptors cost O(m^2) per template to build, so only the packed engine pays for them
+    if (options.engine != pImpl->scan_engine.engine) {
+        if (options.engine == ScanEngine::Packed && !pImpl->adoptStaged()) {
+            if (prepared_only) {
+                return false;
+            }
+            pImpl->repack(true);
+        } else if (options.engine != ScanEngine::Packed) {
+            pImpl->repack(false);
+        }
+    }
+    pImpl->scan_engine = options;
+    pImpl->scan_engine.shortlist = std::max<size_t>(1, options.shortlist);
+    // Cached results were searched by the previous engine
+    pImpl->gallery_version++;
+    if (options.engine == ScanEngine::Packed) {
+        std::cout << "Scan engine: packed (" << packedKernelName() << " pre-filter, shortlist "
+                  << pImpl->scan_engine.shortlist << ")" << std::endl;
+    } else {
+        std::cout << "Scan engine: reference" << std::endl;
+    }
+    return true;
+}
+
+ScanEngineOptions FingerprintMatcher::getScanEngineOptions() const {
+    return pImpl->scan_engine;
+}
+
+ScanEngineAccuracy FingerprintMatcher::verifyScanEngine(const std::vector<std::vector<uint8_t>>& probes) {
+    ScanEngineAccuracy accuracy;
+    ThreadArena& arena = threadArena();
+    if (pImpl->enrolled_templates.empty()) {
+        return accuracy;
+    }
+    if (pImpl->scan_engine.engine != ScanEngine::Packed) {
+        std::cerr << "Select the packed scan engine before verifying it" << std::endl;
+        return accuracy;
+    }
+    
+    for (const auto& record : probes) {
+        std::shared_ptr<TemplateType> probe = pImpl->parseProbe(record.data(), record.size());
+        MinutiaeDescriptor descriptor;
+        if (!probe || !describeMinutiae(record.data(), record.size(), true, descriptor)) {
+            continue;
+        }
+        viewPositions(record.data(), record.size(), probe->fingerprints().size(), arena.positions);
+        const ProbeView view = {probe.get(), arena.positions.data(), &descriptor};
+        
+        BestMatch reference;
+        BestMatch packed;
+        size_t scanned = 0;
+        const Clock::time_point start = Clock::now();
+        pImpl->scanGallery(&view, 1, &reference, scanned, ScanEngine::Reference);
+        const Clock::time_point middle = Clock::now();
+        pImpl->scanGallery(&view, 1, &packed, scanned, ScanEngine::Packed);
+        const Clock::time_point end = Clock::now();
+        
+        accuracy.probes++;
+        accuracy.reference_time += std::chrono::duration_cast<std::chrono::microseconds>(middle - start);
+        accuracy.packed_time += std::chrono::duration_cast<std::chrono::microseconds>(end - middle);
+        if (packed == reference) {
+            accuracy.agreements++;
+        }
+        if (reference.second != nullptr && reference.first >= pImpl->similarity_threshold) {
+            accuracy.reference_matches++;
+            if (packed.second == reference.second && packed.first >= pImpl->similarity_threshold) {
+                accuracy.matches_found++;
+            }
+        }
     }
-    return total_bytes;
+    return accuracy;
+}
+
+size_t FingerprintMatcher::getMemoryUsage() const {
+    // Maintained on enrollment so per-match result marshalling does not walk the gallery
+    return pImpl->memory_bytes;
+}
+
+size_t FingerprintMatcher::getFootprint() const {
+    return pImpl->memory_bytes + pImpl->side_bytes + pImpl->probe_cache.bytes();
 }
 
 } // namespace openafis
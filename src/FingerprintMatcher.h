@@ -2,10 +2,15 @@
 #define FINGERPRINT_MATCHER_H
 
 #include "OpenAFIS.h"
+#include "MatchTrace.h"
+#include "ProbeCache.h"
+#include "TemplateId.h"
 #include <string>
 #include <vector>
 #include <memory>
 #include <chrono>
+#include <functional>
+#include <atomic>
 
 namespace openafis {
 
@@ -14,15 +19,94 @@ namespace openafis {
  */
 struct MatchResult {
     uint8_t similarity_score;     // Similarity score (0-255)
-    std::string matched_template_id;  // ID of matched template
+    TemplateId matched_template_id;   // ID of matched template (shared handle, copying never allocates)
     std::chrono::milliseconds match_time;  // Time taken for matching
     bool is_match;               // Whether this is considered a match
+    bool from_cache;             // Served from the probe cache without scanning
+    MatchPhases phases;          // Per-phase timings (parse, scan and threads used filled here)
+    size_t candidates_scanned;   // Gallery templates in the finger position partitions searched
+    bool stopped_early;          // A streaming scan was stopped by its callback before it finished
     
-    MatchResult() : similarity_score(0), matched_template_id(""), match_time(0), is_match(false) {}
+    MatchResult()
+        : similarity_score(0), match_time(0), is_match(false), from_cache(false), candidates_scanned(0),
+          stopped_early(false) {}
+};
+
+/**
+ * @brief Best candidate so far of a streaming 1:N scan
+ */
+struct MatchProgress {
+    uint8_t similarity_score;
+    TemplateId matched_template_id;
+    bool is_match;                       // Score reaches the similarity threshold
+    size_t candidates_scored;            // Candidates scored by OpenAFIS so far, across all workers
+    size_t candidates_total;             // Candidates the scan will score
+    std::chrono::microseconds elapsed;   // Since the scan started
+    
+    MatchProgress() : similarity_score(0), is_match(false), candidates_scored(0), candidates_total(0), elapsed(0) {}
+};
+
+/**
+ * @brief Receives each improvement of a streaming scan's best candidate
+ *
+ * Called on scan worker threads, one call at a time, with strictly increasing
+ * scores. Return false to stop the scan; it then returns the best candidate found.
+ */
+using MatchProgressCallback = std::function<bool(const MatchProgress&)>;
+
+/**
+ * @brief How 1:N scans search the gallery
+ */
+enum class ScanEngine {
+    Reference,   // OpenAFIS similarity against every candidate
+    Packed       // SIMD pre-filter over packed minutiae descriptors; OpenAFIS re-scores a shortlist
+};
+
+/**
+ * @brief Scan engine settings
+ */
+struct ScanEngineOptions {
+    ScanEngine engine;
+    size_t shortlist;    // Packed: best pre-filter candidates re-scored by OpenAFIS per probe
+    
+    ScanEngineOptions() : engine(ScanEngine::Reference), shortlist(64) {}
+};
+
+/**
+ * @brief Agreement of the packed engine with the reference scan over a set of probes
+ */
+struct ScanEngineAccuracy {
+    size_t probes;                             // Probes that parsed and were scanned by both engines
+    size_t agreements;                         // Same best template and score as the reference
+    size_t reference_matches;                  // Probes the reference scan matched (score >= threshold)
+    size_t matches_found;                      // ...that the packed engine matched to the same template
+    std::chrono::microseconds reference_time;  // Total scan time of each engine
+    std::chrono::microseconds packed_time;
+    
+    ScanEngineAccuracy()
+        : probes(0), agreements(0), reference_matches(0), matches_found(0), reference_time(0), packed_time(0) {}
+};
+
+/**
+ * @brief Durability settings for an enrollment journal
+ */
+struct JournalOptions {
+    size_t compaction_bytes;                        // Fold the journal into a snapshot once it exceeds this size
+    std::chrono::milliseconds compaction_interval;  // How often the background compactor checks the journal size
+    std::chrono::microseconds group_commit_window;  // Extra wait to gather more changes into one fsync
+    
+    JournalOptions()
+        : compaction_bytes(64 * 1024 * 1024), compaction_interval(30000), group_commit_window(0) {}
 };
 
 /**
  * @brief Hardware-independent fingerprint matcher using OpenAfis
+ *
+ * 1:N scans run on a process-wide pool of persistent threads. Probe templates and
+ * scan scratch are recycled per thread (and through the probe cache), so in steady
+ * state the raw-data match paths do not allocate. The gallery is partitioned by the
+ * ISO finger position of each view; a 1:N search only visits the partitions the
+ * finger compatibility map allows for the probe's positions.
  */
 class FingerprintMatcher {
 public:
@@ -54,6 +138,124 @@ public:
      */
     bool loadTemplate(const std::string& template_id, const uint8_t* data, size_t length);
     
+    /**
+     * @brief Remove an enrolled template
+     * @param template_id ID of the template to remove
+     * @return true if the template existed
+     */
+    bool removeTemplate(const std::string& template_id);
+    
+    /**
+     * @brief Write every enrolled template to a checksummed snapshot file
+     * @param path Snapshot file path (written atomically)
+     * @return true if the snapshot is durable
+     */
+    bool saveSnapshot(const std::string& path) const;
+    
+    /**
+     * @brief Replace the gallery with the contents of a snapshot file
+     *
+     * Not available while a journal is attached; use openJournal() instead.
+     * @param path Snapshot file path
+     * @return true if the snapshot was valid and loaded
+     */
+    bool loadSnapshot(const std::string& path);
+    
+    /**
+     * @brief Attach a durable store: recover the gallery and journal every later change
+     *
+     * Loads <directory>/gallery.snapshot, replays <directory>/gallery.journal on top
+     * of it, then appends every enrollment, removal and clear to the journal. A
+     * background thread folds the journal into a new snapshot once it grows past
+     * options.compaction_bytes, so restart time stays bounded.
+     *
+     * The recovered gallery replaces the current one, so opening is refused while the
+     * gallery holds templates that no store records (see hasUnstoredTemplates()).
+     * @param directory Store directory (created if missing)
+     * @param options Compaction and group commit settings
+     * @return true if recovery succeeded and the journal is open
+     */
+    bool openJournal(const std::string& directory, const JournalOptions& options = JournalOptions());
+    
+    /**
+     * @brief Commit outstanding journal entries and detach the store
+     */
+    void closeJournal();
+    
+    /**
+     * @brief Block until every journaled change is on stable storage
+     * @return false if no journal is attached or a write failed
+     */
+    bool syncJournal();
+    
+    /**
+     * @brief Whether the gallery holds templates loaded while no journal was attached
+     *        (openJournal() would drop them, so it refuses until they are cleared)
+     */
+    bool hasUnstoredTemplates() const;
+    
+    /**
+     * @brief Whether the attached journal stopped recording changes after a failed write
+     *        or rotation (changes still apply in memory but are not durable)
+     */
+    bool journalFailed() const;
+    
+    /**
+     * @brief Fold the journal into a new snapshot now
+     * @return true if the new snapshot is durable
+     */
+    bool compactJournal();
+    
+    /**
+     * @brief Publish the gallery to a shared memory segment as its single writer
+     *
+     * The current templates and every later enrollment, removal and clear are
+     * written to the segment's log, which matchers in other processes replay after
+     * attachSharedGallery(). When the log fills up it is rewritten as the live
+     * gallery. Destroying the matcher leaves the segment in place so a restarted
+     * writer takes it over; detachSharedGallery() removes it.
+     * @param name "/name" for POSIX shared memory, otherwise a file path to map
+     * @param capacity Log bytes to reserve (the segment never shrinks)
+     * @return false if the segment cannot be created, already has a writer, or is too small
+     */
+    bool publishSharedGallery(const std::string& name, size_t capacity);
+    
+    /**
+     * @brief Replace the gallery with a read-only replica of a published shared gallery
+     *
+     * Enrollment changes are refused while attached; call refreshSharedGallery()
+     * to pick up what the writer published since.
+     * @return false if the segment does not exist or could not be read
+     */
+    bool attachSharedGallery(const std::string& name);
+    
+    /**
+     * @brief Whether the attached shared gallery published changes since the last refresh
+     *
+     * Lock-free; safe to call while other threads are matching.
+     */
+    bool sharedGalleryChanged() const;
+    
+    /**
+     * @brief Apply the changes published since the last refresh
+     *
+     * Must not run concurrently with matching.
+     * @return false if no shared gallery is attached or the log could not be read
+     */
+    bool refreshSharedGallery();
+    
+    /**
+     * @brief Stop publishing (removing the segment) or following a shared gallery
+     *
+     * A detached replica keeps its templates as an ordinary, writable gallery.
+     */
+    void detachSharedGallery();
+    
+    /**
+     * @brief Whether the gallery is a read-only replica of a shared gallery
+     */
+    bool isSharedGalleryReplica() const;
+    
     /**
      * @brief Perform 1:1 matching between two specific templates
      * @param probe_id ID of the probe template
@@ -76,8 +278,42 @@ public:
      */
     MatchResult match1toNFromFile(const std::string& probe_file_path);
     
+    /**
+     * @brief Perform 1:N matching with probe supplied as raw ISO data
+     * @param data Raw probe template data
+     * @param length Size of the data
+     * @return MatchResult with best match information
+     */
+    MatchResult match1toN(const uint8_t* data, size_t length);
+    
+    /**
+     * @brief 1:N matching that reports the best candidate as it improves
+     *
+     * Same scan and final result as match1toN(data, length), but every worker
+     * offers candidates that beat the best reported so far to on_progress while the
+     * scan runs (under the packed engine, during the OpenAFIS re-scoring of the
+     * shortlist). A cached result is reported once. A scan stopped by the callback
+     * sets stopped_early and is not cached.
+     * @param cancel Optional flag the caller sets to stop the scan; workers check it
+     *        before every block, so it takes effect without waiting for an improvement
+     */
+    MatchResult match1toNStream(const uint8_t* data, size_t length, const MatchProgressCallback& on_progress,
+                                const std::atomic<bool>* cancel = nullptr);
+    
+    /**
+     * @brief Perform 1:N matching of several probes in one blocked pass over the gallery
+     *
+     * Each gallery block is scored against every probe before moving on, so the
+     * candidates stay cache-resident while the whole batch is served.
+     * @param probes Raw ISO probe templates
+     * @return One MatchResult per probe, in input order (unparseable probes yield a default result)
+     */
+    std::vector<MatchResult> match1toNBatch(const std::vector<std::vector<uint8_t>>& probes);
+    
     /**
      * @brief Get number of enrolled templates
+     *
+     * Lock-free; safe to call while another thread changes or refreshes the gallery.
      * @return Number of templates currently loaded
      */
     size_t getEnrolledCount() const;
@@ -100,16 +336,109 @@ public:
     uint8_t getSimilarityThreshold() const;
     
     /**
-     * @brief Get concurrency level (number of threads used)
+     * @brief Get concurrency level (number of scan pool threads, including the caller)
      * @return Number of threads
      */
     size_t getConcurrency() const;
     
+    /**
+     * @brief Configure the probe cache used by the raw-data 1:N paths
+     *
+     * Identical probe bytes seen again within the TTL skip decoding and parsing,
+     * and reuse the previous 1:N result if the gallery has not changed since.
+     * @param capacity Maximum number of cached probes (0 disables the cache)
+     * @param ttl Lifetime of a cache entry
+     */
+    void configureProbeCache(size_t capacity, std::chrono::milliseconds ttl);
+    
+    /**
+     * @brief Get probe cache counters
+     */
+    ProbeCacheStats getProbeCacheStats() const;
+    
+    /**
+     * @brief Get the gallery version, incremented on every enrollment change
+     */
+    uint64_t getGalleryVersion() const;
+    
+    /**
+     * @brief Set which gallery finger positions probe views at a position are compared with
+     *
+     * Positions follow ISO 19794-2 (0 = unknown, 1-5 right thumb to little, 6-10 left).
+     * By default a known position searches itself plus unknown-position gallery views,
+     * and an unknown probe position searches everything. Must not run concurrently
+     * with matching; invalidates cached probe results.
+     * @param probe_position Probe view position (0-10)
+     * @param gallery_positions Gallery positions searched for it
+     * @return false if a position is out of range
+     */
+    bool setFingerCompatibility(uint8_t probe_position, const std::vector<uint8_t>& gallery_positions);
+    
+    /**
+     * @brief Restore the default finger compatibility map
+     */
+    void resetFingerCompatibility();
+    
+    /**
+     * @brief Gallery positions searched for probe views at a position
+     */
+    std::vector<uint8_t> getFingerCompatibility(uint8_t probe_position) const;
+    
+    /**
+     * @brief Number of templates in each finger position partition (index = position)
+     *
+     * Templates with views at several positions count once per position.
+     */
+    std::vector<size_t> getFingerPartitionSizes() const;
+    
+    /**
+     * @brief Select the 1:N scan engine
+     *
+     * The packed engine keeps a 2048-bit minutiae neighbourhood descriptor of every
+     * template in interleaved 16-candidate blocks and scores a probe against whole blocks with
+     * the widest SIMD kernel the CPU supports (see packedKernelName()). Only the
+     * options.shortlist best candidates are then scored by OpenAFIS, so reported
+     * scores are always OpenAFIS scores; a genuine mate outside the shortlist is
+     * missed, which verifyScanEngine() measures. The descriptors are built when the
+     * packed engine is selected and released when it is deselected; prepareScanEngine()
+     * builds them ahead so this call only swaps them in. Must not run concurrently with
+     * matching; invalidates cached probe results.
+     * @param prepared_only Leave the engine unchanged instead of building the descriptors here
+     *        when the prepared ones are missing or the gallery changed after they were built
+     * @return false if prepared_only stopped the switch
+     */
+    bool configureScanEngine(const ScanEngineOptions& options, bool prepared_only = false);
+    
+    /**
+     * @brief Build the descriptors configureScanEngine(options) needs without changing the gallery
+     *
+     * Only reads the gallery, so it may run beside scans (but not beside enrollment changes).
+     */
+    void prepareScanEngine(const ScanEngineOptions& options);
+    
+    ScanEngineOptions getScanEngineOptions() const;
+    
+    /**
+     * @brief Scan probes with both engines and report how often the packed engine agrees
+     * @param probes Raw ISO probe templates (unparseable ones are skipped)
+     * @return Empty accuracy unless the packed engine is selected
+     */
+    ScanEngineAccuracy verifyScanEngine(const std::vector<std::vector<uint8_t>>& probes);
+    
     /**
      * @brief Get memory usage statistics
      * @return Memory usage in bytes
      */
     size_t getMemoryUsage() const;
+    
+    /**
+     * @brief Get the memory held for this gallery, for quotas and budgets
+     *
+     * Adds to getMemoryUsage() what is kept beside the parsed templates (raw records,
+     * IDs, finger positions, pre-filter descriptors) and the probe cache.
+     * @return Approximate footprint in bytes
+     */
+    size_t getFootprint() const;
 
 private:
     // Forward declarations for PIMPL pattern
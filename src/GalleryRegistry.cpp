@@ -0,0 +1,404 @@
+#include "GalleryRegistry.h"
+
+#include <filesystem>
+#include <iostream>
+
+namespace openafis {
+
+namespace {
+
+constexpr size_t kMaxGalleryNameLength = 128;
+
+// Names double as snapshot file names, so keep them to a portable character set
+bool validGalleryName(const std::string& name) {
+    if (name.empty() || name.size() > kMaxGalleryNameLength || name[0] == '.') {
+        return false;
+    }
+    for (char c : name) {
+        const bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                        c == '.' || c == '_' || c == '-';
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+const char* galleryStatusMessage(GalleryStatus status) {
+    switch (status) {
+        case GalleryStatus::Ok: return "ok";
+        case GalleryStatus::NotFound: return "Gallery or template not found";
+        case GalleryStatus::Exists: return "A gallery with this name already exists";
+        case GalleryStatus::InvalidName: return "Gallery names must be 1-128 characters of [A-Za-z0-9._-] not starting with '.'";
+        case GalleryStatus::QuotaExceeded: return "Gallery memory quota exceeded";
+        case GalleryStatus::Rejected: return "Template could not be loaded (duplicate ID or invalid data)";
+        case GalleryStatus::Unavailable: return "Gallery snapshot could not be written or read (see stderr for details)";
+    }
+    return "Unknown error";
+}
+
+GalleryRegistry::GalleryRegistry(const std::string& spill_directory, size_t memory_budget)
+    : spill_directory_(spill_directory), memory_budget_(memory_budget), resident_bytes_(0),
+      evictions_(0), reloads_(0), probe_cache_enabled_(false), next_serial_(1), probe_cache_capacity_(0),
+      probe_cache_ttl_(0) {
+    std::error_code ec;
+    std::filesystem::create_directories(spill_directory_, ec);
+    if (ec) {
+        std::cerr << "Failed to create gallery spill directory " << spill_directory_ << ": " << ec.message() << std::endl;
+    }
+}
+
+GalleryRegistry::~GalleryRegistry() {
+    // Snapshots only back evicted galleries of this registry; they are not a durable store
+    std::error_code ec;
+    for (const auto& gallery : galleries_) {
+        if (gallery.second->has_snapshot) {
+            std::filesystem::remove(snapshotPath(*gallery.second), ec);
+        }
+    }
+}
+
+void GalleryRegistry::setMemoryBudget(size_t memory_budget) {
+    memory_budget_ = memory_budget;
+    enforceBudget(nullptr);
+}
+
+void GalleryRegistry::configureProbeCache(size_t capacity, std::chrono::milliseconds ttl) {
+    std::vector<EntryPtr> entries;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        probe_cache_capacity_ = capacity;
+        probe_cache_ttl_ = ttl;
+        probe_cache_enabled_ = capacity > 0;
+        entries.assign(lru_.begin(), lru_.end());
+    }
+
+    for (const EntryPtr& entry : entries) {
+        std::unique_lock<std::shared_mutex> lock(entry->mutex);
+        if (entry->matcher) {
+            entry->matcher->configureProbeCache(capacity, ttl);
+            account(*entry);
+        }
+    }
+    enforceBudget(nullptr);
+}
+
+GalleryStatus GalleryRegistry::createGallery(const std::string& name, const GalleryOptions& options) {
+    if (!validGalleryName(name)) {
+        return GalleryStatus::InvalidName;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (galleries_.count(name) != 0) {
+        return GalleryStatus::Exists;
+    }
+
+    auto entry = std::make_shared<Entry>();
+    entry->name = name;
+    entry->serial = next_serial_++;
+    entry->options = options;
+    entry->matcher = std::make_unique<FingerprintMatcher>(options.threshold);
+    entry->matcher->configureProbeCache(probe_cache_capacity_, probe_cache_ttl_);
+    entry->saved_version = entry->matcher->getGalleryVersion();
+    entry->resident = true;
+
+    lru_.push_front(entry);
+    entry->lru = lru_.begin();
+    galleries_.emplace(name, std::move(entry));
+    return GalleryStatus::Ok;
+}
+
+GalleryStatus GalleryRegistry::dropGallery(const std::string& name) {
+    EntryPtr entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = galleries_.find(name);
+        if (it == galleries_.end()) {
+            return GalleryStatus::NotFound;
+        }
+        entry = it->second;
+        lru_.erase(entry->lru);
+        galleries_.erase(it);
+    }
+
+    // Waits for in-flight scans of this gallery to finish
+    std::unique_lock<std::shared_mutex> lock(entry->mutex);
+    entry->dropped = true;
+    if (entry->matcher) {
+        resident_bytes_ -= entry->memory_bytes;
+        entry->matcher.reset();
+        entry->resident = false;
+    }
+    if (entry->has_snapshot) {
+        // The file is this entry's alone, so a gallery re-created under the name meanwhile keeps its own
+        std::error_code ec;
+        std::filesystem::remove(snapshotPath(*entry), ec);
+    }
+    return GalleryStatus::Ok;
+}
+
+GalleryStatus GalleryRegistry::enroll(const std::string& name, const std::string& template_id,
+                                      const uint8_t* data, size_t length) {
+    EntryPtr entry = touch(name);
+    if (!entry) {
+        return GalleryStatus::NotFound;
+    }
+
+    GalleryStatus status = GalleryStatus::Ok;
+    {
+        std::unique_lock<std::shared_mutex> lock(entry->mutex);
+        if (entry->dropped) {
+            return GalleryStatus::NotFound;
+        }
+        if (!entry->matcher && !reload(*entry)) {
+            return GalleryStatus::Unavailable;
+        }
+
+        if (!entry->matcher->loadTemplate(template_id, data, length)) {
+            status = GalleryStatus::Rejected;
+        } else if (entry->options.quota_bytes != 0 && entry->matcher->getFootprint() > entry->options.quota_bytes) {
+            // Template sizes are only known once parsed, so roll the enrollment back
+            entry->matcher->removeTemplate(template_id);
+            status = GalleryStatus::QuotaExceeded;
+        }
+        account(*entry);
+    }
+
+    enforceBudget(entry.get());
+    return status;
+}
+
+GalleryStatus GalleryRegistry::remove(const std::string& name, const std::string& template_id) {
+    EntryPtr entry = touch(name);
+    if (!entry) {
+        return GalleryStatus::NotFound;
+    }
+
+    {
+        std::unique_lock<std::shared_mutex> lock(entry->mutex);
+        if (entry->dropped) {
+            return GalleryStatus::NotFound;
+        }
+        if (!entry->matcher && !reload(*entry)) {
+            return GalleryStatus::Unavailable;
+        }
+        if (!entry->matcher->removeTemplate(template_id)) {
+            return GalleryStatus::NotFound;
+        }
+        account(*entry);
+    }
+
+    enforceBudget(entry.get());
+    return GalleryStatus::Ok;
+}
+
+GalleryStatus GalleryRegistry::match(const std::string& name, const uint8_t* data, size_t length,
+                                     MatchResult& result) {
+    EntryPtr entry = touch(name);
+    if (!entry) {
+        return GalleryStatus::NotFound;
+    }
+
+    for (;;) {
+        bool scanned = false;
+        {
+            std::shared_lock<std::shared_mutex> lock(entry->mutex);
+            if (entry->dropped) {
+                return GalleryStatus::NotFound;
+            }
+            if (entry->matcher) {
+                result = entry->matcher->match1toN(data, length);
+                scanned = true;
+                if (probe_cache_enabled_) {
+                    refreshFootprint(*entry); // The probe cache grows with matches
+                }
+            }
+        }
+        if (scanned) {
+            if (probe_cache_enabled_) {
+                enforceBudget(entry.get());
+            }
+            return GalleryStatus::Ok;
+        }
+
+        {
+            std::unique_lock<std::shared_mutex> lock(entry->mutex);
+            if (entry->dropped) {
+                return GalleryStatus::NotFound;
+            }
+            if (!entry->matcher && !reload(*entry)) {
+                return GalleryStatus::Unavailable;
+            }
+        }
+
+        // Make room for the reloaded gallery; it is most recently used, so it stays
+        enforceBudget(entry.get());
+    }
+}
+
+GalleryStatus GalleryRegistry::describe(const std::string& name, GalleryInfo& info) const {
+    EntryPtr entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = galleries_.find(name);
+        if (it == galleries_.end()) {
+            return GalleryStatus::NotFound;
+        }
+        entry = it->second;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(entry->mutex);
+    info.name = entry->name;
+    info.resident = entry->matcher != nullptr;
+    info.templates = entry->templates;
+    info.memory_bytes = entry->memory_bytes;
+    info.quota_bytes = entry->options.quota_bytes;
+    info.evictions = entry->evictions;
+    info.reloads = entry->reloads;
+    return GalleryStatus::Ok;
+}
+
+std::vector<GalleryInfo> GalleryRegistry::list() const {
+    std::vector<std::string> names;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const EntryPtr& entry : lru_) {
+            names.push_back(entry->name);
+        }
+    }
+
+    std::vector<GalleryInfo> galleries;
+    for (const std::string& name : names) {
+        GalleryInfo info;
+        if (describe(name, info) == GalleryStatus::Ok) {
+            galleries.push_back(std::move(info));
+        }
+    }
+    return galleries;
+}
+
+RegistryStats GalleryRegistry::stats() const {
+    RegistryStats stats;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats.galleries = galleries_.size();
+        stats.resident_galleries = 0;
+        for (const EntryPtr& entry : lru_) {
+            if (entry->resident) {
+                stats.resident_galleries++;
+            }
+        }
+    }
+    stats.resident_bytes = resident_bytes_;
+    stats.memory_budget = memory_budget_;
+    stats.evictions = evictions_;
+    stats.reloads = reloads_;
+    return stats;
+}
+
+GalleryRegistry::EntryPtr GalleryRegistry::touch(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = galleries_.find(name);
+    if (it == galleries_.end()) {
+        return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second->lru);
+    return it->second;
+}
+
+bool GalleryRegistry::reload(Entry& entry) {
+    std::unique_ptr<FingerprintMatcher> matcher = newMatcher(entry.options);
+    if (entry.has_snapshot && !matcher->loadSnapshot(snapshotPath(entry))) {
+        std::cerr << "Failed to reload gallery '" << entry.name << "' from its snapshot" << std::endl;
+        return false;
+    }
+
+    entry.matcher = std::move(matcher);
+    entry.saved_version = entry.matcher->getGalleryVersion();
+    entry.memory_bytes = 0;
+    entry.resident = true;
+    account(entry);
+
+    entry.reloads++;
+    reloads_++;
+    return true;
+}
+
+bool GalleryRegistry::evict(Entry& entry) {
+    if (!entry.matcher) {
+        return true;
+    }
+
+    // A gallery unchanged since it was last spilled or reloaded already matches its snapshot
+    if (!entry.has_snapshot || entry.matcher->getGalleryVersion() != entry.saved_version) {
+        if (!entry.matcher->saveSnapshot(snapshotPath(entry))) {
+            std::cerr << "Failed to spill gallery '" << entry.name << "'; keeping it resident" << std::endl;
+            return false;
+        }
+        entry.has_snapshot = true;
+    }
+
+    resident_bytes_ -= entry.memory_bytes;
+    entry.matcher.reset();
+    entry.resident = false;
+
+    entry.evictions++;
+    evictions_++;
+    return true;
+}
+
+void GalleryRegistry::account(Entry& entry) {
+    entry.templates = entry.matcher->getEnrolledCount();
+    refreshFootprint(entry);
+}
+
+void GalleryRegistry::refreshFootprint(Entry& entry) {
+    const size_t bytes = entry.matcher->getFootprint();
+    const size_t previous = entry.memory_bytes.exchange(bytes);
+    resident_bytes_ += bytes;
+    resident_bytes_ -= previous;
+}
+
+void GalleryRegistry::enforceBudget(const Entry* keep) {
+    for (;;) {
+        const size_t budget = memory_budget_;
+        if (budget == 0 || resident_bytes_ <= budget) {
+            return;
+        }
+
+        EntryPtr victim;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto it = lru_.rbegin(); it != lru_.rend(); ++it) {
+                if (it->get() != keep && (*it)->resident && (*it)->memory_bytes > 0) {
+                    victim = *it;
+                    break;
+                }
+            }
+        }
+        if (!victim) {
+            return; // Only the gallery in use is left; it may exceed the budget on its own
+        }
+
+        std::unique_lock<std::shared_mutex> lock(victim->mutex);
+        if (!victim->dropped && !evict(*victim)) {
+            return;
+        }
+    }
+}
+
+std::unique_ptr<FingerprintMatcher> GalleryRegistry::newMatcher(const GalleryOptions& options) const {
+    auto matcher = std::make_unique<FingerprintMatcher>(options.threshold);
+    std::lock_guard<std::mutex> lock(mutex_);
+    matcher->configureProbeCache(probe_cache_capacity_, probe_cache_ttl_);
+    return matcher;
+}
+
+std::string GalleryRegistry::snapshotPath(const Entry& entry) const {
+    return (std::filesystem::path(spill_directory_) /
+            (entry.name + "." + std::to_string(entry.serial) + ".snapshot")).string();
+}
+
+} // namespace openafis
@@ -0,0 +1,212 @@
+#ifndef GALLERY_REGISTRY_H
+#define GALLERY_REGISTRY_H
+
+#include "FingerprintMatcher.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace openafis {
+
+/**
+ * @brief Outcome of a registry operation on a named gallery
+ */
+enum class GalleryStatus {
+    Ok,
+    NotFound,        // No gallery (or template, for removals) with that name
+    Exists,          // createGallery: the name is already taken
+    InvalidName,     // Names must be 1-128 characters of [A-Za-z0-9._-] and not start with '.'
+    QuotaExceeded,   // Enrollment would push the gallery past its memory quota
+    Rejected,        // Template could not be loaded (duplicate ID or invalid data)
+    Unavailable      // Spilled snapshot could not be written or read back
+};
+
+/**
+ * @brief Short description of a status for error messages
+ */
+const char* galleryStatusMessage(GalleryStatus status);
+
+/**
+ * @brief Per-gallery settings
+ */
+struct GalleryOptions {
+    size_t quota_bytes;      // Maximum footprint of the gallery (0 = unlimited), see FingerprintMatcher::getFootprint
+    uint8_t threshold;       // Similarity threshold of its matches
+
+    GalleryOptions() : quota_bytes(0), threshold(40) {}
+};
+
+/**
+ * @brief Snapshot of one gallery's state
+ */
+struct GalleryInfo {
+    std::string name;
+    bool resident;           // Loaded in memory (false once spilled to its snapshot)
+    size_t templates;
+    size_t memory_bytes;     // Footprint while resident, as of eviction otherwise
+    size_t quota_bytes;
+    uint64_t evictions;
+    uint64_t reloads;
+};
+
+/**
+ * @brief Registry-wide counters
+ */
+struct RegistryStats {
+    size_t galleries;
+    size_t resident_galleries;
+    size_t resident_bytes;
+    size_t memory_budget;
+    uint64_t evictions;
+    uint64_t reloads;
+};
+
+/**
+ * @brief Process-wide set of named galleries sharing one memory budget
+ *
+ * Every gallery is its own FingerprintMatcher behind its own reader/writer lock,
+ * and concurrent scans share the ScanPool threads instead of queueing for them,
+ * so tenants never block each other's scans. When the footprint of the resident
+ * galleries (templates, raw records, descriptors and probe caches) exceeds the
+ * budget, the least recently used galleries are written to
+ * <spill_directory>/<name>.<serial>.snapshot and released; the next call that
+ * touches a spilled gallery reloads it transparently. Unchanged galleries are
+ * not rewritten on eviction.
+ */
+class GalleryRegistry {
+public:
+    /**
+     * @param spill_directory Where evicted galleries are snapshotted (created if missing)
+     * @param memory_budget Resident footprint across all galleries (0 = unlimited)
+     */
+    GalleryRegistry(const std::string& spill_directory, size_t memory_budget);
+
+    /**
+     * @brief Remove the snapshots of every gallery still registered
+     */
+    ~GalleryRegistry();
+
+    GalleryRegistry(const GalleryRegistry&) = delete;
+    GalleryRegistry& operator=(const GalleryRegistry&) = delete;
+
+    /**
+     * @brief Change the memory budget, evicting immediately if needed
+     */
+    void setMemoryBudget(size_t memory_budget);
+
+    /**
+     * @brief Set the probe cache of every gallery (applied as galleries are created or reloaded)
+     *
+     * Galleries have no probe cache until this is called. Cached probes count towards
+     * each gallery's quota and the budget.
+     */
+    void configureProbeCache(size_t capacity, std::chrono::milliseconds ttl);
+
+    GalleryStatus createGallery(const std::string& name, const GalleryOptions& options);
+
+    /**
+     * @brief Forget a gallery and delete its snapshot
+     */
+    GalleryStatus dropGallery(const std::string& name);
+
+    /**
+     * @brief Enroll one template, rejecting it if the gallery would exceed its quota
+     */
+    GalleryStatus enroll(const std::string& name, const std::string& template_id, const uint8_t* data, size_t length);
+
+    GalleryStatus remove(const std::string& name, const std::string& template_id);
+
+    /**
+     * @brief 1:N match against one gallery, reloading it first if it was spilled
+     */
+    GalleryStatus match(const std::string& name, const uint8_t* data, size_t length, MatchResult& result);
+
+    /**
+     * @brief Describe one gallery
+     */
+    GalleryStatus describe(const std::string& name, GalleryInfo& info) const;
+
+    /**
+     * @brief Describe every gallery, most recently used first
+     */
+    std::vector<GalleryInfo> list() const;
+
+    RegistryStats stats() const;
+
+private:
+    struct Entry {
+        std::string name;
+        uint64_t serial = 0;                           // Distinguishes galleries created under a reused name
+        GalleryOptions options;
+        std::shared_mutex mutex;                       // Shared for scans, exclusive for changes, reload and eviction
+        std::unique_ptr<FingerprintMatcher> matcher;   // Null while spilled
+        uint64_t saved_version = 0;                    // Gallery version the snapshot on disk reflects
+        bool has_snapshot = false;
+        bool dropped = false;
+        size_t templates = 0;
+        std::atomic<bool> resident{false};             // Mirrors matcher != null for lock-free victim selection
+        std::atomic<size_t> memory_bytes{0};
+        std::atomic<uint64_t> evictions{0};
+        std::atomic<uint64_t> reloads{0};
+        std::list<std::shared_ptr<Entry>>::iterator lru;
+    };
+    using EntryPtr = std::shared_ptr<Entry>;
+
+    /**
+     * @brief Look up a gallery and mark it most recently used
+     */
+    EntryPtr touch(const std::string& name);
+
+    /**
+     * @brief Make a gallery resident (caller holds its exclusive lock)
+     */
+    bool reload(Entry& entry);
+
+    /**
+     * @brief Spill a resident gallery to its snapshot (caller holds its exclusive lock)
+     */
+    bool evict(Entry& entry);
+
+    /**
+     * @brief Refresh a resident gallery's template count and footprint (caller holds its exclusive lock)
+     */
+    void account(Entry& entry);
+
+    /**
+     * @brief Refresh a resident gallery's accounted footprint (caller holds its lock, shared or exclusive)
+     */
+    void refreshFootprint(Entry& entry);
+
+    /**
+     * @brief Evict least recently used galleries other than keep until within budget
+     */
+    void enforceBudget(const Entry* keep);
+
+    std::unique_ptr<FingerprintMatcher> newMatcher(const GalleryOptions& options) const;
+    std::string snapshotPath(const Entry& entry) const;
+
+    const std::string spill_directory_;
+    std::atomic<size_t> memory_budget_;
+    std::atomic<size_t> resident_bytes_;
+    std::atomic<uint64_t> evictions_;
+    std::atomic<uint64_t> reloads_;
+    std::atomic<bool> probe_cache_enabled_;
+
+    mutable std::mutex mutex_;                         // Guards galleries_, lru_, next_serial_ and the probe cache settings
+    std::unordered_map<std::string, EntryPtr> galleries_;
+    std::list<EntryPtr> lru_;                          // Front is most recently used
+    uint64_t next_serial_;
+    size_t probe_cache_capacity_;
+    std::chrono::milliseconds probe_cache_ttl_;
+};
+
+} // namespace openafis
+
+#endif // GALLERY_REGISTRY_H
@@ -0,0 +1,142 @@
+#include "GallerySnapshot.h"
+#include "Crc32.h"
+#include "StorageUtil.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+namespace openafis {
+
+namespace {
+
+const char kSnapshotMagic[8] = {'O', 'A', 'F', 'S', 'N', 'A', 'P', '1'};
+
+using FilePtr = std::unique_ptr<FILE, int (*)(FILE*)>;
+
+/**
+ * @brief Write bytes and fold them into the running checksum
+ */
+bool writeChecked(FILE* file, const void* data, size_t length, uint32_t& crc) {
+    crc = crc32(data, length, crc);
+    return length == 0 || std::fwrite(data, 1, length, file) == length;
+}
+
+bool readChecked(FILE* file, void* data, size_t length, uint32_t& crc) {
+    if (length != 0 && std::fread(data, 1, length, file) != length) {
+        return false;
+    }
+    crc = crc32(data, length, crc);
+    return true;
+}
+
+} // namespace
+
+bool writeGallerySnapshot(const std::string& path, uint64_t sequence, const std::vector<GalleryRecord>& records) {
+    const std::string temp_path = path + ".tmp";
+    
+    {
+        FilePtr file(std::fopen(temp_path.c_str(), "wb"), &std::fclose);
+        if (!file) {
+            std::cerr << "Failed to create snapshot file: " << temp_path << std::endl;
+            return false;
+        }
+        
+        uint32_t crc = 0;
+        std::vector<uint8_t> header(kSnapshotMagic, kSnapshotMagic + sizeof(kSnapshotMagic));
+        appendU64(header, sequence);
+        appendU32(header, static_cast<uint32_t>(records.size()));
+        bool ok = writeChecked(file.get(), header.data(), header.size(), crc);
+        
+        std::vector<uint8_t> lengths;
+        for (const auto& record : records) {
+            if (!ok) {
+                break;
+            }
+            lengths.clear();
+            appendU32(lengths, static_cast<uint32_t>(record.id.size()));
+            ok = writeChecked(file.get(), lengths.data(), lengths.size(), crc) &&
+                 writeChecked(file.get(), record.id.data(), record.id.size(), crc);
+            lengths.clear();
+            appendU32(lengths, static_cast<uint32_t>(record.data.size()));
+            ok = ok && writeChecked(file.get(), lengths.data(), lengths.size(), crc) &&
+                 writeChecked(file.get(), record.data.data(), record.data.size(), crc);
+        }
+        
+        std::vector<uint8_t> trailer;
+        appendU32(trailer, crc);
+        ok = ok && std::fwrite(trailer.data(), 1, trailer.size(), file.get()) == trailer.size();
+        
+        if (!ok || !syncFile(file.get())) {
+            std::cerr << "Failed to write snapshot file: " << temp_path << std::endl;
+            file.reset();
+            std::remove(temp_path.c_str());
+            return false;
+        }
+    }
+    
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to move snapshot into place: " << path << std::endl;
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    
+    return syncDirectory(parentDirectory(path));
+}
+
+bool readGallerySnapshot(const std::string& path, uint64_t& sequence, std::vector<GalleryRecord>& records) {
+    FilePtr file(std::fopen(path.c_str(), "rb"), &std::fclose);
+    if (!file) {
+        return false;
+    }
+    
+    uint32_t crc = 0;
+    uint8_t header[sizeof(kSnapshotMagic) + 12];
+    if (!readChecked(file.get(), header, sizeof(header), crc) ||
+        std::memcmp(header, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0) {
+        std::cerr << "Not a gallery snapshot: " << path << std::endl;
+        return false;
+    }
+    
+    const uint64_t stored_sequence = readU64(header + 8);
+    const uint32_t count = readU32(header + 16);
+    
+    std::vector<GalleryRecord> loaded;
+    loaded.reserve(count);
+    uint8_t length_bytes[4];
+    for (uint32_t i = 0; i < count; i++) {
+        GalleryRecord record;
+        if (!readChecked(file.get(), length_bytes, 4, crc)) {
+            break;
+        }
+        if (readU32(length_bytes) > kMaxRecordIdBytes) {
+            break;
+        }
+        record.id.resize(readU32(length_bytes));
+        if (!readChecked(file.get(), &record.id[0], record.id.size(), crc) ||
+            !readChecked(file.get(), length_bytes, 4, crc)) {
+            break;
+        }
+        if (readU32(length_bytes) > kMaxRecordDataBytes) {
+            break;
+        }
+        record.data.resize(readU32(length_bytes));
+        if (!readChecked(file.get(), record.data.data(), record.data.size(), crc)) {
+            break;
+        }
+        loaded.push_back(std::move(record));
+    }
+    
+    uint8_t trailer[4];
+    if (loaded.size() != count || std::fread(trailer, 1, 4, file.get()) != 4 || readU32(trailer) != crc) {
+        std::cerr << "Gallery snapshot is truncated or corrupt: " << path << std::endl;
+        return false;
+    }
+    
+    sequence = stored_sequence;
+    records = std::move(loaded);
+    return true;
+}
+
+} // namespace openafis
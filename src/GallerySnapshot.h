@@ -0,0 +1,46 @@
+#ifndef GALLERY_SNAPSHOT_H
+#define GALLERY_SNAPSHOT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace openafis {
+
+// Upper bounds used to reject corrupt length fields before allocating
+constexpr uint32_t kMaxRecordIdBytes = 64 * 1024;
+constexpr uint32_t kMaxRecordDataBytes = 16 * 1024 * 1024;
+
+/**
+ * @brief Raw enrollment record: template ID and its ISO 19794-2 bytes
+ */
+struct GalleryRecord {
+    std::string id;
+    std::vector<uint8_t> data;
+};
+
+/**
+ * @brief Atomically write a full gallery snapshot
+ *
+ * Layout: "OAFSNAP1", u64 journal sequence, u32 record count, then per record
+ * u32 id length, id, u32 data length, data; a trailing CRC-32 covers everything
+ * before it. The file is written beside the target and renamed into place.
+ * @param path Snapshot file path
+ * @param sequence Last journal sequence number folded into this snapshot
+ * @param records Gallery contents
+ * @return true if the snapshot is durable
+ */
+bool writeGallerySnapshot(const std::string& path, uint64_t sequence, const std::vector<GalleryRecord>& records);
+
+/**
+ * @brief Read and verify a gallery snapshot
+ * @param path Snapshot file path
+ * @param sequence Receives the journal sequence stored in the snapshot
+ * @param records Receives the gallery contents
+ * @return true if the file exists and its checksum is valid
+ */
+bool readGallerySnapshot(const std::string& path, uint64_t& sequence, std::vector<GalleryRecord>& records);
+
+} // namespace openafis
+
+#endif // GALLERY_SNAPSHOT_H
@@ -0,0 +1,140 @@
+#include "MatchTrace.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <process.h>
+#define OPENAFIS_GETPID _getpid
+#else
+#include <unistd.h>
+#define OPENAFIS_GETPID getpid
+#endif
+
+namespace openafis {
+
+namespace {
+
+std::atomic<uint64_t> g_next_match_id(1);
+std::atomic<uint32_t> g_next_thread_index(1);
+thread_local uint64_t t_current_match_id = 0;
+
+double microsecondsBetween(TraceRecorder::Clock::time_point from, TraceRecorder::Clock::time_point to) {
+    return std::chrono::duration<double, std::micro>(to - from).count();
+}
+
+} // namespace
+
+TraceRecorder::TraceRecorder() : active_(false), users_(0), capacity_(0), dropped_(0), epoch_(Clock::now()) {}
+
+TraceRecorder& TraceRecorder::instance() {
+    static TraceRecorder recorder;
+    return recorder;
+}
+
+void TraceRecorder::acquire(size_t capacity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (users_++ > 0) {
+        // Keep the spans the other users are recording
+        capacity_ = std::max(capacity_, capacity);
+        return;
+    }
+    spans_.clear();
+    spans_.reserve(capacity);
+    capacity_ = capacity;
+    dropped_ = 0;
+    epoch_ = Clock::now();
+    active_.store(true, std::memory_order_relaxed);
+}
+
+void TraceRecorder::release() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (users_ > 0 && --users_ == 0) {
+        active_.store(false, std::memory_order_relaxed);
+    }
+}
+
+void TraceRecorder::record(const char* name, Clock::time_point begin, Clock::time_point end,
+                           uint64_t match_id, int32_t worker) {
+    if (!active()) {
+        return;
+    }
+    const uint32_t thread = threadIndex();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (spans_.size() >= capacity_) {
+        dropped_++;
+        return;
+    }
+    spans_.push_back({name, thread, worker, match_id, begin, end});
+}
+
+std::string TraceRecorder::exportChromeTrace(bool clear) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const int pid = static_cast<int>(OPENAFIS_GETPID());
+
+    std::string json;
+    json.reserve(128 + spans_.size() * 160);
+    char buffer[256];
+
+    std::snprintf(buffer, sizeof(buffer),
+                  "{\"traceEvents\":[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,"
+                  "\"args\":{\"name\":\"openafis\"}}", pid);
+    json += buffer;
+
+    for (const Span& span : spans_) {
+        std::snprintf(buffer, sizeof(buffer),
+                      ",{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,"
+                      "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"match\":%llu",
+                      span.name, span.worker >= 0 ? "scan-worker" : "match", pid, span.thread,
+                      microsecondsBetween(epoch_, span.begin), microsecondsBetween(span.begin, span.end),
+                      static_cast<unsigned long long>(span.match_id));
+        json += buffer;
+        if (span.worker >= 0) {
+            std::snprintf(buffer, sizeof(buffer), ",\"worker\":%d", span.worker);
+            json += buffer;
+        }
+        json += "}}";
+    }
+
+    std::snprintf(buffer, sizeof(buffer),
+                  "],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedSpans\":%llu}}",
+                  static_cast<unsigned long long>(dropped_));
+    json += buffer;
+
+    if (clear) {
+        spans_.clear();
+        dropped_ = 0;
+    }
+    return json;
+}
+
+size_t TraceRecorder::spanCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return spans_.size();
+}
+
+uint64_t TraceRecorder::droppedCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dropped_;
+}
+
+uint64_t TraceRecorder::nextMatchId() {
+    return g_next_match_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t TraceRecorder::currentMatchId() {
+    return t_current_match_id;
+}
+
+void TraceRecorder::setCurrentMatchId(uint64_t match_id) {
+    t_current_match_id = match_id;
+}
+
+uint32_t TraceRecorder::threadIndex() {
+    // Small stable IDs read better in trace viewers than hashed std::thread::ids
+    thread_local const uint32_t index = g_next_thread_index.fetch_add(1, std::memory_order_relaxed);
+    return index;
+}
+
+} // namespace openafis
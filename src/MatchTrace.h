@@ -0,0 +1,112 @@
+#ifndef MATCH_TRACE_H
+#define MATCH_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace openafis {
+
+/**
+ * @brief Per-phase timing breakdown of one match call
+ *
+ * The matcher fills parse, scan and threads_used; the addon adds decode,
+ * enroll (per-call database enrollment) and marshal.
+ */
+struct MatchPhases {
+    std::chrono::microseconds decode;   // Base64 decoding of the probe
+    std::chrono::microseconds parse;    // Probe cache lookup and ISO parsing
+    std::chrono::microseconds enroll;   // Enrolling a per-call database (matchFingerprint(probe, users))
+    std::chrono::microseconds scan;     // 1:N gallery scan
+    std::chrono::microseconds marshal;  // Building the JS result
+    uint32_t threads_used;              // Threads that scored part of the gallery
+
+    MatchPhases() : decode(0), parse(0), enroll(0), scan(0), marshal(0), threads_used(0) {}
+};
+
+/**
+ * @brief Process-wide recorder of trace spans, exported as Chrome trace-event JSON
+ *
+ * Recording is off by default and then costs one relaxed atomic load per span.
+ * While active, spans are appended to a bounded buffer (spans past the capacity
+ * are counted and dropped). Open the export in chrome://tracing or Perfetto.
+ *
+ * Several users (one per Node.js environment) can record at once: the buffer is
+ * shared, it is started fresh by the first user and recording stops with the last.
+ */
+class TraceRecorder {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static TraceRecorder& instance();
+
+    /**
+     * @brief Add a user; the first one starts recording into a fresh buffer
+     * @param capacity Maximum number of spans kept (a later user can only raise it)
+     */
+    void acquire(size_t capacity);
+
+    /**
+     * @brief Remove a user; recording stops with the last one (buffered spans are kept for export)
+     */
+    void release();
+
+    bool active() const { return active_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Record a complete span on the calling thread
+     * @param name Span name (string literal)
+     * @param match_id Match the span belongs to (0 if none)
+     * @param worker Scan worker index, or -1 for non-worker spans
+     */
+    void record(const char* name, Clock::time_point begin, Clock::time_point end,
+                uint64_t match_id, int32_t worker = -1);
+
+    /**
+     * @brief Serialize buffered spans as {"traceEvents": [...]} and optionally clear them
+     */
+    std::string exportChromeTrace(bool clear);
+
+    size_t spanCount() const;
+    uint64_t droppedCount() const;
+
+    /**
+     * @brief Allocate an ID correlating the spans of one match
+     */
+    static uint64_t nextMatchId();
+
+    /**
+     * @brief Match ID spans recorded by the calling thread are attributed to (0 if none)
+     */
+    static uint64_t currentMatchId();
+    static void setCurrentMatchId(uint64_t match_id);
+
+private:
+    struct Span {
+        const char* name;
+        uint32_t thread;
+        int32_t worker;
+        uint64_t match_id;
+        Clock::time_point begin;
+        Clock::time_point end;
+    };
+
+    TraceRecorder();
+    static uint32_t threadIndex();
+
+    std::atomic<bool> active_;
+    mutable std::mutex mutex_;
+    std::vector<Span> spans_;
+    size_t users_;
+    size_t capacity_;
+    uint64_t dropped_;
+    Clock::time_point epoch_;
+};
+
+} // namespace openafis
+
+#endif // MATCH_TRACE_H
@@ -0,0 +1,332 @@
+#include "PackedMinutiae.h"
+#include "CpuDispatch.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if OPENAFIS_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace openafis {
+
+namespace {
+
+// ISO 19794-2:2005 layout (see FingerPosition.cpp); each minutia is type + x (14 bits),
+// reserved + y (14 bits), direction in 256ths of a turn and quality
+constexpr size_t kRecordHeaderBytes = 24;
+constexpr size_t kViewHeaderBytes = 4;
+constexpr size_t kMinutiaBytes = 6;
+constexpr size_t kExtendedLengthBytes = 2;
+
+// Each minutia is paired with this many nearest neighbours closer than kMaxPairDistance pixels
+constexpr size_t kNeighbours = 4;
+constexpr double kMaxPairDistance = 160.0;
+
+// Cells per feature: distance, direction difference, line direction
+constexpr int kDistanceCells = 16;
+constexpr int kAngleCells = 16;
+
+// A probe feature this close to a cell edge (fraction of a cell) also sets the neighbouring cell
+constexpr double kEdgeMargin = 0.25;
+
+constexpr size_t kDescriptorBits = kDescriptorBytes * 8;
+constexpr size_t kBlockBytes = kDescriptorBytes * kPackedLanes;
+constexpr double kPi = 3.14159265358979323846;
+
+static_assert((kDescriptorBits & (kDescriptorBits - 1)) == 0, "descriptor bits are indexed by a hash mask");
+
+struct Minutia {
+    int x;
+    int y;
+    uint8_t direction;
+};
+
+using ScoreKernel = void (*)(const uint8_t* blocks, const uint8_t* wide, size_t block_count, uint16_t* scores);
+
+void scoreScalar(const uint8_t* blocks, const uint8_t* wide, size_t block_count, uint16_t* scores) {
+    for (size_t block = 0; block < block_count; block++) {
+        const uint8_t* rows = blocks + block * kBlockBytes;
+        uint16_t* out = scores + block * kPackedLanes;
+        std::fill(out, out + kPackedLanes, 0);
+        for (size_t row = 0; row < kDescriptorBytes; row++) {
+            const uint8_t probe = wide[row * kPackedLanes];
+            for (size_t lane = 0; lane < kPackedLanes; lane++) {
+                out[lane] = static_cast<uint16_t>(out[lane] + __builtin_popcount(probe & rows[row * kPackedLanes + lane]));
+            }
+        }
+    }
+}
+
+#if OPENAFIS_X86_DISPATCH
+// Byte counts are summed this many steps before widening (at most 8 per step, so no u8 overflow)
+constexpr size_t kStepsPerFlush = 16;
+
+/**
+ * @brief Two rows of 16 candidates per step; popcount through a nibble lookup table
+ */
+__attribute__((target("avx2")))
+void scoreAvx2(const uint8_t* blocks, const uint8_t* wide, size_t block_count, uint16_t* scores) {
+    static_assert(kDescriptorBytes % (2 * kStepsPerFlush) == 0, "rows are consumed in flushes of pairs");
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    for (size_t block = 0; block < block_count; block++) {
+        const uint8_t* rows = blocks + block * kBlockBytes;
+        __m256i sum = _mm256_setzero_si256();
+        for (size_t row = 0; row < kDescriptorBytes; row += 2 * kStepsPerFlush) {
+            __m256i counts = _mm256_setzero_si256();
+            for (size_t step = 0; step < kStepsPerFlush; step++) {
+                const size_t offset = (row + 2 * step) * kPackedLanes;
+                __m256i shared = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows + offset)),
+                                                  _mm256_loadu_si256(reinterpret_cast<const __m256i*>(wide + offset)));
+                __m256i low = _mm256_shuffle_epi8(table, _mm256_and_si256(shared, nibble));
+                __m256i high = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(shared, 4), nibble));
+                counts = _mm256_add_epi8(counts, _mm256_add_epi8(low, high));
+            }
+            sum = _mm256_add_epi16(sum, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(counts)));
+            sum = _mm256_add_epi16(sum, _mm256_cvtepu8_epi16(_mm256_extracti128_si256(counts, 1)));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(scores + block * kPackedLanes), sum);
+    }
+}
+
+/**
+ * @brief Four rows of 16 candidates per step, folded into one 16-lane sum at the end
+ */
+__attribute__((target("avx512f,avx512bw")))
+void scoreAvx512(const uint8_t* blocks, const uint8_t* wide, size_t block_count, uint16_t* scores) {
+    static_assert(kDescriptorBytes % (4 * kStepsPerFlush) == 0, "rows are consumed in flushes of quads");
+    static const uint8_t kNibbleCounts[64] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                              0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                              0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                              0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+    const __m512i table = _mm512_loadu_si512(kNibbleCounts);
+    const __m512i nibble = _mm512_set1_epi8(0x0F);
+    for (size_t block = 0; block < block_count; block++) {
+        const uint8_t* rows = blocks + block * kBlockBytes;
+        __m512i sum = _mm512_setzero_si512();
+        for (size_t row = 0; row < kDescriptorBytes; row += 4 * kStepsPerFlush) {
+            __m512i counts = _mm512_setzero_si512();
+            for (size_t step = 0; step < kStepsPerFlush; step++) {
+                const size_t offset = (row + 4 * step) * kPackedLanes;
+                __m512i shared = _mm512_and_si512(_mm512_loadu_si512(rows + offset), _mm512_loadu_si512(wide + offset));
+                __m512i low = _mm512_shuffle_epi8(table, _mm512_and_si512(shared, nibble));
+                __m512i high = _mm512_shuffle_epi8(table, _mm512_and_si512(_mm512_srli_epi16(shared, 4), nibble));
+                counts = _mm512_add_epi8(counts, _mm512_add_epi8(low, high));
+            }
+            sum = _mm512_add_epi16(sum, _mm512_cvtepu8_epi16(_mm512_castsi512_si256(counts)));
+            sum = _mm512_add_epi16(sum, _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(counts, 1)));
+        }
+        __m256i folded = _mm256_add_epi16(_mm512_castsi512_si256(sum), _mm512_extracti64x4_epi64(sum, 1));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(scores + block * kPackedLanes), folded);
+    }
+}
+#endif
+
+struct SelectedKernel {
+    ScoreKernel score;
+    const char* name;
+};
+
+const SelectedKernel& selectedKernel() {
+    static const SelectedKernel kernel = [] {
+#if OPENAFIS_X86_DISPATCH
+        if (selectedIsaLevel() >= IsaLevel::AVX512) {
+            return SelectedKernel{scoreAvx512, "avx512"};
+        }
+        if (selectedIsaLevel() >= IsaLevel::AVX2) {
+            return SelectedKernel{scoreAvx2, "avx2"};
+        }
+#endif
+        return SelectedKernel{scoreScalar, "scalar"};
+    }();
+    return kernel;
+}
+
+/**
+ * @brief Angle of a vector in 256ths of a turn, counter-clockwise with y pointing down (as ISO directions)
+ */
+double lineDirection(int dx, int dy) {
+    const double turns = std::atan2(static_cast<double>(-dy), static_cast<double>(dx)) / (2.0 * kPi);
+    return turns < 0.0 ? (turns + 1.0) * 256.0 : turns * 256.0;
+}
+
+/**
+ * @brief Cells a feature value falls in: its own, plus the nearer neighbour when near an edge
+ * @param wrap Cells are circular (angles) rather than clamped (distance)
+ * @return Number of cells written to out (1 or 2)
+ */
+int cellsOf(double position, int cells, bool wrap, bool probe, int out[2]) {
+    int cell = static_cast<int>(position);
+    if (wrap) {
+        cell = ((cell % cells) + cells) % cells;
+    } else {
+        cell = std::min(std::max(cell, 0), cells - 1);
+    }
+    out[0] = cell;
+    if (!probe) {
+        return 1;
+    }
+
+    const double fraction = position - std::floor(position);
+    int neighbour = -1;
+    if (fraction < kEdgeMargin) {
+        neighbour = cell - 1;
+    } else if (fraction > 1.0 - kEdgeMargin) {
+        neighbour = cell + 1;
+    }
+    if (wrap && neighbour != -1) {
+        neighbour = (neighbour + cells) % cells;
+    }
+    if (neighbour < 0 || neighbour >= cells) {
+        return 1;
+    }
+    out[1] = neighbour;
+    return 2;
+}
+
+void setFeature(int distance, int direction, int line, uint8_t* bits) {
+    const uint32_t key = static_cast<uint32_t>((distance * kAngleCells + direction) * kAngleCells + line) + 1;
+    const uint32_t bit = (key * 2654435761u) >> 16 & (kDescriptorBits - 1);
+    bits[bit >> 3] |= static_cast<uint8_t>(1u << (bit & 7));
+}
+
+void describeView(const std::vector<Minutia>& minutiae, bool probe, uint8_t* bits) {
+    thread_local std::vector<std::pair<double, size_t>> nearest;
+    for (size_t i = 0; i < minutiae.size(); i++) {
+        nearest.clear();
+        for (size_t j = 0; j < minutiae.size(); j++) {
+            const double dx = minutiae[j].x - minutiae[i].x;
+            const double dy = minutiae[j].y - minutiae[i].y;
+            const double distance = std::sqrt(dx * dx + dy * dy);
+            if (j != i && distance < kMaxPairDistance) {
+                nearest.emplace_back(distance, j);
+            }
+        }
+        const size_t kept = std::min(kNeighbours, nearest.size());
+        std::partial_sort(nearest.begin(), nearest.begin() + kept, nearest.end());
+
+        for (size_t n = 0; n < kept; n++) {
+            const Minutia& other = minutiae[nearest[n].second];
+            const double direction = static_cast<uint8_t>(other.direction - minutiae[i].direction);
+            double line = lineDirection(other.x - minutiae[i].x, other.y - minutiae[i].y) - minutiae[i].direction;
+            if (line < 0.0) {
+                line += 256.0;
+            }
+
+            int distance_cells[2], direction_cells[2], line_cells[2];
+            const int distances = cellsOf(nearest[n].first * kDistanceCells / kMaxPairDistance, kDistanceCells,
+                                          false, probe, distance_cells);
+            const int directions = cellsOf(direction * kAngleCells / 256.0, kAngleCells, true, probe, direction_cells);
+            const int lines = cellsOf(line * kAngleCells / 256.0, kAngleCells, true, probe, line_cells);
+            for (int a = 0; a < distances; a++) {
+                for (int b = 0; b < directions; b++) {
+                    for (int c = 0; c < lines; c++) {
+                        setFeature(distance_cells[a], direction_cells[b], line_cells[c], bits);
+                    }
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+bool describeMinutiae(const uint8_t* data, size_t length, bool probe, MinutiaeDescriptor& descriptor) {
+    descriptor.bits.fill(0);
+    if (data == nullptr || length < kRecordHeaderBytes) {
+        return false;
+    }
+
+    thread_local std::vector<Minutia> minutiae;
+    const size_t views = data[22];
+    size_t offset = kRecordHeaderBytes;
+    for (size_t view = 0; view < views; view++) {
+        if (offset + kViewHeaderBytes > length) {
+            return false;
+        }
+        const size_t count = data[offset + 3];
+        offset += kViewHeaderBytes;
+        if (offset + count * kMinutiaBytes + kExtendedLengthBytes > length) {
+            return false;
+        }
+
+        minutiae.clear();
+        for (size_t m = 0; m < count; m++, offset += kMinutiaBytes) {
+            const uint8_t* raw = data + offset;
+            minutiae.push_back({((raw[0] & 0x3F) << 8) | raw[1], ((raw[2] & 0x3F) << 8) | raw[3], raw[4]});
+        }
+        describeView(minutiae, probe, descriptor.bits.data());
+
+        offset += kExtendedLengthBytes + ((static_cast<size_t>(data[offset]) << 8) | data[offset + 1]);
+    }
+    return true;
+}
+
+void widenProbe(const MinutiaeDescriptor& probe, std::vector<uint8_t>& wide) {
+    wide.resize(kBlockBytes);
+    for (size_t row = 0; row < kDescriptorBytes; row++) {
+        std::fill(wide.begin() + row * kPackedLanes, wide.begin() + (row + 1) * kPackedLanes, probe.bits[row]);
+    }
+}
+
+void PackedGallery::append(const MinutiaeDescriptor& descriptor) {
+    const size_t lane = size_ % kPackedLanes;
+    if (lane == 0) {
+        // Padding lanes stay zero and score zero
+        blocks_.resize(blocks_.size() + kBlockBytes, 0);
+    }
+    uint8_t* block = blocks_.data() + (size_ / kPackedLanes) * kBlockBytes;
+    for (size_t row = 0; row < kDescriptorBytes; row++) {
+        block[row * kPackedLanes + lane] = descriptor.bits[row];
+    }
+    size_++;
+}
+
+void PackedGallery::erase(size_t index) {
+    if (index >= size_) {
+        return;
+    }
+    uint8_t* base = blocks_.data();
+    auto lane = [base](size_t candidate) {
+        return base + (candidate / kPackedLanes) * kBlockBytes + candidate % kPackedLanes;
+    };
+
+    // Shift every later candidate down one lane, carrying it across block boundaries
+    for (size_t candidate = index; candidate + 1 < size_; candidate++) {
+        uint8_t* to = lane(candidate);
+        const uint8_t* from = lane(candidate + 1);
+        for (size_t row = 0; row < kDescriptorBytes; row++) {
+            to[row * kPackedLanes] = from[row * kPackedLanes];
+        }
+    }
+    // The vacated lane becomes padding, which must score zero
+    uint8_t* vacated = lane(size_ - 1);
+    for (size_t row = 0; row < kDescriptorBytes; row++) {
+        vacated[row * kPackedLanes] = 0;
+    }
+    size_--;
+    blocks_.resize(blocks() * kBlockBytes);
+}
+
+void PackedGallery::reserve(size_t candidates) {
+    blocks_.reserve((candidates + kPackedLanes - 1) / kPackedLanes * kBlockBytes);
+}
+
+void PackedGallery::clear() {
+    std::vector<uint8_t>().swap(blocks_);
+    size_ = 0;
+}
+
+void PackedGallery::score(const uint8_t* wide, size_t block_begin, size_t block_end, uint16_t* scores) const {
+    if (block_end > block_begin) {
+        selectedKernel().score(blocks_.data() + block_begin * kBlockBytes, wide, block_end - block_begin, scores);
+    }
+}
+
+const char* packedKernelName() {
+    return selectedKernel().name;
+}
+
+} // namespace openafis
@@ -0,0 +1,90 @@
+#ifndef PACKED_MINUTIAE_H
+#define PACKED_MINUTIAE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace openafis {
+
+// Bytes of a minutiae descriptor (a 2048-bit set)
+constexpr size_t kDescriptorBytes = 256;
+
+// Candidates per packed block, scored together by one kernel pass
+constexpr size_t kPackedLanes = 16;
+
+/**
+ * @brief Rotation- and translation-invariant summary of a record's minutiae
+ *
+ * Every minutia is paired with its nearest neighbours in the same view; each pair
+ * is quantized by distance, direction difference and the direction of the line
+ * joining them (relative to the first minutia) and hashed to one bit. Two
+ * impressions of the same finger share many bits, unrelated fingers few.
+ */
+struct MinutiaeDescriptor {
+    std::array<uint8_t, kDescriptorBytes> bits;
+};
+
+/**
+ * @brief Build the descriptor of an ISO 19794-2:2005 record
+ * @param probe Also set the bits of neighbouring cells for features near a cell edge,
+ *        so capture noise does not push a shared feature into another bit
+ * @return false if the record is too short for the minutiae its header declares
+ */
+bool describeMinutiae(const uint8_t* data, size_t length, bool probe, MinutiaeDescriptor& descriptor);
+
+/**
+ * @brief Widen a probe descriptor for the kernels: each byte repeated across kPackedLanes lanes
+ */
+void widenProbe(const MinutiaeDescriptor& probe, std::vector<uint8_t>& wide);
+
+/**
+ * @brief Gallery descriptors interleaved in blocks of kPackedLanes candidates
+ *
+ * Block layout is [byte][lane], so one descriptor byte of 16 candidates is a
+ * single 16-byte row. A probe is scored against a block by the number of bits
+ * both set (AND + nibble-table popcount), two rows per AVX2 step and four per
+ * AVX-512 step; the kernel is picked once through CpuDispatch.
+ */
+class PackedGallery {
+public:
+    PackedGallery() : size_(0) {}
+
+    void append(const MinutiaeDescriptor& descriptor);
+
+    /**
+     * @brief Remove one candidate, shifting the later ones down a lane so indices stay parallel
+     */
+    void erase(size_t index);
+
+    void reserve(size_t candidates);
+
+    /**
+     * @brief Remove every candidate and release the blocks
+     */
+    void clear();
+
+    size_t size() const { return size_; }
+    size_t blocks() const { return (size_ + kPackedLanes - 1) / kPackedLanes; }
+
+    /**
+     * @brief Pre-filter scores of the candidates in blocks [block_begin, block_end)
+     * @param wide Probe from widenProbe()
+     * @param scores Receives kPackedLanes scores per block (padding lanes score 0)
+     */
+    void score(const uint8_t* wide, size_t block_begin, size_t block_end, uint16_t* scores) const;
+
+private:
+    std::vector<uint8_t> blocks_;
+    size_t size_;
+};
+
+/**
+ * @brief Name of the pre-filter kernel selected for this CPU ("avx512", "avx2", "scalar")
+ */
+const char* packedKernelName();
+
+} // namespace openafis
+
+#endif // PACKED_MINUTIAE_H
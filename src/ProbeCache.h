@@ -0,0 +1,272 @@
+#ifndef PROBE_CACHE_H
+#define PROBE_CACHE_H
+
+#include "TemplateId.h"
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace openafis {
+
+/**
+ * @brief Counters describing probe cache effectiveness
+ */
+struct ProbeCacheStats {
+    uint64_t hits;         // Lookups that found the parsed probe
+    uint64_t result_hits;  // Hits whose 1:N result was still valid for the gallery
+    uint64_t misses;       // Lookups that had to parse the probe
+    size_t entries;        // Entries currently held
+
+    ProbeCacheStats() : hits(0), result_hits(0), misses(0), entries(0) {}
+};
+
+/**
+ * @brief Short-TTL LRU cache of parsed probes and their last 1:N result
+ *
+ * Entries are keyed by a hash of the raw probe bytes and verified byte-for-byte,
+ * so a hash collision can never return another probe's result. A cached result
+ * is only reused while the gallery version it was computed against is current.
+ * Once the cache is full, evicted entries are recycled in place and their parsed
+ * probes are handed back through reclaim(), so a steady stream of new probes
+ * causes no allocations here. All methods are thread-safe.
+ *
+ * @tparam Probe Parsed probe template type
+ */
+template <class Probe>
+class ProbeCache {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Snapshot of a cache entry handed back by lookup()
+     */
+    struct Hit {
+        std::shared_ptr<const Probe> probe;
+        bool has_result;
+        uint64_t gallery_version;
+        uint8_t similarity_score;
+        TemplateId matched_template_id;
+    };
+
+    ProbeCache() : capacity_(0), ttl_(0), bytes_(0) {}
+
+    /**
+     * @brief Resize the cache and set the entry lifetime; capacity 0 disables it
+     */
+    void configure(size_t capacity, std::chrono::milliseconds ttl) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        capacity_ = capacity;
+        ttl_ = ttl;
+        while (lru_.size() > capacity_) {
+            evictOldest();
+        }
+        spare_.reserve(kMaxSpareProbes);
+    }
+
+    bool enabled() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return capacity_ > 0;
+    }
+
+    /**
+     * @brief Look up a probe by content
+     * @return true and fills hit if a live entry holds exactly these bytes
+     */
+    bool lookup(const uint8_t* data, size_t length, Hit& hit) {
+        const uint64_t key = hashBytes(data, length);
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = index_.find(key);
+        if (it == index_.end() || !sameBytes(*it->second, data, length)) {
+            stats_.misses++;
+            return false;
+        }
+
+        if (Clock::now() >= it->second->expires_at) {
+            bytes_ -= entryBytes(*it->second);
+            lru_.erase(it->second);
+            index_.erase(it);
+            stats_.misses++;
+            return false;
+        }
+
+        // Move to the front of the LRU list
+        lru_.splice(lru_.begin(), lru_, it->second);
+        const Entry& entry = *it->second;
+        hit.probe = entry.probe;
+        hit.has_result = entry.has_result;
+        hit.gallery_version = entry.gallery_version;
+        hit.similarity_score = entry.similarity_score;
+        hit.matched_template_id = entry.matched_template_id;
+        stats_.hits++;
+        return true;
+    }
+
+    /**
+     * @brief Record that a cached result was served without scanning
+     */
+    void countResultHit() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.result_hits++;
+    }
+
+    /**
+     * @brief Hand back a parsed probe released by an evicted entry, for reuse by the caller
+     * @return nullptr if none is available
+     */
+    std::shared_ptr<Probe> reclaim() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (spare_.empty()) {
+            return nullptr;
+        }
+        std::shared_ptr<Probe> probe = std::move(spare_.back());
+        spare_.pop_back();
+        bytes_ -= probe->bytes();
+        return probe;
+    }
+
+    /**
+     * @brief Store (or refresh) a probe and the 1:N result computed for it
+     */
+    void store(const uint8_t* data, size_t length, std::shared_ptr<const Probe> probe,
+               uint64_t gallery_version, uint8_t similarity_score, const TemplateId& matched_template_id) {
+        const uint64_t key = hashBytes(data, length);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (capacity_ == 0) {
+            return;
+        }
+
+        auto it = index_.find(key);
+        if (it != index_.end() && sameBytes(*it->second, data, length)) {
+            // Same probe: refresh the entry where it is
+            bytes_ -= entryBytes(*it->second);
+            lru_.splice(lru_.begin(), lru_, it->second);
+        } else if (it != index_.end() || lru_.size() >= capacity_) {
+            // Reuse a node (the colliding entry or the least recently used one) and its map slot
+            auto victim = it != index_.end() ? it->second : std::prev(lru_.end());
+            bytes_ -= entryBytes(*victim);
+            auto node = index_.extract(victim->key);
+            retireProbe(*victim);
+            lru_.splice(lru_.begin(), lru_, victim);
+            node.key() = key;
+            index_.insert(std::move(node));
+            lru_.front().bytes.assign(data, data + length);
+        } else {
+            lru_.emplace_front();
+            index_[key] = lru_.begin();
+            lru_.front().bytes.assign(data, data + length);
+        }
+
+        Entry& entry = lru_.front();
+        entry.key = key;
+        if (entry.probe != probe) {
+            retireProbe(entry);
+            entry.probe = std::move(probe);
+        }
+        entry.has_result = true;
+        entry.gallery_version = gallery_version;
+        entry.similarity_score = similarity_score;
+        entry.matched_template_id = matched_template_id;
+        entry.expires_at = Clock::now() + ttl_;
+        bytes_ += entryBytes(entry);
+    }
+
+    /**
+     * @brief Drop every entry
+     */
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lru_.clear();
+        index_.clear();
+        spare_.clear();
+        bytes_ = 0;
+    }
+
+    /**
+     * @brief Approximate memory held by the entries (raw bytes and parsed probes) and spare probes
+     */
+    size_t bytes() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return bytes_;
+    }
+
+    ProbeCacheStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ProbeCacheStats result = stats_;
+        result.entries = lru_.size();
+        return result;
+    }
+
+private:
+    struct Entry {
+        uint64_t key;
+        std::vector<uint8_t> bytes;
+        std::shared_ptr<const Probe> probe;
+        bool has_result;
+        uint64_t gallery_version;
+        uint8_t similarity_score;
+        TemplateId matched_template_id;
+        Clock::time_point expires_at;
+    };
+
+    using EntryList = std::list<Entry>;
+
+    // Parsed probes kept for reclaim(); more than a handful would only pin memory
+    static constexpr size_t kMaxSpareProbes = 8;
+
+    // FNV-1a over the raw record
+    static uint64_t hashBytes(const uint8_t* data, size_t length) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < length; i++) {
+            hash ^= data[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    static bool sameBytes(const Entry& entry, const uint8_t* data, size_t length) {
+        return entry.bytes.size() == length && std::memcmp(entry.bytes.data(), data, length) == 0;
+    }
+
+    // Memory charged for one entry; spare probes are charged by retireProbe()
+    static size_t entryBytes(const Entry& entry) {
+        return sizeof(Entry) + entry.bytes.capacity() + (entry.probe ? entry.probe->bytes() : 0);
+    }
+
+    void evictOldest() {
+        bytes_ -= entryBytes(lru_.back());
+        index_.erase(lru_.back().key);
+        retireProbe(lru_.back());
+        lru_.pop_back();
+    }
+
+    // Keep an entry's probe for reuse if nobody else still holds it
+    void retireProbe(Entry& entry) {
+        if (entry.probe && entry.probe.use_count() == 1 && spare_.size() < kMaxSpareProbes) {
+            // Probes are created non-const by the matcher; the cache is the sole owner here
+            bytes_ += entry.probe->bytes();
+            spare_.push_back(std::const_pointer_cast<Probe>(std::move(entry.probe)));
+        }
+        entry.probe.reset();
+    }
+
+    size_t capacity_;
+    std::chrono::milliseconds ttl_;
+    EntryList lru_;
+    std::unordered_map<uint64_t, typename EntryList::iterator> index_;
+    std::vector<std::shared_ptr<Probe>> spare_;
+    size_t bytes_;
+    ProbeCacheStats stats_;
+    mutable std::mutex mutex_;
+};
+
+} // namespace openafis
+
+#endif // PROBE_CACHE_H
@@ -0,0 +1,107 @@
+#include "ProbeCoalescer.h"
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+namespace openafis {
+
+ProbeCoalescer::ProbeCoalescer(BatchRunner runner, const Options& options)
+    : runner_(std::move(runner)), options_(options), stopping_(false) {
+    if (options_.max_batch_size == 0) {
+        options_.max_batch_size = 1;
+    }
+    worker_ = std::thread(&ProbeCoalescer::run, this);
+}
+
+ProbeCoalescer::~ProbeCoalescer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+void ProbeCoalescer::submit(std::vector<uint8_t> probe, Completion completion) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back({std::move(probe), std::move(completion), std::chrono::steady_clock::now()});
+    }
+    cv_.notify_one();
+}
+
+void ProbeCoalescer::setOptions(const Options& options) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        options_ = options;
+        if (options_.max_batch_size == 0) {
+            options_.max_batch_size = 1;
+        }
+    }
+    cv_.notify_one();
+}
+
+ProbeCoalescer::Options ProbeCoalescer::getOptions() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return options_;
+}
+
+ProbeCoalescer::Stats ProbeCoalescer::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void ProbeCoalescer::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    
+    while (true) {
+        cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            break; // Stopping and fully drained
+        }
+        
+        // The window starts at the oldest queued probe, which bounds its added latency
+        const auto deadline = queue_.front().arrival + options_.window;
+        cv_.wait_until(lock, deadline, [this] {
+            return stopping_ || queue_.size() >= options_.max_batch_size;
+        });
+        
+        const size_t batch_size = std::min(queue_.size(), options_.max_batch_size);
+        std::vector<Pending> batch;
+        batch.reserve(batch_size);
+        for (size_t i = 0; i < batch_size; i++) {
+            batch.push_back(std::move(queue_.front()));
+            queue_.pop_front();
+        }
+        stats_.probes += batch_size;
+        stats_.batches++;
+        stats_.largest_batch = std::max(stats_.largest_batch, batch_size);
+        
+        lock.unlock();
+        
+        std::vector<std::vector<uint8_t>> probes;
+        probes.reserve(batch_size);
+        for (auto& pending : batch) {
+            probes.push_back(std::move(pending.probe));
+        }
+        
+        std::vector<MatchResult> results;
+        try {
+            results = runner_(probes);
+        } catch (const std::exception& e) {
+            std::cerr << "Error in coalesced batch: " << e.what() << std::endl;
+        }
+        results.resize(batch_size);
+        
+        for (size_t i = 0; i < batch_size; i++) {
+            batch[i].completion(results[i], batch_size);
+        }
+        
+        lock.lock();
+    }
+}
+
+} // namespace openafis
@@ -0,0 +1,107 @@
+#ifndef PROBE_COALESCER_H
+#define PROBE_COALESCER_H
+
+#include "FingerprintMatcher.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace openafis {
+
+/**
+ * @brief Gathers concurrent 1:N probes and serves them as one multi-probe pass
+ *
+ * Probes arriving within the coalescing window (or until the batch is full)
+ * are handed to the batch runner together; every caller gets its own result
+ * through its completion callback, invoked on the coalescer thread.
+ */
+class ProbeCoalescer {
+public:
+    /**
+     * @brief Coalescing parameters
+     */
+    struct Options {
+        std::chrono::microseconds window;  // Maximum wait after the first queued probe
+        size_t max_batch_size;             // Batch is dispatched as soon as it is this full
+        
+        Options() : window(1500), max_batch_size(32) {}
+    };
+    
+    /**
+     * @brief Counters describing how well probes are being coalesced
+     */
+    struct Stats {
+        uint64_t probes;       // Probes served
+        uint64_t batches;      // Batches dispatched
+        size_t largest_batch;  // Largest batch dispatched so far
+        
+        Stats() : probes(0), batches(0), largest_batch(0) {}
+    };
+    
+    using BatchRunner = std::function<std::vector<MatchResult>(const std::vector<std::vector<uint8_t>>&)>;
+    using Completion = std::function<void(const MatchResult& result, size_t batch_size)>;
+    
+    /**
+     * @brief Construct a coalescer and start its dispatch thread
+     * @param runner Function performing the blocked multi-probe scan
+     * @param options Coalescing window and batch size
+     */
+    explicit ProbeCoalescer(BatchRunner runner, const Options& options = Options());
+    
+    /**
+     * @brief Stop the dispatch thread after serving every queued probe
+     */
+    ~ProbeCoalescer();
+    
+    ProbeCoalescer(const ProbeCoalescer&) = delete;
+    ProbeCoalescer& operator=(const ProbeCoalescer&) = delete;
+    
+    /**
+     * @brief Queue a probe for the next batch
+     * @param probe Raw ISO probe template
+     * @param completion Called with the probe's result once its batch has run
+     */
+    void submit(std::vector<uint8_t> probe, Completion completion);
+    
+    /**
+     * @brief Replace the coalescing parameters (applies to the next batch)
+     */
+    void setOptions(const Options& options);
+    
+    /**
+     * @brief Get the current coalescing parameters
+     */
+    Options getOptions() const;
+    
+    /**
+     * @brief Get coalescing counters
+     */
+    Stats getStats() const;
+
+private:
+    struct Pending {
+        std::vector<uint8_t> probe;
+        Completion completion;
+        std::chrono::steady_clock::time_point arrival;
+    };
+    
+    void run();
+    
+    BatchRunner runner_;
+    Options options_;
+    Stats stats_;
+    std::deque<Pending> queue_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_;
+    std::thread worker_;
+};
+
+} // namespace openafis
+
+#endif // PROBE_COALESCER_H
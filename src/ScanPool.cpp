@@ -0,0 +1,99 @@
+#include "ScanPool.h"
+
+#include <algorithm>
+
+namespace openafis {
+
+ScanPool::ScanPool(size_t workers) : queue_head_(nullptr), queue_tail_(nullptr), stopping_(false) {
+    const size_t helpers = std::max<size_t>(1, workers) - 1;
+    threads_.reserve(helpers);
+    for (size_t w = 1; w <= helpers; w++) {
+        threads_.emplace_back(&ScanPool::loop, this);
+    }
+}
+
+ScanPool::~ScanPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& t : threads_) {
+        t.join();
+    }
+}
+
+ScanPool& ScanPool::shared() {
+    // Intentionally leaked: workers must outlive every matcher, including ones torn down at exit
+    static ScanPool* pool = new ScanPool(std::max(1u, std::thread::hardware_concurrency()));
+    return *pool;
+}
+
+void ScanPool::dispatch(Trampoline trampoline, void* task) {
+    Job job;
+    job.trampoline = trampoline;
+    job.task = task;
+    job.next = 0;
+    job.remaining = workers();
+    job.queued_after = nullptr;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!threads_.empty()) {
+        if (queue_tail_ != nullptr) {
+            queue_tail_->queued_after = &job;
+        } else {
+            queue_head_ = &job;
+        }
+        queue_tail_ = &job;
+        work_cv_.notify_all();
+    }
+
+    // The caller works on its own job; workers busy with other jobs join in as they free up
+    while (job.next < workers()) {
+        execute(job, claim(job), lock);
+    }
+    job.done_cv.wait(lock, [&job] { return job.remaining == 0; });
+}
+
+size_t ScanPool::claim(Job& job) {
+    const size_t worker = job.next++;
+    if (job.next == workers() && !threads_.empty()) {
+        // Fully claimed: unlink it so idle workers move on to the next job
+        Job** link = &queue_head_;
+        Job* previous = nullptr;
+        while (*link != &job) {
+            previous = *link;
+            link = &previous->queued_after;
+        }
+        *link = job.queued_after;
+        if (queue_tail_ == &job) {
+            queue_tail_ = previous;
+        }
+        job.queued_after = nullptr;
+    }
+    return worker;
+}
+
+void ScanPool::execute(Job& job, size_t worker, std::unique_lock<std::mutex>& lock) {
+    lock.unlock();
+    job.trampoline(job.task, worker);
+    lock.lock();
+    if (--job.remaining == 0) {
+        job.done_cv.notify_one();
+    }
+}
+
+void ScanPool::loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        work_cv_.wait(lock, [this] { return stopping_ || queue_head_ != nullptr; });
+        if (stopping_) {
+            break;
+        }
+        Job& job = *queue_head_;
+        execute(job, claim(job), lock);
+    }
+}
+
+} // namespace openafis
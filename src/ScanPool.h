@@ -0,0 +1,103 @@
+#ifndef SCAN_POOL_H
+#define SCAN_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace openafis {
+
+/**
+ * @brief Persistent worker threads that fan one gallery scan out across cores
+ *
+ * run() calls the task once for every worker index and returns once all of
+ * them have finished. Tasks are passed by reference through a plain function
+ * pointer, so dispatching a scan never allocates. Concurrent run() calls share
+ * the threads: each call is queued, idle workers take indices from the oldest
+ * queued call, and the calling thread works through the indices of its own
+ * call, so a scan keeps making progress while another one holds the workers.
+ */
+class ScanPool {
+public:
+    /**
+     * @brief Start a pool
+     * @param workers Number of participants including the calling thread (at least 1)
+     */
+    explicit ScanPool(size_t workers);
+
+    /**
+     * @brief Stop and join the worker threads
+     */
+    ~ScanPool();
+
+    ScanPool(const ScanPool&) = delete;
+    ScanPool& operator=(const ScanPool&) = delete;
+
+    /**
+     * @brief Process-wide pool sized to the hardware concurrency
+     */
+    static ScanPool& shared();
+
+    /**
+     * @brief Number of participants in every run()
+     */
+    size_t workers() const { return threads_.size() + 1; }
+
+    /**
+     * @brief Call task(worker) once for every worker index in [0, workers()) and wait
+     *
+     * Indices may run on any thread, several of them one after another on the same
+     * thread when the pool is shared with other calls.
+     * @param task Callable taking the worker index; must not throw
+     */
+    template <class Task>
+    void run(Task& task) {
+        dispatch(&invoke<Task>, &task);
+    }
+
+private:
+    using Trampoline = void (*)(void* task, size_t worker);
+
+    template <class Task>
+    static void invoke(void* task, size_t worker) {
+        (*static_cast<Task*>(task))(worker);
+    }
+
+    /**
+     * @brief One run() call, queued on the caller's stack while it has unclaimed indices
+     */
+    struct Job {
+        Trampoline trampoline;
+        void* task;
+        size_t next;         // Next worker index to hand out
+        size_t remaining;    // Indices not finished yet
+        Job* queued_after;
+        std::condition_variable done_cv;
+    };
+
+    void dispatch(Trampoline trampoline, void* task);
+    void loop();
+
+    /**
+     * @brief Hand out the next index of a job, dequeuing it once all are claimed (mutex_ held)
+     */
+    size_t claim(Job& job);
+
+    /**
+     * @brief Run one index of a job and record its completion
+     */
+    void execute(Job& job, size_t worker, std::unique_lock<std::mutex>& lock);
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    Job* queue_head_;          // Oldest job with unclaimed indices
+    Job* queue_tail_;
+    bool stopping_;
+};
+
+} // namespace openafis
+
+#endif // SCAN_POOL_H
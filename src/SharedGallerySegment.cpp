@@ -0,0 +1,380 @@
+#include "SharedGallerySegment.h"
+#include "StorageUtil.h"
+
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace openafis {
+
+namespace {
+
+const char kSegmentMagic[8] = {'O', 'A', 'F', 'S', 'H', 'M', '0', '1'};
+
+// Operation byte, u32 id length, u32 data length
+constexpr size_t kEntryOverhead = 1 + 4 + 4;
+
+// A read overlapping this many publications in a row gives up (the writer is in a tight loop)
+constexpr int kMaxReadAttempts = 1000;
+
+void storeU32(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+bool isShmName(const std::string& name) {
+    return name.size() > 1 && name[0] == '/' && name.find('/', 1) == std::string::npos;
+}
+
+} // namespace
+
+/**
+ * @brief Segment header, followed by the log
+ *
+ * Lives in the shared mapping, so it only holds lock-free atomics and plain data.
+ */
+struct SharedGallerySegment::Header {
+    char magic[8];
+    uint64_t capacity;                   // Log bytes after the header
+    std::atomic<uint64_t> generation;    // Odd while the writer is publishing
+    std::atomic<uint64_t> epoch;         // Incremented on every rewrite
+    std::atomic<uint64_t> used;          // Log bytes published
+    uint64_t reserved[3];
+};
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "shared atomics must be plain words");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomics must be lock-free across processes");
+
+SharedGallerySegment::SharedGallerySegment() : writer_(false), fd_(-1), header_(nullptr), mapped_bytes_(0) {}
+
+SharedGallerySegment::~SharedGallerySegment() {
+    close();
+}
+
+#ifdef _WIN32
+
+bool SharedGallerySegment::map(const std::string& name, bool, size_t) {
+    std::cerr << "Shared galleries are not supported on Windows: " << name << std::endl;
+    return false;
+}
+
+void SharedGallerySegment::close() {}
+
+bool SharedGallerySegment::remap() {
+    return false;
+}
+
+bool SharedGallerySegment::unlink(const std::string&) {
+    return false;
+}
+
+#else
+
+bool SharedGallerySegment::map(const std::string& name, bool writer, size_t capacity) {
+    close();
+
+    const int flags = writer ? (O_CREAT | O_RDWR) : O_RDONLY;
+    int fd = isShmName(name) ? shm_open(name.c_str(), flags, 0600) : ::open(name.c_str(), flags, 0600);
+    if (fd < 0) {
+        std::cerr << "Failed to open shared gallery " << name << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // The lock is released when the descriptor is closed, including when the writer dies
+    if (writer && flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        std::cerr << "Shared gallery " << name << " already has a writer" << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+
+    if (writer) {
+        // Never shrink: readers may still map the old size
+        const size_t wanted = sizeof(Header) + capacity;
+        if (size < wanted) {
+            if (ftruncate(fd, static_cast<off_t>(wanted)) != 0) {
+                std::cerr << "Failed to size shared gallery " << name << ": " << std::strerror(errno) << std::endl;
+                ::close(fd);
+                return false;
+            }
+            size = wanted;
+        }
+    } else if (size < sizeof(Header)) {
+        std::cerr << "Shared gallery " << name << " has not been published" << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    void* base = mmap(nullptr, size, writer ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        std::cerr << "Failed to map shared gallery " << name << ": " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    Header* header = static_cast<Header*>(base);
+    if (std::memcmp(header->magic, kSegmentMagic, sizeof(kSegmentMagic)) != 0) {
+        if (!writer) {
+            std::cerr << "Not a shared gallery: " << name << std::endl;
+            munmap(base, size);
+            ::close(fd);
+            return false;
+        }
+        header = new (base) Header();
+        header->generation.store(0, std::memory_order_relaxed);
+        header->epoch.store(0, std::memory_order_relaxed);
+        header->used.store(0, std::memory_order_relaxed);
+        std::memcpy(header->magic, kSegmentMagic, sizeof(kSegmentMagic));
+    }
+    if (writer) {
+        header->capacity = size - sizeof(Header);
+    } else if (header->capacity > size - sizeof(Header)) {
+        std::cerr << "Shared gallery " << name << " is truncated" << std::endl;
+        munmap(base, size);
+        ::close(fd);
+        return false;
+    }
+
+    name_ = name;
+    writer_ = writer;
+    fd_ = fd;
+    header_.store(header, std::memory_order_release);
+    mapped_bytes_ = size;
+    return true;
+}
+
+void SharedGallerySegment::close() {
+    if (header() != nullptr) {
+        munmap(header(), mapped_bytes_);
+        header_.store(nullptr, std::memory_order_release);
+        mapped_bytes_ = 0;
+    }
+    for (const auto& mapping : retired_) {
+        munmap(mapping.first, mapping.second);
+    }
+    retired_.clear();
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    writer_ = false;
+}
+
+bool SharedGallerySegment::remap() {
+    if (!isReader()) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        return false;
+    }
+    if (static_cast<size_t>(st.st_size) <= mapped_bytes_) {
+        return true;
+    }
+
+    // Keep the current mapping alive: generation() may be reading it without a lock
+    SharedGallerySegment fresh;
+    if (!fresh.map(name_, false, 0)) {
+        return false;
+    }
+    retired_.emplace_back(header(), mapped_bytes_);
+    ::close(fd_);
+    fd_ = fresh.fd_;
+    mapped_bytes_ = fresh.mapped_bytes_;
+    header_.store(fresh.header(), std::memory_order_release);
+    fresh.fd_ = -1;
+    fresh.header_.store(nullptr, std::memory_order_relaxed);
+    return true;
+}
+
+bool SharedGallerySegment::unlink(const std::string& name) {
+    return (isShmName(name) ? shm_unlink(name.c_str()) : ::unlink(name.c_str())) == 0;
+}
+
+#endif
+
+bool SharedGallerySegment::create(const std::string& name, size_t capacity) {
+    return map(name, true, capacity);
+}
+
+bool SharedGallerySegment::attach(const std::string& name) {
+    return map(name, false, 0);
+}
+
+uint8_t* SharedGallerySegment::data() const {
+    return reinterpret_cast<uint8_t*>(header()) + sizeof(Header);
+}
+
+bool SharedGallerySegment::writeEntry(size_t offset, EnrollmentJournal::Operation operation, const std::string& id,
+                                      const uint8_t* data_bytes, size_t length, size_t& end) {
+    const size_t size = kEntryOverhead + id.size() + length;
+    if (offset + size > header()->capacity) {
+        return false;
+    }
+
+    uint8_t* out = data() + offset;
+    out[0] = static_cast<uint8_t>(operation);
+    storeU32(out + 1, static_cast<uint32_t>(id.size()));
+    std::memcpy(out + 5, id.data(), id.size());
+    storeU32(out + 5 + id.size(), static_cast<uint32_t>(length));
+    if (length > 0) {
+        std::memcpy(out + kEntryOverhead + id.size(), data_bytes, length);
+    }
+    end = offset + size;
+    return true;
+}
+
+void SharedGallerySegment::beginPublish() {
+    // A writer that died mid-publication left the generation odd: keep it odd until this publication ends
+    const uint64_t generation = header()->generation.load(std::memory_order_relaxed);
+    if ((generation & 1) == 0) {
+        header()->generation.store(generation + 1, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void SharedGallerySegment::endPublish() {
+    header()->generation.store((header()->generation.load(std::memory_order_relaxed) | 1) + 1,
+                               std::memory_order_release);
+}
+
+bool SharedGallerySegment::append(EnrollmentJournal::Operation operation, const std::string& id,
+                                  const uint8_t* data_bytes, size_t length) {
+    if (!isWriter()) {
+        return false;
+    }
+
+    const size_t used = static_cast<size_t>(header()->used.load(std::memory_order_relaxed));
+    if (used + kEntryOverhead + id.size() + length > header()->capacity) {
+        return false;
+    }
+
+    beginPublish();
+    size_t end = used;
+    writeEntry(used, operation, id, data_bytes, length, end);
+    header()->used.store(end, std::memory_order_relaxed);
+    endPublish();
+    return true;
+}
+
+bool SharedGallerySegment::rewrite(const std::vector<GalleryRecord>& records) {
+    if (!isWriter()) {
+        return false;
+    }
+
+    size_t total = 0;
+    for (const auto& record : records) {
+        total += kEntryOverhead + record.id.size() + record.data.size();
+    }
+    if (total > header()->capacity) {
+        return false;
+    }
+
+    beginPublish();
+    header()->epoch.fetch_add(1, std::memory_order_relaxed);
+    size_t offset = 0;
+    for (const auto& record : records) {
+        writeEntry(offset, EnrollmentJournal::Operation::Enroll, record.id, record.data.data(), record.data.size(),
+                   offset);
+    }
+    header()->used.store(offset, std::memory_order_relaxed);
+    endPublish();
+    return true;
+}
+
+uint64_t SharedGallerySegment::generation() const {
+    return header() != nullptr ? header()->generation.load(std::memory_order_acquire) : 0;
+}
+
+bool SharedGallerySegment::read(uint64_t& epoch, size_t& offset, std::vector<EnrollmentJournal::Entry>& entries,
+                                bool& replaced) const {
+    entries.clear();
+    replaced = false;
+    if (header() == nullptr) {
+        return false;
+    }
+
+    std::vector<uint8_t> log;
+    for (int attempt = 0; attempt < kMaxReadAttempts; attempt++) {
+        const uint64_t before = header()->generation.load(std::memory_order_acquire);
+        if (before & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        const uint64_t current_epoch = header()->epoch.load(std::memory_order_relaxed);
+        const size_t used = static_cast<size_t>(header()->used.load(std::memory_order_relaxed));
+        const bool rewritten = current_epoch != epoch || offset > used;
+        const size_t from = rewritten ? 0 : offset;
+        if (used > mapped_bytes_ - sizeof(Header)) {
+            std::cerr << "Shared gallery " << name_ << " grew past this mapping; remap it" << std::endl;
+            return false;
+        }
+        log.assign(data() + from, data() + used);
+
+        // Sequence lock: the copy only counts if no publication overlapped it
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header()->generation.load(std::memory_order_relaxed) != before) {
+            continue;
+        }
+
+        size_t position = 0;
+        uint64_t sequence = 0;
+        while (position < log.size()) {
+            if (log.size() - position < kEntryOverhead) {
+                return false;
+            }
+            EnrollmentJournal::Entry entry;
+            entry.sequence = ++sequence;
+            entry.operation = static_cast<EnrollmentJournal::Operation>(log[position]);
+            const uint32_t id_length = readU32(&log[position + 1]);
+            if (id_length > kMaxRecordIdBytes || log.size() - position - kEntryOverhead < id_length) {
+                return false;
+            }
+            entry.id.assign(reinterpret_cast<const char*>(&log[position + 5]), id_length);
+            const uint32_t data_length = readU32(&log[position + 5 + id_length]);
+            if (data_length > kMaxRecordDataBytes ||
+                log.size() - position - kEntryOverhead - id_length < data_length) {
+                return false;
+            }
+            const uint8_t* record = &log[position + kEntryOverhead + id_length];
+            entry.data.assign(record, record + data_length);
+            entries.push_back(std::move(entry));
+            position += kEntryOverhead + id_length + data_length;
+        }
+
+        epoch = current_epoch;
+        offset = used;
+        replaced = rewritten;
+        return true;
+    }
+    return false;
+}
+
+size_t SharedGallerySegment::capacity() const {
+    return header() != nullptr ? static_cast<size_t>(header()->capacity) : 0;
+}
+
+size_t SharedGallerySegment::usedBytes() const {
+    return header() != nullptr ? static_cast<size_t>(header()->used.load(std::memory_order_relaxed)) : 0;
+}
+
+} // namespace openafis
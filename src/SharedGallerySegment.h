@@ -0,0 +1,129 @@
+#ifndef SHARED_GALLERY_SEGMENT_H
+#define SHARED_GALLERY_SEGMENT_H
+
+#include "EnrollmentJournal.h"
+#include "GallerySnapshot.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace openafis {
+
+/**
+ * @brief Enrollment log of a gallery published in shared memory
+ *
+ * One writer process publishes enrollments, removals and clears as an append-only
+ * log in a POSIX shared memory object ("/name") or a memory-mapped file (any other
+ * path); any number of processes attach read-only and replay what is new since
+ * they last looked. Publication is a sequence lock: the writer makes the
+ * generation odd while it writes and even (release) once the log is consistent,
+ * and readers retry a read that overlapped a write. When the log fills up the
+ * writer rewrites it as the live records only and bumps the epoch, which tells
+ * readers to replay from the start. A second writer is refused while the first
+ * holds the segment's lock.
+ *
+ * Records are stored raw (ISO bytes), not as parsed OpenAFIS templates: those own
+ * heap memory and cannot be placed in a shared mapping.
+ */
+class SharedGallerySegment {
+public:
+    SharedGallerySegment();
+    ~SharedGallerySegment();
+
+    SharedGallerySegment(const SharedGallerySegment&) = delete;
+    SharedGallerySegment& operator=(const SharedGallerySegment&) = delete;
+
+    /**
+     * @brief Create (or take over) a segment as its single writer
+     * @param name "/name" for POSIX shared memory, otherwise a file path to map
+     * @param capacity Bytes reserved for the log
+     * @return false if the segment cannot be mapped or another writer holds it
+     */
+    bool create(const std::string& name, size_t capacity);
+
+    /**
+     * @brief Map an existing segment read-only
+     */
+    bool attach(const std::string& name);
+
+    /**
+     * @brief Map the segment again at its current size, after its writer grew it (reader only)
+     *
+     * Does nothing if the segment has not grown past the current mapping.
+     * The previous mapping stays valid until close(), so a generation() call racing
+     * with the remap never touches unmapped memory.
+     */
+    bool remap();
+
+    void close();
+
+    bool isOpen() const { return header() != nullptr; }
+    bool isWriter() const { return header() != nullptr && writer_; }
+    bool isReader() const { return header() != nullptr && !writer_; }
+    const std::string& name() const { return name_; }
+
+    /**
+     * @brief Append one change to the log (writer only)
+     * @return false if the log is full
+     */
+    bool append(EnrollmentJournal::Operation operation, const std::string& id,
+                const uint8_t* data = nullptr, size_t length = 0);
+
+    /**
+     * @brief Replace the log with an enrollment of each live record (writer only)
+     * @return false if the records do not fit
+     */
+    bool rewrite(const std::vector<GalleryRecord>& records);
+
+    /**
+     * @brief Publication counter; changes on every append or rewrite
+     */
+    uint64_t generation() const;
+
+    /**
+     * @brief Read the changes published after a reader's position
+     * @param epoch Reader's epoch; on return the segment's current one
+     * @param offset Reader's log offset; on return the end of the log
+     * @param entries Receives the new changes
+     * @param replaced Set if the log was rewritten since, so entries hold the whole gallery
+     * @return false if no consistent read was possible
+     */
+    bool read(uint64_t& epoch, size_t& offset, std::vector<EnrollmentJournal::Entry>& entries, bool& replaced) const;
+
+    size_t capacity() const;
+    size_t usedBytes() const;
+
+    /**
+     * @brief Delete a segment's name (mapped segments stay valid until unmapped)
+     */
+    static bool unlink(const std::string& name);
+
+private:
+    struct Header;
+
+    bool map(const std::string& name, bool writer, size_t capacity);
+    bool writeEntry(size_t offset, EnrollmentJournal::Operation operation, const std::string& id,
+                    const uint8_t* data, size_t length, size_t& end);
+    uint8_t* data() const;
+    Header* header() const { return header_.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Make the generation odd (readers retry) / even again once the log is consistent
+     */
+    void beginPublish();
+    void endPublish();
+
+    std::string name_;
+    bool writer_;
+    int fd_;
+    std::atomic<Header*> header_;
+    size_t mapped_bytes_;
+    std::vector<std::pair<Header*, size_t>> retired_;   // Mappings replaced by remap()
+};
+
+} // namespace openafis
+
+#endif // SHARED_GALLERY_SEGMENT_H
@@ -0,0 +1,55 @@
+#ifndef STORAGE_UTIL_H
+#define STORAGE_UTIL_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace openafis {
+
+/**
+ * @brief Append little-endian integers to a byte buffer
+ */
+inline void appendU32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+inline void appendU64(std::vector<uint8_t>& out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+/**
+ * @brief Read little-endian integers from a byte pointer
+ */
+inline uint32_t readU32(const uint8_t* in) {
+    return static_cast<uint32_t>(in[0]) | (static_cast<uint32_t>(in[1]) << 8) |
+           (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+}
+
+inline uint64_t readU64(const uint8_t* in) {
+    return static_cast<uint64_t>(readU32(in)) | (static_cast<uint64_t>(readU32(in + 4)) << 32);
+}
+
+/**
+ * @brief Flush a stdio stream and force its data to stable storage
+ */
+bool syncFile(FILE* file);
+
+/**
+ * @brief Force a directory entry update (e.g. after rename) to stable storage
+ */
+bool syncDirectory(const std::string& directory);
+
+/**
+ * @brief Directory part of a path ("." if there is none)
+ */
+std::string parentDirectory(const std::string& path);
+
+} // namespace openafis
+
+#endif // STORAGE_UTIL_H
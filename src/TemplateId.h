@@ -0,0 +1,41 @@
+#ifndef TEMPLATE_ID_H
+#define TEMPLATE_ID_H
+
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace openafis {
+
+/**
+ * @brief Lightweight handle to the ID of an enrolled template
+ *
+ * The ID string is allocated once at enrollment and shared by every result that
+ * refers to it, so copying a handle never allocates. A handle stays valid after
+ * the template is removed from the gallery.
+ */
+class TemplateId {
+public:
+    TemplateId() = default;
+    explicit TemplateId(std::string id) : id_(std::make_shared<const std::string>(std::move(id))) {}
+
+    bool empty() const { return !id_ || id_->empty(); }
+
+    /**
+     * @brief The ID, or an empty string for a default-constructed handle
+     */
+    const std::string& str() const {
+        static const std::string none;
+        return id_ ? *id_ : none;
+    }
+
+    bool operator==(const std::string& other) const { return str() == other; }
+    bool operator!=(const std::string& other) const { return !(*this == other); }
+
+private:
+    std::shared_ptr<const std::string> id_;
+};
+
+} // namespace openafis
+
+#endif // TEMPLATE_ID_H
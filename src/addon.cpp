@@ -2,42 +2,324 @@
 #include <vector>
 #include <string>
 #include <memory>
-#include <fstream>
 #include <cstdint>
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <cstdlib>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
 #include "FingerprintMatcher.h"
+#include "GalleryRegistry.h"
+#include "ProbeCoalescer.h"
+#include "CpuDispatch.h"
+#include "MatchTrace.h"
+#include "PackedMinutiae.h"
+#include "base64.h"
+#ifdef OPENAFIS_COUNT_ALLOCATIONS
+#include "AllocationCounter.h"
+#endif
 
-// Simple base64 decoder
-std::vector<uint8_t> decode_base64(const std::string& encoded_string) {
-    const std::string chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-    std::vector<uint8_t> decoded;
+/**
+ * @brief A persistent gallery and its lock
+ *
+ * Owned by one environment, or shared by every environment of the process (main
+ * thread and worker_threads) that published or attached the same shared gallery,
+ * so they all scan one parsed copy.
+ */
+struct GalleryState {
+    std::unique_ptr<openafis::FingerprintMatcher> matcher;
+    std::shared_mutex mutex;                  // Shared for scans, exclusive for (re)loading
     
-    // Clean the input string (remove whitespace and newlines)
-    std::string cleaned;
-    for (char c : encoded_string) {
-        if (chars.find(c) != std::string::npos || c == '=') {
-            cleaned += c;
-        }
+    GalleryState() : matcher(std::make_unique<openafis::FingerprintMatcher>(40)) {}
+};
+
+/**
+ * @brief Per-environment addon state: the persistent gallery and its coalescer
+ */
+struct AddonData {
+    // Replaced (std::atomic_store) only on the JS thread; workers hold their own reference
+    std::shared_ptr<GalleryState> gallery;
+    std::string shared_gallery;               // Shared gallery published or attached, empty if private
+    bool shared_publisher = false;            // This environment published shared_gallery
+    Napi::ObjectReference users;              // JS array the gallery was loaded from
+    std::unordered_map<std::string, uint32_t> index_by_id;
+    uint32_t loaded_count = 0;
+    
+    std::unique_ptr<openafis::ProbeCoalescer> coalescer;
+    openafis::ProbeCoalescer::Options coalescer_options;
+    Napi::ThreadSafeFunction completions;     // Delivers coalesced results to the JS thread
+    uint32_t pending_batched = 0;
+    
+    size_t probe_cache_capacity = 1024;
+    std::chrono::milliseconds probe_cache_ttl{2000};
+    
+    std::unique_ptr<openafis::GalleryRegistry> registry;  // Named (per-tenant) galleries, see configureGalleries
+    
+    bool tracing = false;                     // Attach per-phase timings to results and record spans
+    
+    // Reused by the synchronous gallery path so a steady stream of matches does not allocate
+    std::string probe_text;
+    std::vector<uint8_t> probe_bytes;
+    
+    AddonData() : gallery(std::make_shared<GalleryState>()) {
+        // Repeated presentations and retried requests within a couple of seconds skip the scan
+        gallery->matcher->configureProbeCache(probe_cache_capacity, probe_cache_ttl);
     }
     
-    if (cleaned.empty()) {
-        return decoded;
+    ~AddonData() {
+        // Serve queued probes before the completion channel goes away
+        coalescer.reset();
+        if (completions) {
+            completions.Release();
+        }
+        // The recorder is process-wide: stop only if no other environment is tracing
+        if (tracing) {
+            openafis::TraceRecorder::instance().release();
+        }
+    }
+};
+
+/**
+ * @brief Derive the template ID used for a database entry (its 'id' or its index)
+ */
+static std::string TemplateIdFor(const Napi::Object& obj, uint32_t index) {
+    if (obj.Has("id")) {
+        Napi::Value id_value = obj.Get("id");
+        if (id_value.IsString()) {
+            return id_value.As<Napi::String>().Utf8Value();
+        } else if (id_value.IsNumber()) {
+            return "id_" + std::to_string(id_value.As<Napi::Number>().Int32Value());
+        }
     }
+    return "template_" + std::to_string(index);
+}
+
+/**
+ * @brief Copy a JS string into a reusable buffer (no allocation once the buffer has grown)
+ */
+static void ReadUtf8(Napi::Env env, const Napi::Value& value, std::string& buffer) {
+    size_t length = 0;
+    napi_get_value_string_utf8(env, value, nullptr, 0, &length);
+    buffer.resize(length + 1);
+    napi_get_value_string_utf8(env, value, &buffer[0], buffer.size(), &length);
+    buffer.resize(length);
+}
+
+/**
+ * @brief Enroll every valid entry of a database array into a matcher
+ * @param index_by_id Optional map filled with template ID -> array index
+ * @return Number of templates loaded
+ */
+static uint32_t LoadDatabase(openafis::FingerprintMatcher& matcher, const Napi::Array& database_array,
+                             std::unordered_map<std::string, uint32_t>* index_by_id) {
+    uint32_t loaded_count = 0;
     
-    int val = 0, valb = -8;
-    for (char c : cleaned) {
-        if (chars.find(c) != std::string::npos) {
-            val = (val << 6) + static_cast<int>(chars.find(c));
-            valb += 6;
-            if (valb >= 0) {
-                decoded.push_back(static_cast<uint8_t>((val >> valb) & 0xFF));
-                valb -= 8;
+    for (uint32_t i = 0; i < database_array.Length(); i++) {
+        Napi::Value item = database_array[i];
+        
+        if (!item.IsObject()) {
+            continue; // Skip non-object items
+        }
+        
+        Napi::Object obj = item.As<Napi::Object>();
+        
+        // Check if object has 'fingerprint' property
+        if (!obj.Has("fingerprint")) {
+            continue; // Skip objects without fingerprint property
+        }
+        
+        Napi::Value fp_value = obj.Get("fingerprint");
+        if (!fp_value.IsString()) {
+            continue; // Skip if fingerprint is not a string
+        }
+        
+        std::string template_id = TemplateIdFor(obj, i);
+        
+        // Decode Base64 fingerprint
+        try {
+            auto decoded = base64_decode(fp_value.As<Napi::String>().Utf8Value());
+            if (decoded.empty()) {
+                continue; // Skip empty decoded data
             }
+            
+            // Load template into matcher
+            if (matcher.loadTemplate(template_id, decoded.data(), decoded.size())) {
+                if (index_by_id != nullptr) {
+                    (*index_by_id)[template_id] = i;
+                }
+                loaded_count++;
+            }
+        } catch (...) {
+            // Skip this fingerprint if decoding fails
+            continue;
+        }
+    }
+    
+    return loaded_count;
+}
+
+/**
+ * @brief Fill the JS result object shared by every match entry point
+ */
+static void SetMatchFields(Napi::Object& result, const openafis::MatchResult& match_result,
+                           const openafis::FingerprintMatcher& matcher, uint32_t loaded_count) {
+    result.Set("success", true);
+    result.Set("isMatch", match_result.is_match);
+    result.Set("bestMatch", match_result.matched_template_id.str());
+    result.Set("similarityScore", static_cast<int>(match_result.similarity_score));
+    result.Set("similarityPercentage", (static_cast<float>(match_result.similarity_score) / 255.0f) * 100.0f);
+    result.Set("matchingTimeMs", static_cast<int>(match_result.match_time.count()));
+    result.Set("threshold", static_cast<int>(matcher.getSimilarityThreshold()));
+    result.Set("loadedTemplates", loaded_count);
+    result.Set("memoryUsage", static_cast<int>(matcher.getMemoryUsage()));
+    result.Set("concurrency", static_cast<int>(matcher.getConcurrency()));
+    result.Set("candidatesScanned", static_cast<double>(match_result.candidates_scanned));
+    result.Set("cached", match_result.from_cache);
+}
+
+/**
+ * @brief Attach the JS object a gallery template was loaded from as result.matchedObject
+ */
+static void SetMatchedObject(Napi::Object& result, AddonData& data, const openafis::TemplateId& template_id) {
+    if (data.users.IsEmpty()) {
+        return;
+    }
+    auto it = data.index_by_id.find(template_id.str());
+    if (it != data.index_by_id.end()) {
+        Napi::Value item = data.users.Value().As<Napi::Array>()[it->second];
+        if (item.IsObject()) {
+            result.Set("matchedObject", item);
         }
     }
+}
+
+/**
+ * @brief Build the JS result for a match against the persistent gallery
+ */
+static Napi::Object GalleryResult(Napi::Env env, AddonData& data, const openafis::MatchResult& match_result) {
+    // Shared galleries change under other environments and worker-thread refreshes
+    if (!data.shared_gallery.empty()) {
+        data.loaded_count = static_cast<uint32_t>(data.gallery->matcher->getEnrolledCount());
+    }
+    Napi::Object result = Napi::Object::New(env);
+    SetMatchFields(result, match_result, *data.gallery->matcher, data.loaded_count);
+    
+    // Find the original object for the best match
+    if (match_result.is_match) {
+        SetMatchedObject(result, data, match_result.matched_template_id);
+    }
+    
+    return result;
+}
+
+using TraceClock = openafis::TraceRecorder::Clock;
+
+static std::chrono::microseconds MicrosecondsBetween(TraceClock::time_point start, TraceClock::time_point end) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+}
+
+/**
+ * @brief Start tracing one match: allocate its ID and attribute this thread's spans to it
+ * @return Match ID, or 0 when tracing is disabled
+ */
+static uint64_t BeginTrace(const AddonData& data) {
+    const uint64_t match_id = data.tracing ? openafis::TraceRecorder::nextMatchId() : 0;
+    openafis::TraceRecorder::setCurrentMatchId(match_id);
+    return match_id;
+}
+
+/**
+ * @brief Attach the per-phase breakdown of a match as result.trace
+ */
+static void SetTraceFields(Napi::Env env, Napi::Object& result, const openafis::MatchPhases& phases, uint64_t match_id) {
+    auto ms = [](std::chrono::microseconds us) { return static_cast<double>(us.count()) / 1000.0; };
+    Napi::Object trace = Napi::Object::New(env);
+    trace.Set("matchId", static_cast<double>(match_id));
+    trace.Set("decodeMs", ms(phases.decode));
+    trace.Set("parseMs", ms(phases.parse));
+    trace.Set("enrollMs", ms(phases.enroll));
+    trace.Set("scanMs", ms(phases.scan));
+    trace.Set("marshalMs", ms(phases.marshal));
+    trace.Set("threadsUsed", phases.threads_used);
+    result.Set("trace", trace);
+}
+
+/**
+ * @brief Finish a traced result: time the marshalling and attach the phase breakdown
+ * @param build Produces the JS result object (this is the marshal phase)
+ */
+template <class Build>
+static Napi::Object TracedResult(Napi::Env env, const AddonData& data, openafis::MatchPhases phases,
+                                 uint64_t match_id, Build build) {
+    if (!data.tracing) {
+        return build();
+    }
     
-    return decoded;
+    const TraceClock::time_point start = TraceClock::now();
+    Napi::Object result = build();
+    const TraceClock::time_point end = TraceClock::now();
+    openafis::TraceRecorder::instance().record("marshal", start, end, match_id);
+    phases.marshal = MicrosecondsBetween(start, end);
+    SetTraceFields(env, result, phases, match_id);
+    return result;
+}
+
+/**
+ * @brief Build the JS result returned when no gallery has been loaded
+ */
+static Napi::Object NoGalleryResult(Napi::Env env) {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("success", false);
+    result.Set("error", "No gallery loaded; call loadGallery() first");
+    result.Set("loadedTemplates", 0);
+    return result;
+}
+
+/**
+ * @brief Bring a shared gallery replica up to date before a scan
+ *
+ * Replays what the writer published since the last refresh. New records are parsed
+ * under the exclusive lock, so the async paths call this on their worker thread;
+ * only the synchronous matchFingerprint refreshes on the JS thread.
+ */
+static void RefreshSharedGallery(GalleryState& gallery) {
+    if (!gallery.matcher->sharedGalleryChanged()) {
+        return;
+    }
+    std::unique_lock<std::shared_mutex> lock(gallery.mutex);
+    // Another worker thread sharing this replica may have refreshed it meanwhile
+    if (gallery.matcher->sharedGalleryChanged()) {
+        gallery.matcher->refreshSharedGallery();
+    }
+}
+
+/**
+ * @brief Whether there is nothing to match against (JS thread, lock-free)
+ *
+ * Every environment sharing a gallery picks up its current template count; a replica
+ * whose writer published changes is not empty until a scan has refreshed it.
+ */
+static bool GalleryEmpty(AddonData& data) {
+    if (!data.shared_gallery.empty()) {
+        data.loaded_count = static_cast<uint32_t>(data.gallery->matcher->getEnrolledCount());
+    }
+    return data.loaded_count == 0 && !data.gallery->matcher->sharedGalleryChanged();
+}
+
+/**
+ * @brief Throw if the gallery is a read-only shared gallery replica
+ * @return true if an exception is pending
+ */
+static bool RejectOnReplica(Napi::Env env, const AddonData& data) {
+    if (!data.gallery->matcher->isSharedGalleryReplica()) {
+        return false;
+    }
+    Napi::Error::New(env, "The gallery is a read-only replica of shared gallery " + data.shared_gallery +
+                     "; enroll through its publisher or call detachSharedGallery() first")
+        .ThrowAsJavaScriptException();
+    return true;
 }
 
 /**
@@ -45,14 +327,15 @@ std::vector<uint8_t> decode_base64(const std::string& encoded_string) {
  * @param info - Node.js function arguments:
  *   - arg[0]: string - Base64 encoded fingerprint to compare
  *   - arg[1]: array - Array of objects with 'fingerprint' property containing Base64 ISO templates
+ *     (optional: when omitted the probe is matched against the gallery from loadGallery())
  * @return object - Match result with success, bestMatch, score, etc.
  */
 Napi::Object MatchFingerprint(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     
     // Validate arguments
-    if (info.Length() != 2) {
-        Napi::TypeError::New(env, "Expected exactly 2 arguments: (fingerprintToCompare, fingerprintDatabase)")
+    if (info.Length() != 1 && info.Length() != 2) {
+        Napi::TypeError::New(env, "Expected 1 or 2 arguments: (fingerprintToCompare[, fingerprintDatabase])")
             .ThrowAsJavaScriptException();
         return Napi::Object::New(env);
     }
@@ -63,14 +346,42 @@ Napi::Object MatchFingerprint(const Napi::CallbackInfo& info) {
         return Napi::Object::New(env);
     }
     
-    if (!info[1].IsArray()) {
+    if (info.Length() == 2 && !info[1].IsArray()) {
         Napi::TypeError::New(env, "Second argument must be an array of fingerprint objects")
             .ThrowAsJavaScriptException();
         return Napi::Object::New(env);
     }
     
+    if (info.Length() == 1) {
+        AddonData* data = env.GetInstanceData<AddonData>();
+        // The synchronous path scans on the JS thread, so it refreshes a replica there too
+        RefreshSharedGallery(*data->gallery);
+        std::shared_lock<std::shared_mutex> lock(data->gallery->mutex);
+        if (GalleryEmpty(*data)) {
+            return NoGalleryResult(env);
+        }
+        const uint64_t match_id = BeginTrace(*data);
+        
+        const TraceClock::time_point decode_start = TraceClock::now();
+        ReadUtf8(env, info[0], data->probe_text);
+        base64_decode(data->probe_text.data(), data->probe_text.size(), data->probe_bytes);
+        const TraceClock::time_point decode_end = TraceClock::now();
+        openafis::TraceRecorder::instance().record("decode", decode_start, decode_end, match_id);
+        
+        openafis::MatchResult match_result = data->gallery->matcher->match1toN(data->probe_bytes.data(), data->probe_bytes.size());
+        openafis::TraceRecorder::setCurrentMatchId(0);
+        match_result.phases.decode = MicrosecondsBetween(decode_start, decode_end);
+        return TracedResult(env, *data, match_result.phases, match_id,
+                            [&] { return GalleryResult(env, *data, match_result); });
+    }
+    
+    AddonData* data = env.GetInstanceData<AddonData>();
+    const uint64_t match_id = BeginTrace(*data);
+    openafis::MatchPhases phases;
+    
     // Extract arguments
     std::string probe_fingerprint_b64 = info[0].As<Napi::String>().Utf8Value();
+    
     Napi::Array database_array = info[1].As<Napi::Array>();
     
     // Create result object
@@ -81,62 +392,11 @@ Napi::Object MatchFingerprint(const Napi::CallbackInfo& info) {
         auto matcher = std::make_unique<openafis::FingerprintMatcher>(40);
         
         // Load database fingerprints
-        std::vector<std::string> template_ids;
-        uint32_t loaded_count = 0;
-        
-        for (uint32_t i = 0; i < database_array.Length(); i++) {
-            Napi::Value item = database_array[i];
-            
-            if (!item.IsObject()) {
-                continue; // Skip non-object items
-            }
-            
-            Napi::Object obj = item.As<Napi::Object>();
-            
-            // Check if object has 'fingerprint' property
-            if (!obj.Has("fingerprint")) {
-                continue; // Skip objects without fingerprint property
-            }
-            
-            Napi::Value fp_value = obj.Get("fingerprint");
-            if (!fp_value.IsString()) {
-                continue; // Skip if fingerprint is not a string
-            }
-            
-            std::string fingerprint_b64 = fp_value.As<Napi::String>().Utf8Value();
-            
-            // Generate template ID (use index or id if available)
-            std::string template_id;
-            if (obj.Has("id")) {
-                Napi::Value id_value = obj.Get("id");
-                if (id_value.IsString()) {
-                    template_id = id_value.As<Napi::String>().Utf8Value();
-                } else if (id_value.IsNumber()) {
-                    template_id = "id_" + std::to_string(id_value.As<Napi::Number>().Int32Value());
-                } else {
-                    template_id = "template_" + std::to_string(i);
-                }
-            } else {
-                template_id = "template_" + std::to_string(i);
-            }
-            
-            // Decode Base64 fingerprint
-            try {
-                auto decoded = decode_base64(fingerprint_b64);
-                if (decoded.empty()) {
-                    continue; // Skip empty decoded data
-                }
-                
-                // Load template into matcher
-                if (matcher->loadTemplate(template_id, decoded.data(), decoded.size())) {
-                    template_ids.push_back(template_id);
-                    loaded_count++;
-                }
-            } catch (...) {
-                // Skip this fingerprint if decoding fails
-                continue;
-            }
-        }
+        const TraceClock::time_point enroll_start = TraceClock::now();
+        uint32_t loaded_count = LoadDatabase(*matcher, database_array, nullptr);
+        const TraceClock::time_point enroll_end = TraceClock::now();
+        openafis::TraceRecorder::instance().record("enroll", enroll_start, enroll_end, match_id);
+        phases.enroll = MicrosecondsBetween(enroll_start, enroll_end);
         
         // Check if any templates were loaded
         if (loaded_count == 0) {
@@ -147,7 +407,11 @@ Napi::Object MatchFingerprint(const Napi::CallbackInfo& info) {
         }
         
         // Decode probe fingerprint
-        auto probe_decoded = decode_base64(probe_fingerprint_b64);
+        const TraceClock::time_point decode_start = TraceClock::now();
+        auto probe_decoded = base64_decode(probe_fingerprint_b64);
+        const TraceClock::time_point decode_end = TraceClock::now();
+        openafis::TraceRecorder::instance().record("decode", decode_start, decode_end, match_id);
+        phases.decode = MicrosecondsBetween(decode_start, decode_end);
         if (probe_decoded.empty()) {
             result.Set("success", false);
             result.Set("error", "Failed to decode probe fingerprint");
@@ -155,35 +419,12 @@ Napi::Object MatchFingerprint(const Napi::CallbackInfo& info) {
             return result;
         }
         
-        // Create temporary file for probe fingerprint
-        std::string temp_file = "/tmp/probe_fingerprint_" + std::to_string(time(nullptr)) + ".iso";
-        std::ofstream file(temp_file, std::ios::binary);
-        if (!file) {
-            result.Set("success", false);
-            result.Set("error", "Failed to create temporary file");
-            result.Set("loadedTemplates", loaded_count);
-            return result;
-        }
-        file.write(reinterpret_cast<const char*>(probe_decoded.data()), probe_decoded.size());
-        file.close();
-        
         // Perform matching
-        auto match_result = matcher->match1toNFromFile(temp_file);
-        
-        // Clean up temporary file
-        std::remove(temp_file.c_str());
+        auto match_result = matcher->match1toN(probe_decoded.data(), probe_decoded.size());
         
         // Prepare result
-        result.Set("success", true);
-        result.Set("isMatch", match_result.is_match);
-        result.Set("bestMatch", match_result.matched_template_id);
-        result.Set("similarityScore", static_cast<int>(match_result.similarity_score));
-        result.Set("similarityPercentage", (static_cast<float>(match_result.similarity_score) / 255.0f) * 100.0f);
-        result.Set("matchingTimeMs", static_cast<int>(match_result.match_time.count()));
-        result.Set("threshold", static_cast<int>(matcher->getSimilarityThreshold()));
-        result.Set("loadedTemplates", loaded_count);
-        result.Set("memoryUsage", static_cast<int>(matcher->getMemoryUsage()));
-        result.Set("concurrency", static_cast<int>(matcher->getConcurrency()));
+        const TraceClock::time_point marshal_start = TraceClock::now();
+        SetMatchFields(result, match_result, *matcher, loaded_count);
         
         // Find the original object for the best match
         if (match_result.is_match && !match_result.matched_template_id.empty()) {
@@ -191,22 +432,7 @@ Napi::Object MatchFingerprint(const Napi::CallbackInfo& info) {
                 Napi::Value item = database_array[i];
                 if (item.IsObject()) {
                     Napi::Object obj = item.As<Napi::Object>();
-                    
-                    std::string check_id;
-                    if (obj.Has("id")) {
-                        Napi::Value id_value = obj.Get("id");
-                        if (id_value.IsString()) {
-                            check_id = id_value.As<Napi::String>().Utf8Value();
-                        } else if (id_value.IsNumber()) {
-                            check_id = "id_" + std::to_string(id_value.As<Napi::Number>().Int32Value());
-                        } else {
-                            check_id = "template_" + std::to_string(i);
-                        }
-                    } else {
-                        check_id = "template_" + std::to_string(i);
-                    }
-                    
-                    if (check_id == match_result.matched_template_id) {
+                    if (match_result.matched_template_id == TemplateIdFor(obj, i)) {
                         result.Set("matchedObject", obj);
                         break;
                     }
@@ -214,6 +440,16 @@ Napi::Object MatchFingerprint(const Napi::CallbackInfo& info) {
             }
         }
         
+        if (data->tracing) {
+            const TraceClock::time_point marshal_end = TraceClock::now();
+            openafis::TraceRecorder::instance().record("marshal", marshal_start, marshal_end, match_id);
+            phases.parse = match_result.phases.parse;
+            phases.scan = match_result.phases.scan;
+            phases.threads_used = match_result.phases.threads_used;
+            phases.marshal = MicrosecondsBetween(marshal_start, marshal_end);
+            SetTraceFields(env, result, phases, match_id);
+        }
+        
     } catch (const std::exception& e) {
         result.Set("success", false);
         result.Set("error", std::string("Exception: ") + e.what());
@@ -222,45 +458,1881 @@ Napi::Object MatchFingerprint(const Napi::CallbackInfo& info) {
         result.Set("error", "Unknown error occurred during fingerprint matching");
     }
     
+    openafis::TraceRecorder::setCurrentMatchId(0);
     return result;
 }
 
 /**
- * @brief Set the similarity threshold for matching
+ * @brief Load (or replace) the persistent gallery used by the async and batched entry points
  * @param info - Node.js function arguments:
- *   - arg[0]: number - Threshold value (0-255)
- * @return boolean - Success status
+ *   - arg[0]: array - Array of objects with 'fingerprint' property containing Base64 ISO templates
+ * @return object - { success, loadedTemplates, memoryUsage }
  */
-Napi::Boolean SetThreshold(const Napi::CallbackInfo& info) {
+Napi::Value LoadGallery(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     
-    if (info.Length() != 1 || !info[0].IsNumber()) {
-        Napi::TypeError::New(env, "Expected one number argument (threshold 0-255)")
+    if (info.Length() != 1 || !info[0].IsArray()) {
+        Napi::TypeError::New(env, "Expected one argument: an array of fingerprint objects")
             .ThrowAsJavaScriptException();
-        return Napi::Boolean::New(env, false);
+        return env.Undefined();
     }
     
-    int threshold = info[0].As<Napi::Number>().Int32Value();
+    AddonData* data = env.GetInstanceData<AddonData>();
+    if (RejectOnReplica(env, *data)) {
+        return env.Undefined();
+    }
+    Napi::Array database_array = info[0].As<Napi::Array>();
     
-    if (threshold < 0 || threshold > 255) {
-        Napi::TypeError::New(env, "Threshold must be between 0 and 255")
+    // Waits for in-flight scans to drain before the gallery is replaced
+    std::unique_lock<std::shared_mutex> lock(data->gallery->mutex);
+    
+    data->gallery->matcher->clearTemplates();
+    data->index_by_id.clear();
+    data->loaded_count = LoadDatabase(*data->gallery->matcher, database_array, &data->index_by_id);
+    // No-op unless a gallery store is attached: make the bulk load durable before returning
+    data->gallery->matcher->syncJournal();
+    data->users = Napi::Persistent(database_array.As<Napi::Object>());
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("success", data->loaded_count > 0);
+    result.Set("loadedTemplates", data->loaded_count);
+    result.Set("memoryUsage", static_cast<int>(data->gallery->matcher->getMemoryUsage()));
+    return result;
+}
+
+/**
+ * @brief Attach a durable store (snapshot + enrollment journal) to the persistent gallery
+ * @param info - Node.js function arguments:
+ *   - arg[0]: string - Store directory
+ *   - arg[1]: object (optional) - { compactionBytes?, compactionIntervalMs?, groupCommitWindowMs? }
+ * @return object - { success, loadedTemplates, memoryUsage }
+ */
+Napi::Value OpenGalleryStore(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString() || (info.Length() > 1 && !info[1].IsObject())) {
+        Napi::TypeError::New(env, "Expected (directory[, { compactionBytes, compactionIntervalMs, groupCommitWindowMs }])")
             .ThrowAsJavaScriptException();
-        return Napi::Boolean::New(env, false);
+        return env.Undefined();
     }
     
-    // Note: This is a simple implementation. In a real application,
-    // you might want to maintain a global matcher instance.
-    return Napi::Boolean::New(env, true);
+    openafis::JournalOptions options;
+    if (info.Length() > 1) {
+        Napi::Object settings = info[1].As<Napi::Object>();
+        if (settings.Has("compactionBytes")) {
+            options.compaction_bytes = static_cast<size_t>(settings.Get("compactionBytes").As<Napi::Number>().Int64Value());
+        }
+        if (settings.Has("compactionIntervalMs")) {
+            options.compaction_interval = std::chrono::milliseconds(
+                settings.Get("compactionIntervalMs").As<Napi::Number>().Int64Value());
+        }
+        if (settings.Has("groupCommitWindowMs")) {
+            options.group_commit_window = std::chrono::microseconds(static_cast<int64_t>(
+                settings.Get("groupCommitWindowMs").As<Napi::Number>().DoubleValue() * 1000.0));
+        }
+    }
+    
+    AddonData* data = env.GetInstanceData<AddonData>();
+    if (RejectOnReplica(env, *data)) {
+        return env.Undefined();
+    }
+    std::unique_lock<std::shared_mutex> lock(data->gallery->mutex);
+    
+    // Recovery replaces the gallery, so templates loaded without a store would be lost
+    if (data->gallery->matcher->hasUnstoredTemplates()) {
+        Napi::Object result = Napi::Object::New(env);
+        result.Set("success", false);
+        result.Set("loadedTemplates", data->loaded_count);
+        result.Set("memoryUsage", static_cast<int>(data->gallery->matcher->getMemoryUsage()));
+        result.Set("error", "The gallery holds templates loaded without a store; clear it with loadGallery([]) "
+                            "before opening one, then enroll them again");
+        return result;
+    }
+    
+    bool opened = data->gallery->matcher->openJournal(info[0].As<Napi::String>().Utf8Value(), options);
+    
+    // Stored templates have no JS objects behind them; results carry their IDs only
+    data->index_by_id.clear();
+    data->users.Reset();
+    data->loaded_count = static_cast<uint32_t>(data->gallery->matcher->getEnrolledCount());
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("success", opened);
+    result.Set("loadedTemplates", data->loaded_count);
+    result.Set("memoryUsage", static_cast<int>(data->gallery->matcher->getMemoryUsage()));
+    if (!opened) {
+        result.Set("error", "Failed to recover gallery store (see stderr for details)");
+    }
+    return result;
 }
 
 /**
- * @brief Initialize the Node.js addon
+ * @brief Async worker enrolling or removing one template, resolving once the change is durable
  */
-Napi::Object Init(Napi::Env env, Napi::Object exports) {
+class EnrollWorker : public Napi::AsyncWorker {
+public:
+    EnrollWorker(Napi::Env env, AddonData* data, std::string template_id, std::vector<uint8_t> record, bool remove)
+        : Napi::AsyncWorker(env), data_(data), gallery_(data->gallery), template_id_(std::move(template_id)),
+          record_(std::move(record)),
+          remove_(remove), ok_(false), durable_(false), journal_failed_(false), count_(0),
+          deferred_(Napi::Promise::Deferred::New(env)) {}
+    
+    Napi::Promise GetPromise() { return deferred_.Promise(); }
+    
+    void Execute() override {
+        {
+            std::unique_lock<std::shared_mutex> lock(gallery_->mutex);
+            ok_ = remove_ ? gallery_->matcher->removeTemplate(template_id_)
+                          : gallery_->matcher->loadTemplate(template_id_, record_.data(), record_.size());
+            count_ = static_cast<uint32_t>(gallery_->matcher->getEnrolledCount());
+        }
+        // Wait for the group commit outside the gallery lock so scans keep running
+        durable_ = ok_ && gallery_->matcher->syncJournal();
+        journal_failed_ = ok_ && !durable_ && gallery_->matcher->journalFailed();
+    }
+    
+    void OnOK() override {
+        data_->loaded_count = count_;
+        
+        Napi::Object result = Napi::Object::New(Env());
+        result.Set("success", ok_);
+        result.Set("durable", durable_);
+        result.Set("loadedTemplates", count_);
+        if (!ok_) {
+            result.Set("error", remove_ ? "Template not found" : "Template could not be loaded (duplicate ID or invalid data)");
+        } else if (journal_failed_) {
+            result.Set("error", "The change applied in memory but the gallery store failed to journal it "
+                                "(see stderr); reopen the store");
+        }
+        deferred_.Resolve(result);
+    }
+    
+    void OnError(const Napi::Error& e) override {
+        deferred_.Reject(e.Value());
+    }
+
+private:
+    AddonData* data_;
+    std::shared_ptr<GalleryState> gallery_;   // The gallery at queue time, even if the environment switches
+    std::string template_id_;
+    std::vector<uint8_t> record_;
+    bool remove_;
+    bool ok_;
+    bool durable_;
+    bool journal_failed_;
+    uint32_t count_;
+    Napi::Promise::Deferred deferred_;
+};
+
+/**
+ * @brief Enroll one fingerprint into the persistent gallery
+ * @param info - Node.js function arguments:
+ *   - arg[0]: string - Template ID
+ *   - arg[1]: string - Base64 encoded ISO template
+ * @return Promise<object> - { success, durable, loadedTemplates }; durable once journaled to disk
+ */
+Napi::Value EnrollFingerprint(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() != 2 || !info[0].IsString() || !info[1].IsString()) {
+        Napi::TypeError::New(env, "Expected (templateId: string, fingerprint: string)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    AddonData* data = env.GetInstanceData<AddonData>();
+    if (RejectOnReplica(env, *data)) {
+        return env.Undefined();
+    }
+    
+    auto* worker = new EnrollWorker(env, data, info[0].As<Napi::String>().Utf8Value(),
+                                    base64_decode(info[1].As<Napi::String>().Utf8Value()), false);
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue();
+    return promise;
+}
+
+/**
+ * @brief Remove (revoke) one template from the persistent gallery
+ * @param info - Node.js function arguments:
+ *   - arg[0]: string - Template ID
+ * @return Promise<object> - { success, durable, loadedTemplates }
+ */
+Napi::Value RemoveFingerprint(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() != 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "Expected (templateId: string)").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    AddonData* data = env.GetInstanceData<AddonData>();
+    if (RejectOnReplica(env, *data)) {
+        return env.Undefined();
+    }
+    
+    auto* worker = new EnrollWorker(env, data, info[0].As<Napi::String>().Utf8Value(), std::vector<uint8_t>(), true);
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue();
+    return promise;
+}
+
+/**
+ * @brief Async worker running one 1:N scan against the persistent gallery
+ */
+class MatchWorker : public Napi::AsyncWorker {
+public:
+    MatchWorker(Napi::Env env, AddonData* data, std::vector<uint8_t> probe, uint64_t match_id,
+                std::chrono::microseconds decode_time)
+        : Napi::AsyncWorker(env), data_(data), gallery_(data->gallery), probe_(std::move(probe)), match_id_(match_id),
+          decode_time_(decode_time), deferred_(Napi::Promise::Deferred::New(env)) {}
+    
+    Napi::Promise GetPromise() { return deferred_.Promise(); }
+    
+    void Execute() override {
+        openafis::TraceRecorder::setCurrentMatchId(match_id_);
+        RefreshSharedGallery(*gallery_);
+        {
+            std::shared_lock<std::shared_mutex> lock(gallery_->mutex);
+            result_ = gallery_->matcher->match1toN(probe_.data(), probe_.size());
+        }
+        openafis::TraceRecorder::setCurrentMatchId(0);
+    }
+    
+    void OnOK() override {
+        result_.phases.decode = decode_time_;
+        deferred_.Resolve(TracedResult(Env(), *data_, result_.phases, match_id_,
+                                       [this] { return GalleryResult(Env(), *data_, result_); }));
+    }
+    
+    void OnError(const Napi::Error& e) override {
+        deferred_.Reject(e.Value());
+    }
+
+private:
+    AddonData* data_;
+    std::shared_ptr<GalleryState> gallery_;
+    std::vector<uint8_t> probe_;
+    uint64_t match_id_;
+    std::chrono::microseconds decode_time_;
+    openafis::MatchResult result_;
+    Napi::Promise::Deferred deferred_;
+};
+
+/**
+ * @brief Match a fingerprint against the persistent gallery on the libuv thread pool
+ * @param info - Node.js function arguments:
+ *   - arg[0]: string - Base64 encoded fingerprint to compare
+ * @return Promise<object> - Match result (same shape as matchFingerprint)
+ */
+Napi::Value MatchFingerprintAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() != 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "Expected one argument: a string (Base64 fingerprint)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    AddonData* data = env.GetInstanceData<AddonData>();
+    if (GalleryEmpty(*data)) {
+        auto deferred = Napi::Promise::Deferred::New(env);
+        deferred.Resolve(NoGalleryResult(env));
+        return deferred.Promise();
+    }
+    
+    // Decoding reads the JS string, so it happens here on the main thread
+    const uint64_t match_id = data->tracing ? openafis::TraceRecorder::nextMatchId() : 0;
+    const TraceClock::time_point decode_start = TraceClock::now();
+    std::vector<uint8_t> probe = base64_decode(info[0].As<Napi::String>().Utf8Value());
+    const TraceClock::time_point decode_end = TraceClock::now();
+    openafis::TraceRecorder::instance().record("decode", decode_start, decode_end, match_id);
+    
+    auto* worker = new MatchWorker(env, data, std::move(probe), match_id, MicrosecondsBetween(decode_start, decode_end));
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue();
+    return promise;
+}
+
+/**
+ * @brief A coalesced result waiting to be delivered on the JS thread
+ */
+struct BatchedCompletion {
+    Napi::Promise::Deferred* deferred;
+    openafis::MatchResult result;
+    size_t batch_size;
+    uint64_t match_id;
+    std::chrono::microseconds decode_time;
+};
+
+/**
+ * @brief Create the coalescer and its completion channel on first use
+ */
+static void EnsureCoalescer(Napi::Env env, AddonData* data) {
+    if (data->coalescer) {
+        return;
+    }
+    
+    data->completions = Napi::ThreadSafeFunction::New(
+        env, Napi::Function::New(env, [](const Napi::CallbackInfo&) {}), "openafis_coalescer", 0, 1);
+    data->completions.Unref(env);
+    
+    data->coalescer = std::make_unique<openafis::ProbeCoalescer>(
+        [data](const std::vector<std::vector<uint8_t>>& probes) {
+            // Runs on the coalescer thread while the JS thread may switch galleries
+            std::shared_ptr<GalleryState> gallery = std::atomic_load(&data->gallery);
+            RefreshSharedGallery(*gallery);
+            std::shared_lock<std::shared_mutex> lock(gallery->mutex);
+            return gallery->matcher->match1toNBatch(probes);
+        },
+        data->coalescer_options);
+}
+
+/**
+ * @brief Match a fingerprint against the persistent gallery through the coalescing layer
+ *
+ * Probes arriving together are scanned in one blocked multi-probe pass (see configureCoalescing).
+ * @param info - Node.js function arguments:
+ *   - arg[0]: string - Base64 encoded fingerprint to compare
+ * @return Promise<object> - Match result plus the size of the batch it was served in
+ */
+Napi::Value MatchFingerprintBatched(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() != 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "Expected one argument: a string (Base64 fingerprint)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    AddonData* data = env.GetInstanceData<AddonData>();
+    auto* deferred = new Napi::Promise::Deferred(Napi::Promise::Deferred::New(env));
+    Napi::Promise promise = deferred->Promise();
+    
+    if (GalleryEmpty(*data)) {
+        deferred->Resolve(NoGalleryResult(env));
+        delete deferred;
+        return promise;
+    }
+    
+    EnsureCoalescer(env, data);
+    
+    // Keep the process alive while coalesced probes are outstanding
+    if (data->pending_batched++ == 0) {
+        data->completions.Ref(env);
+    }
+    
+    // The scan spans of a coalesced probe belong to its batch; decode and marshal are per call
+    const uint64_t match_id = data->tracing ? openafis::TraceRecorder::nextMatchId() : 0;
+    const TraceClock::time_point decode_start = TraceClock::now();
+    std::vector<uint8_t> probe = base64_decode(info[0].As<Napi::String>().Utf8Value());
+    const TraceClock::time_point decode_end = TraceClock::now();
+    openafis::TraceRecorder::instance().record("decode", decode_start, decode_end, match_id);
+    const std::chrono::microseconds decode_time = MicrosecondsBetween(decode_start, decode_end);
+    
+    data->coalescer->submit(
+        std::move(probe),
+        [data, deferred, match_id, decode_time](const openafis::MatchResult& result, size_t batch_size) {
+            auto* done = new BatchedCompletion{deferred, result, batch_size, match_id, decode_time};
+            data->completions.NonBlockingCall(done, [data](Napi::Env env, Napi::Function, BatchedCompletion* done) {
+                if (env != nullptr) {
+                    done->result.phases.decode = done->decode_time;
+                    Napi::Object result = TracedResult(env, *data, done->result.phases, done->match_id,
+                                                       [&] { return GalleryResult(env, *data, done->result); });
+                    result.Set("batchSize", static_cast<uint32_t>(done->batch_size));
+                    done->deferred->Resolve(result);
+                    if (--data->pending_batched == 0) {
+                        data->completions.Unref(env);
+                    }
+                }
+                delete done->deferred;
+                delete done;
+            });
+        });
+    
+    return promise;
+}
+
+/**
+ * @brief A streaming match shared by its scan and its update channel
+ *
+ * Updates reach JS through a thread-safe function in the order they were queued;
+ * the final result is queued after the last improvement, so onProgress has seen
+ * every candidate before the promise resolves.
+ */
+struct StreamContext {
+    AddonData* data;
+    Napi::Promise::Deferred deferred;
+    Napi::ThreadSafeFunction updates;         // Calls onProgress on the JS thread
+    uint64_t match_id;
+    std::chrono::microseconds decode_time;
+    int stop_at_score;                        // Stop the scan once a candidate reaches this score
+    std::atomic<bool> stop_requested{false};  // onProgress returned false
+    
+    StreamContext(Napi::Env env, AddonData* data, uint64_t match_id, std::chrono::microseconds decode_time,
+                  int stop_at_score)
+        : data(data), deferred(Napi::Promise::Deferred::New(env)), match_id(match_id), decode_time(decode_time),
+          stop_at_score(stop_at_score) {}
+};
+
+/**
+ * @brief One improvement of a streaming match, or its final result
+ */
+struct StreamUpdate {
+    std::shared_ptr<StreamContext> context;
+    bool done;
+    openafis::MatchProgress progress;
+    openafis::MatchResult result;
+};
+
+/**
+ * @brief Deliver a streaming update on the JS thread
+ */
+static void DeliverStreamUpdate(Napi::Env env, Napi::Function on_progress, StreamUpdate* update) {
+    StreamContext& context = *update->context;
+    if (env != nullptr && !update->done) {
+        const openafis::MatchProgress& progress = update->progress;
+        Napi::Object event = Napi::Object::New(env);
+        event.Set("bestMatch", progress.matched_template_id.str());
+        event.Set("similarityScore", static_cast<int>(progress.similarity_score));
+        event.Set("isMatch", progress.is_match);
+        event.Set("candidatesScored", static_cast<double>(progress.candidates_scored));
+        event.Set("candidatesTotal", static_cast<double>(progress.candidates_total));
+        event.Set("elapsedMs", static_cast<double>(progress.elapsed.count()) / 1000.0);
+        if (progress.is_match) {
+            SetMatchedObject(event, *context.data, progress.matched_template_id);
+        }
+        Napi::Value keep_going = on_progress.Call({event});
+        if (keep_going.IsBoolean() && !keep_going.As<Napi::Boolean>().Value()) {
+            context.stop_requested.store(true, std::memory_order_relaxed);
+        }
+    } else if (env != nullptr) {
+        AddonData& data = *context.data;
+        update->result.phases.decode = context.decode_time;
+        Napi::Object result = TracedResult(env, data, update->result.phases, context.match_id,
+                                           [&] { return GalleryResult(env, data, update->result); });
+        result.Set("stoppedEarly", update->result.stopped_early);
+        context.deferred.Resolve(result);
+    }
+    if (update->done) {
+        context.updates.Release();
+    }
+    delete update;
+}
+
+/**
+ * @brief Async worker running one streaming 1:N scan against the persistent gallery
+ */
+class StreamWorker : public Napi::AsyncWorker {
+public:
+    StreamWorker(Napi::Env env, std::shared_ptr<StreamContext> context, std::vector<uint8_t> probe)
+        : Napi::AsyncWorker(env), context_(std::move(context)), gallery_(context_->data->gallery),
+          probe_(std::move(probe)) {}
+    
+    void Execute() override {
+        openafis::TraceRecorder::setCurrentMatchId(context_->match_id);
+        RefreshSharedGallery(*gallery_);
+        {
+            std::shared_lock<std::shared_mutex> lock(gallery_->mutex);
+            // Called on scan worker threads, one at a time; stop_requested also stops the scan between blocks
+            result_ = gallery_->matcher->match1toNStream(
+                probe_.data(), probe_.size(), [this](const openafis::MatchProgress& progress) {
+                    auto* update = new StreamUpdate{context_, false, progress, {}};
+                    // A closing channel drops the update; the final result still settles the promise
+                    if (context_->updates.NonBlockingCall(update, DeliverStreamUpdate) != napi_ok) {
+                        delete update;
+                    }
+                    return progress.similarity_score < context_->stop_at_score;
+                }, &context_->stop_requested);
+        }
+        openafis::TraceRecorder::setCurrentMatchId(0);
+    }
+    
+    void OnOK() override {
+        // Queued behind every improvement of this scan
+        auto* update = new StreamUpdate{context_, true, {}, result_};
+        if (context_->updates.NonBlockingCall(update, DeliverStreamUpdate) != napi_ok) {
+            // Already on the JS thread: settle the promise here rather than leave it pending
+            DeliverStreamUpdate(Env(), Napi::Function(), update);
+        }
+    }
+    
+    void OnError(const Napi::Error& e) override {
+        context_->deferred.Reject(e.Value());
+        context_->updates.Release();
+    }
+
+private:
+    std::shared_ptr<StreamContext> context_;
+    std::shared_ptr<GalleryState> gallery_;
+    std::vector<uint8_t> probe_;
+    openafis::MatchResult result_;
+};
+
+/**
+ * @brief Match a fingerprint against the persistent gallery, reporting the best candidate as it improves
+ *
+ * Scan workers report every candidate that beats the best so far; onProgress runs
+ * on the JS thread with { bestMatch, similarityScore, isMatch, candidatesScored,
+ * candidatesTotal, elapsedMs, matchedObject? }. Returning false from onProgress
+ * stops the scan before its next block of candidates; stopAtScore stops it as soon
+ * as a candidate reaches that score.
+ * @param info - Node.js function arguments:
+ *   - arg[0]: string - Base64 encoded fingerprint to compare
+ *   - arg[1]: function - onProgress(update)
+ *   - arg[2]: object (optional) - { stopAtScore?: number }
+ * @return Promise<object> - Final match result (same shape as matchFingerprintAsync) plus stoppedEarly
+ */
+Napi::Value MatchFingerprintStream(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsString() || !info[1].IsFunction() ||
+        (info.Length() > 2 && !info[2].IsObject())) {
+        Napi::TypeError::New(env, "Expected (probe: string, onProgress: function, options?: { stopAtScore })")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    int stop_at_score = 256;
+    if (info.Length() > 2) {
+        Napi::Object options = info[2].As<Napi::Object>();
+        if (options.Has("stopAtScore")) {
+            stop_at_score = options.Get("stopAtScore").As<Napi::Number>().Int32Value();
+            if (stop_at_score < 0 || stop_at_score > 255) {
+                Napi::TypeError::New(env, "stopAtScore must be 0-255").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+        }
+    }
+    
+    AddonData* data = env.GetInstanceData<AddonData>();
+    if (GalleryEmpty(*data)) {
+        auto deferred = Napi::Promise::Deferred::New(env);
+        deferred.Resolve(NoGalleryResult(env));
+        return deferred.Promise();
+    }
+    
+    const uint64_t match_id = data->tracing ? openafis::TraceRecorder::nextMatchId() : 0;
+    const TraceClock::time_point decode_start = TraceClock::now();
+    std::vector<uint8_t> probe = base64_decode(info[0].As<Napi::String>().Utf8Value());
+    const TraceClock::time_point decode_end = TraceClock::now();
+    openafis::TraceRecorder::instance().record("decode", decode_start, decode_end, match_id);
+    
+    auto context = std::make_shared<StreamContext>(env, data, match_id, MicrosecondsBetween(decode_start, decode_end),
+                                                   stop_at_score);
+    context->updates = Napi::ThreadSafeFunction::New(env, info[1].As<Napi::Function>(), "openafis_stream", 0, 1);
+    Napi::Promise promise = context->deferred.Promise();
+    
+    auto* worker = new StreamWorker(env, std::move(context), std::move(probe));
+    worker->Queue();
+    return promise;
+}
+
+/**
+ * @brief Configure the coalescing layer used by matchFingerprintBatched
+ * @param info - Node.js function arguments:
+ *   - arg[0]: object (optional) - { windowMs?: number, maxBatchSize?: number }
+ * @return object - Current settings and coalescing counters
+ */
+Napi::Value ConfigureCoalescing(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    AddonData* data = env.GetInstanceData<AddonData>();
+    
+    if (info.Length() > 0 && !info[0].IsObject()) {
+        Napi::TypeError::New(env, "Expected an options object: { windowMs, maxBatchSize }")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    if (info.Length() > 0) {
+        Napi::Object options = info[0].As<Napi::Object>();
+        
+        if (options.Has("windowMs")) {
+            double window_ms = options.Get("windowMs").As<Napi::Number>().DoubleValue();
+            if (window_ms < 0) {
+                Napi::TypeError::New(env, "windowMs must be non-negative").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            data->coalescer_options.window = std::chrono::microseconds(static_cast<int64_t>(window_ms * 1000.0));
+        }
+        
+        if (options.Has("maxBatchSize")) {
+            int64_t max_batch_size = options.Get("maxBatchSize").As<Napi::Number>().Int64Value();
+            if (max_batch_size < 1) {
+                Napi::TypeError::New(env, "maxBatchSize must be at least 1").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            data->coalescer_options.max_batch_size = static_cast<size_t>(max_batch_size);
+        }
+        
+        if (data->coalescer) {
+            data->coalescer->setOptions(data->coalescer_options);
+        }
+    }
+    
+    openafis::ProbeCoalescer::Stats stats;
+    if (data->coalescer) {
+        stats = data->coalescer->getStats();
+    }
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("windowMs", static_cast<double>(data->coalescer_options.window.count()) / 1000.0);
+    result.Set("maxBatchSize", static_cast<double>(data->coalescer_options.max_batch_size));
+    result.Set("probes", static_cast<double>(stats.probes));
+    result.Set("batches", static_cast<double>(stats.batches));
+    result.Set("largestBatch", static_cast<double>(stats.largest_batch));
+    return result;
+}
+
+/**
+ * @brief Set the similarity threshold for matching
+ * @param info - Node.js function arguments:
+ *   - arg[0]: number - Threshold value (0-255)
+ * @return boolean - Success status
+ */
+Napi::Boolean SetThreshold(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() != 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Expected one number argument (threshold 0-255)")
+            .ThrowAsJavaScriptException();
+        return Napi::Boolean::New(env, false);
+    }
+    
+    int threshold = info[0].As<Napi::Number>().Int32Value();
+    
+    if (threshold < 0 || threshold > 255) {
+        Napi::TypeError::New(env, "Threshold must be between 0 and 255")
+            .ThrowAsJavaScriptException();
+        return Napi::Boolean::New(env, false);
+    }
+    
+    // Applies to the persistent gallery; matchFingerprint(probe, database) keeps its own default
+    AddonData* data = env.GetInstanceData<AddonData>();
+    std::unique_lock<std::shared_mutex> lock(data->gallery->mutex);
+    data->gallery->matcher->setSimilarityThreshold(static_cast<uint8_t>(threshold));
+    return Napi::Boolean::New(env, true);
+}
+
+/**
+ * @brief Configure the probe cache of the persistent gallery
+ * @param info - Node.js function arguments:
+ *   - arg[0]: object (optional) - { capacity?: number, ttlMs?: number } (capacity 0 disables it)
+ * @return object - Current settings and cache counters
+ */
+Napi::Value ConfigureProbeCache(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    AddonData* data = env.GetInstanceData<AddonData>();
+    
+    if (info.Length() > 0 && !info[0].IsObject()) {
+        Napi::TypeError::New(env, "Expected an options object: { capacity, ttlMs }")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    if (info.Length() > 0) {
+        Napi::Object options = info[0].As<Napi::Object>();
+        
+        if (options.Has("capacity")) {
+            int64_t capacity = options.Get("capacity").As<Napi::Number>().Int64Value();
+            if (capacity < 0) {
+                Napi::TypeError::New(env, "capacity must be non-negative").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            data->probe_cache_capacity = static_cast<size_t>(capacity);
+        }
+        
+        if (options.Has("ttlMs")) {
+            int64_t ttl_ms = options.Get("ttlMs").As<Napi::Number>().Int64Value();
+            if (ttl_ms < 0) {
+                Napi::TypeError::New(env, "ttlMs must be non-negative").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            data->probe_cache_ttl = std::chrono::milliseconds(ttl_ms);
+        }
+        
+        data->gallery->matcher->configureProbeCache(data->probe_cache_capacity, data->probe_cache_ttl);
+    }
+    
+    openafis::ProbeCacheStats stats = data->gallery->matcher->getProbeCacheStats();
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("capacity", static_cast<double>(data->probe_cache_capacity));
+    result.Set("ttlMs", static_cast<double>(data->probe_cache_ttl.count()));
+    result.Set("entries", static_cast<double>(stats.entries));
+    result.Set("hits", static_cast<double>(stats.hits));
+    result.Set("resultHits", static_cast<double>(stats.result_hits));
+    result.Set("misses", static_cast<double>(stats.misses));
+    result.Set("galleryVersion", static_cast<double>(data->gallery->matcher->getGalleryVersion()));
+    return result;
+}
+
+/**
+ * @brief Report how this addon was built and which kernel variants were selected at load time
+ * @return object - { isa, detectedIsa, kernels: { base64, packedMinutiae }, lto, pgo }
+ */
+Napi::Object GetBuildInfo(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    Napi::Object kernels = Napi::Object::New(env);
+    kernels.Set("base64", base64_kernel_name());
+    kernels.Set("packedMinutiae", openafis::packedKernelName());
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("isa", openafis::isaLevelName(openafis::selectedIsaLevel()));
+    result.Set("detectedIsa", openafis::isaLevelName(openafis::detectIsaLevel()));
+    result.Set("kernels", kernels);
+#ifdef OPENAFIS_BUILD_LTO
+    result.Set("lto", true);
+#else
+    result.Set("lto", false);
+#endif
+#if defined(OPENAFIS_BUILD_PGO) && OPENAFIS_BUILD_PGO == 1
+    result.Set("pgo", "generate");
+#elif defined(OPENAFIS_BUILD_PGO) && OPENAFIS_BUILD_PGO == 2
+    result.Set("pgo", "use");
+#else
+    result.Set("pgo", "off");
+#endif
+#ifdef OPENAFIS_COUNT_ALLOCATIONS
+    result.Set("allocationCounter", true);
+#else
+    result.Set("allocationCounter", false);
+#endif
+    return result;
+}
+
+/**
+ * @brief Score a probe descriptor against descriptors packed into 16-candidate blocks
+ *
+ * Diagnostic entry point: runs the pre-filter kernel selected at load time (lower it with
+ * OPENAFIS_ISA) so tests can check each kernel against a reference popcount.
+ * @param info - Node.js function arguments:
+ *   - arg[0]: Buffer[] - Gallery descriptors (256 bytes each)
+ *   - arg[1]: Buffer - Probe descriptor (256 bytes)
+ * @return Uint16Array - 16 scores per block, including the padding lanes of a partial last block
+ */
+Napi::Value ScorePackedDescriptors(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() != 2 || !info[0].IsArray() || !info[1].IsBuffer()) {
+        Napi::TypeError::New(env, "Expected an array of descriptor Buffers and a probe descriptor Buffer")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    auto readDescriptor = [](const Napi::Value& value, openafis::MinutiaeDescriptor& descriptor) {
+        if (!value.IsBuffer()) {
+            return false;
+        }
+        Napi::Buffer<uint8_t> buffer = value.As<Napi::Buffer<uint8_t>>();
+        if (buffer.Length() != openafis::kDescriptorBytes) {
+            return false;
+        }
+        std::copy(buffer.Data(), buffer.Data() + openafis::kDescriptorBytes, descriptor.bits.begin());
+        return true;
+    };
+    
+    openafis::MinutiaeDescriptor descriptor;
+    openafis::PackedGallery gallery;
+    Napi::Array descriptors = info[0].As<Napi::Array>();
+    for (uint32_t i = 0; i < descriptors.Length(); i++) {
+        if (!readDescriptor(descriptors.Get(i), descriptor)) {
+            Napi::TypeError::New(env, "Descriptors must be Buffers of 256 bytes").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        gallery.append(descriptor);
+    }
+    if (!readDescriptor(info[1], descriptor)) {
+        Napi::TypeError::New(env, "The probe descriptor must be a Buffer of 256 bytes").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    std::vector<uint8_t> wide;
+    openafis::widenProbe(descriptor, wide);
+    Napi::Uint16Array scores = Napi::Uint16Array::New(env, gallery.blocks() * openafis::kPackedLanes);
+    gallery.score(wide.data(), 0, gallery.blocks(), scores.Data());
+    return scores;
+}
+
+/**
+ * @brief Async worker applying finger position compatibility changes to the persistent gallery
+ */
+class FingerPositionWorker : public Napi::AsyncWorker {
+public:
+    FingerPositionWorker(Napi::Env env, AddonData* data, bool reset,
+                         std::vector<std::pair<uint8_t, std::vector<uint8_t>>> changes)
+        : Napi::AsyncWorker(env), gallery_(data->gallery), reset_(reset), changes_(std::move(changes)),
+          deferred_(Napi::Promise::Deferred::New(env)) {}
+    
+    Napi::Promise GetPromise() { return deferred_.Promise(); }
+    
+    void Execute() override {
+        if (reset_ || !changes_.empty()) {
+            // The map is read by every scan, so changes wait for in-flight scans to drain
+            std::unique_lock<std::shared_mutex> lock(gallery_->mutex);
+            if (reset_) {
+                gallery_->matcher->resetFingerCompatibility();
+            }
+            for (const auto& change : changes_) {
+                gallery_->matcher->setFingerCompatibility(change.first, change.second);
+            }
+        }
+        
+        std::shared_lock<std::shared_mutex> lock(gallery_->mutex);
+        sizes_ = gallery_->matcher->getFingerPartitionSizes();
+        compatibility_.clear();
+        for (uint8_t probe_position = 0; probe_position < sizes_.size(); probe_position++) {
+            compatibility_.push_back(gallery_->matcher->getFingerCompatibility(probe_position));
+        }
+    }
+    
+    void OnOK() override {
+        Napi::Env env = Env();
+        Napi::Object result = Napi::Object::New(env);
+        Napi::Array partitions = Napi::Array::New(env, sizes_.size());
+        for (size_t i = 0; i < sizes_.size(); i++) {
+            partitions.Set(static_cast<uint32_t>(i), static_cast<double>(sizes_[i]));
+        }
+        result.Set("partitions", partitions);
+        
+        Napi::Object compatibility = Napi::Object::New(env);
+        for (size_t probe_position = 0; probe_position < compatibility_.size(); probe_position++) {
+            const std::vector<uint8_t>& gallery_positions = compatibility_[probe_position];
+            Napi::Array list = Napi::Array::New(env, gallery_positions.size());
+            for (size_t j = 0; j < gallery_positions.size(); j++) {
+                list.Set(static_cast<uint32_t>(j), static_cast<double>(gallery_positions[j]));
+            }
+            compatibility.Set(std::to_string(probe_position), list);
+        }
+        result.Set("compatibility", compatibility);
+        deferred_.Resolve(result);
+    }
+    
+    void OnError(const Napi::Error& e) override {
+        deferred_.Reject(e.Value());
+    }
+
+private:
+    std::shared_ptr<GalleryState> gallery_;
+    bool reset_;
+    std::vector<std::pair<uint8_t, std::vector<uint8_t>>> changes_;
+    std::vector<size_t> sizes_;
+    std::vector<std::vector<uint8_t>> compatibility_;
+    Napi::Promise::Deferred deferred_;
+};
+
+/**
+ * @brief Configure how the persistent gallery's finger position partitions are searched
+ * @param info - Node.js function arguments:
+ *   - arg[0]: object (optional) - { reset?: boolean, compatibility?: { [probePosition]: number[] } }
+ *     Positions follow ISO 19794-2: 0 = unknown, 1-5 right thumb to little, 6-10 left thumb to little
+ * @return Promise<object> - { partitions: templates per position, compatibility: positions searched per
+ *     probe position } once in-flight scans have drained and the map applies
+ */
+Napi::Value ConfigureFingerPositions(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    AddonData* data = env.GetInstanceData<AddonData>();
+    
+    if (info.Length() > 0 && !info[0].IsObject()) {
+        Napi::TypeError::New(env, "Expected an options object: { reset, compatibility }")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    // Validate everything here so the worker applies all of the changes or none
+    bool reset = false;
+    std::vector<std::pair<uint8_t, std::vector<uint8_t>>> changes;
+    if (info.Length() > 0) {
+        Napi::Object options = info[0].As<Napi::Object>();
+        
+        reset = options.Has("reset") && options.Get("reset").ToBoolean().Value();
+        
+        if (options.Has("compatibility")) {
+            if (!options.Get("compatibility").IsObject()) {
+                Napi::TypeError::New(env, "compatibility must map probe positions to arrays of gallery positions")
+                    .ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            Napi::Object compatibility = options.Get("compatibility").As<Napi::Object>();
+            Napi::Array probe_positions = compatibility.GetPropertyNames();
+            for (uint32_t i = 0; i < probe_positions.Length(); i++) {
+                Napi::Value key = probe_positions[i];
+                const std::string probe_key = key.As<Napi::String>().Utf8Value();
+                const int probe_position = std::atoi(probe_key.c_str());
+                Napi::Value value = compatibility.Get(probe_key);
+                if (!value.IsArray() || probe_position < 0 || probe_position > 10 ||
+                    probe_key != std::to_string(probe_position)) {
+                    Napi::TypeError::New(env, "compatibility keys must be positions 0-10 mapping to arrays")
+                        .ThrowAsJavaScriptException();
+                    return env.Undefined();
+                }
+                
+                Napi::Array positions = value.As<Napi::Array>();
+                std::vector<uint8_t> gallery_positions;
+                for (uint32_t j = 0; j < positions.Length(); j++) {
+                    Napi::Value position = positions[j];
+                    int gallery_position = position.IsNumber() ? position.As<Napi::Number>().Int32Value() : -1;
+                    if (gallery_position < 0 || gallery_position > 10) {
+                        Napi::TypeError::New(env, "Gallery positions must be numbers 0-10").ThrowAsJavaScriptException();
+                        return env.Undefined();
+                    }
+                    gallery_positions.push_back(static_cast<uint8_t>(gallery_position));
+                }
+                changes.emplace_back(static_cast<uint8_t>(probe_position), std::move(gallery_positions));
+            }
+        }
+    }
+    
+    auto* worker = new FingerPositionWorker(env, data, reset, std::move(changes));
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue();
+    return promise;
+}
+
+/**
+ * @brief Describe the persistent gallery's scan engine settings as a JS object
+ */
+static Napi::Object ScanEngineObject(Napi::Env env, const openafis::ScanEngineOptions& options) {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("engine", options.engine == openafis::ScanEngine::Packed ? "packed" : "reference");
+    result.Set("shortlist", static_cast<double>(options.shortlist));
+    result.Set("kernel", openafis::packedKernelName());
+    return result;
+}
+
+/**
+ * @brief Async worker switching the persistent gallery's scan engine
+ *
+ * Selecting the packed engine describes every template, which is O(m^2) per template,
+ * so the descriptors are built under the shared lock beside running scans and only
+ * swapped in under the exclusive lock.
+ */
+class ScanEngineWorker : public Napi::AsyncWorker {
+public:
+    // Rebuilds after enrollments landed between the build and the swap, before building under the lock
+    static constexpr int kPreparedAttempts = 2;
+    
+    ScanEngineWorker(Napi::Env env, AddonData* data)
+        : Napi::AsyncWorker(env), gallery_(data->gallery), set_engine_(false),
+          engine_(openafis::ScanEngine::Reference), shortlist_(0),
+          deferred_(Napi::Promise::Deferred::New(env)) {}
+    
+    Napi::Promise GetPromise() { return deferred_.Promise(); }
+    
+    void SetEngine(openafis::ScanEngine engine) {
+        set_engine_ = true;
+        engine_ = engine;
+    }
+    
+    void SetShortlist(size_t shortlist) { shortlist_ = shortlist; }
+    
+    void Execute() override {
+        for (int attempt = 0;; attempt++) {
+            openafis::ScanEngineOptions options;
+            {
+                std::shared_lock<std::shared_mutex> lock(gallery_->mutex);
+                options = Requested(gallery_->matcher->getScanEngineOptions());
+                if (!set_engine_ && shortlist_ == 0) {
+                    options_ = options;
+                    return;
+                }
+                gallery_->matcher->prepareScanEngine(options);
+            }
+            
+            // The engine is read by every scan, so the swap waits for in-flight scans to drain
+            std::unique_lock<std::shared_mutex> lock(gallery_->mutex);
+            options = Requested(gallery_->matcher->getScanEngineOptions());
+            if (gallery_->matcher->configureScanEngine(options, attempt < kPreparedAttempts)) {
+                options_ = gallery_->matcher->getScanEngineOptions();
+                return;
+            }
+        }
+    }
+    
+    void OnOK() override {
+        deferred_.Resolve(ScanEngineObject(Env(), options_));
+    }
+    
+    void OnError(const Napi::Error& e) override {
+        deferred_.Reject(e.Value());
+    }
+
+private:
+    /**
+     * @brief The current settings with the requested changes applied
+     */
+    openafis::ScanEngineOptions Requested(openafis::ScanEngineOptions options) const {
+        if (set_engine_) {
+            options.engine = engine_;
+        }
+        if (shortlist_ > 0) {
+            options.shortlist = shortlist_;
+        }
+        return options;
+    }
+    
+    std::shared_ptr<GalleryState> gallery_;
+    bool set_engine_;
+    openafis::ScanEngine engine_;
+    size_t shortlist_;
+    openafis::ScanEngineOptions options_;
+    Napi::Promise::Deferred deferred_;
+};
+
+/**
+ * @brief Select how 1:N scans of the persistent gallery search it
+ * @param info - Node.js function arguments:
+ *   - arg[0]: object (optional) - { engine?: 'reference' | 'packed', shortlist?: number }
+ *     'packed' pre-filters with a SIMD kernel and re-scores the shortlist best candidates with OpenAFIS
+ * @return Promise<object> - { engine, shortlist, kernel } once the engine is in use
+ */
+Napi::Value ConfigureScanEngine(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    AddonData* data = env.GetInstanceData<AddonData>();
+    
+    if (info.Length() > 0 && !info[0].IsObject()) {
+        Napi::TypeError::New(env, "Expected an options object: { engine, shortlist }")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    bool set_engine = false;
+    openafis::ScanEngine engine = openafis::ScanEngine::Reference;
+    int64_t shortlist = 0;
+    if (info.Length() > 0) {
+        Napi::Object settings = info[0].As<Napi::Object>();
+        
+        if (settings.Has("engine")) {
+            Napi::Value value = settings.Get("engine");
+            const std::string name = value.IsString() ? value.As<Napi::String>().Utf8Value() : std::string();
+            if (name != "packed" && name != "reference") {
+                Napi::TypeError::New(env, "engine must be 'reference' or 'packed'").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            set_engine = true;
+            engine = name == "packed" ? openafis::ScanEngine::Packed : openafis::ScanEngine::Reference;
+        }
+        
+        if (settings.Has("shortlist")) {
+            shortlist = settings.Get("shortlist").As<Napi::Number>().Int64Value();
+            if (shortlist < 1) {
+                Napi::TypeError::New(env, "shortlist must be at least 1").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+        }
+    }
+    
+    auto* worker = new ScanEngineWorker(env, data);
+    if (set_engine) {
+        worker->SetEngine(engine);
+    }
+    worker->SetShortlist(static_cast<size_t>(shortlist));
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue();
+    return promise;
+}
+
+/**
+ * @brief Async worker scanning probes with both engines to measure the packed engine's accuracy
+ */
+class VerifyScanEngineWorker : public Napi::AsyncWorker {
+public:
+    VerifyScanEngineWorker(Napi::Env env, AddonData* data, std::vector<std::vector<uint8_t>> probes)
+        : Napi::AsyncWorker(env), gallery_(data->gallery), probes_(std::move(probes)),
+          deferred_(Napi::Promise::Deferred::New(env)) {}
+    
+    Napi::Promise GetPromise() { return deferred_.Promise(); }
+    
+    void Execute() override {
+        RefreshSharedGallery(*gallery_);
+        std::shared_lock<std::shared_mutex> lock(gallery_->mutex);
+        accuracy_ = gallery_->matcher->verifyScanEngine(probes_);
+    }
+    
+    void OnOK() override {
+        Napi::Env env = Env();
+        Napi::Object result = Napi::Object::New(env);
+        result.Set("probes", static_cast<double>(accuracy_.probes));
+        result.Set("agreements", static_cast<double>(accuracy_.agreements));
+        result.Set("referenceMatches", static_cast<double>(accuracy_.reference_matches));
+        result.Set("matchesFound", static_cast<double>(accuracy_.matches_found));
+        result.Set("recall", accuracy_.reference_matches > 0
+            ? static_cast<double>(accuracy_.matches_found) / static_cast<double>(accuracy_.reference_matches)
+            : 1.0);
+        result.Set("referenceMs", static_cast<double>(accuracy_.reference_time.count()) / 1000.0);
+        result.Set("packedMs", static_cast<double>(accuracy_.packed_time.count()) / 1000.0);
+        deferred_.Resolve(result);
+    }
+    
+    void OnError(const Napi::Error& e) override {
+        deferred_.Reject(e.Value());
+    }
+
+private:
+    std::shared_ptr<GalleryState> gallery_;
+    std::vector<std::vector<uint8_t>> probes_;
+    openafis::ScanEngineAccuracy accuracy_;
+    Napi::Promise::Deferred deferred_;
+};
+
+/**
+ * @brief Scan sample probes with both engines and report how well the packed engine keeps up
+ * @param info - Node.js function arguments:
+ *   - arg[0]: string[] - Base64 encoded probes, ideally with known mates in the gallery
+ * @return Promise<object> - { probes, agreements, referenceMatches, matchesFound, recall, referenceMs, packedMs }
+ */
+Napi::Value VerifyScanEngine(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() != 1 || !info[0].IsArray()) {
+        Napi::TypeError::New(env, "Expected one argument: an array of Base64 fingerprints")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    AddonData* data = env.GetInstanceData<AddonData>();
+    
+    Napi::Array samples = info[0].As<Napi::Array>();
+    std::vector<std::vector<uint8_t>> probes;
+    probes.reserve(samples.Length());
+    for (uint32_t i = 0; i < samples.Length(); i++) {
+        Napi::Value sample = samples[i];
+        if (!sample.IsString()) {
+            Napi::TypeError::New(env, "Probes must be Base64 strings").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        probes.push_back(base64_decode(sample.As<Napi::String>().Utf8Value()));
+    }
+    
+    auto* worker = new VerifyScanEngineWorker(env, data, std::move(probes));
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue();
+    return promise;
+}
+
+// Galleries published or attached in this process, by shared gallery name
+static std::mutex g_shared_galleries_mutex;
+static std::unordered_map<std::string, std::weak_ptr<GalleryState>> g_shared_galleries;
+
+/**
+ * @brief The gallery another environment of this process shares under a name, if any
+ */
+static std::shared_ptr<GalleryState> FindSharedGallery(const std::string& name) {
+    std::lock_guard<std::mutex> lock(g_shared_galleries_mutex);
+    auto it = g_shared_galleries.find(name);
+    if (it == g_shared_galleries.end()) {
+        return nullptr;
+    }
+    std::shared_ptr<GalleryState> gallery = it->second.lock();
+    if (!gallery) {
+        g_shared_galleries.erase(it);
+    }
+    return gallery;
+}
+
+static void RegisterSharedGallery(const std::string& name, const std::shared_ptr<GalleryState>& gallery) {
+    std::lock_guard<std::mutex> lock(g_shared_galleries_mutex);
+    g_shared_galleries[name] = gallery;
+}
+
+/**
+ * @brief Switch this environment to another gallery (JS thread)
+ */
+static void SwitchGallery(AddonData& data, std::shared_ptr<GalleryState> gallery, const std::string& shared_name) {
+    std::atomic_store(&data.gallery, std::move(gallery));
+    data.shared_gallery = shared_name;
+    data.shared_publisher = false;
+    // Shared templates have no JS objects behind them in this environment; results carry their IDs only
+    data.index_by_id.clear();
+    data.users.Reset();
+    std::shared_lock<std::shared_mutex> lock(data.gallery->mutex);
+    data.loaded_count = static_cast<uint32_t>(data.gallery->matcher->getEnrolledCount());
+}
+
+/**
+ * @brief Publish the persistent gallery to shared memory as its single writer
+ *
+ * Other processes (cluster workers) attach a replica that follows every later
+ * enrollment change; worker_threads of this process attach this very gallery.
+ * @param info - Node.js function arguments:
+ *   - arg[0]: string - "/name" for POSIX shared memory, or a file path to map
+ *   - arg[1]: object (optional) - { capacityBytes?: number } log size, default 64 MiB
+ * @return object - { success, name, loadedTemplates, capacityBytes, error? }
+ */
+Napi::Value PublishSharedGallery(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString() || (info.Length() > 1 && !info[1].IsObject())) {
+        Napi::TypeError::New(env, "Expected (name: string[, { capacityBytes }])").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    size_t capacity = 64 * 1024 * 1024;
+    if (info.Length() > 1) {
+        Napi::Object options = info[1].As<Napi::Object>();
+        if (options.Has("capacityBytes")) {
+            int64_t capacity_bytes = options.Get("capacityBytes").As<Napi::Number>().Int64Value();
+            if (capacity_bytes <= 0) {
+                Napi::TypeError::New(env, "capacityBytes must be positive").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            capacity = static_cast<size_t>(capacity_bytes);
+        }
+    }
+    
+    AddonData* data = env.GetInstanceData<AddonData>();
+    if (RejectOnReplica(env, *data)) {
+        return env.Undefined();
+    }
+    
+    const std::string name = info[0].As<Napi::String>().Utf8Value();
+    bool published;
+    {
+        std::unique_lock<std::shared_mutex> lock(data->gallery->mutex);
+        published = data->gallery->matcher->publishSharedGallery(name, capacity);
+    }
+    if (published) {
+        RegisterSharedGallery(name, data->gallery);
+        data->shared_gallery = name;
+        data->shared_publisher = true;
+    }
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("success", published);
+    result.Set("name", name);
+    result.Set("loadedTemplates", data->loaded_count);
+    result.Set("capacityBytes", static_cast<double>(capacity));
+    if (!published) {
+        result.Set("error", "Failed to publish shared gallery (see stderr for details)");
+    }
+    return result;
+}
+
+/**
+ * @brief Replace the persistent gallery with a published shared gallery
+ *
+ * Within the publishing process this shares the publisher's gallery; elsewhere it
+ * attaches a read-only replica that catches up with the writer before each match.
+ * @param info - Node.js function arguments:
+ *   - arg[0]: string - Shared gallery name given to publishSharedGallery()
+ * @return object - { success, loadedTemplates, memoryUsage, replica, error? }
+ */
+Napi::Value AttachSharedGallery(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() != 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "Expected (name: string)").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    AddonData* data = env.GetInstanceData<AddonData>();
+    const std::string name = info[0].As<Napi::String>().Utf8Value();
+    
+    // One parsed copy per process: join a gallery another environment already holds
+    std::shared_ptr<GalleryState> gallery = FindSharedGallery(name);
+    bool attached = gallery != nullptr;
+    if (!attached) {
+        gallery = std::make_shared<GalleryState>();
+        gallery->matcher->configureProbeCache(data->probe_cache_capacity, data->probe_cache_ttl);
+        attached = gallery->matcher->attachSharedGallery(name);
+        if (attached) {
+            RegisterSharedGallery(name, gallery);
+        }
+    }
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("success", attached);
+    if (attached) {
+        SwitchGallery(*data, std::move(gallery), name);
+        result.Set("replica", data->gallery->matcher->isSharedGalleryReplica());
+    } else {
+        result.Set("error", "Failed to attach shared gallery (see stderr for details)");
+    }
+    result.Set("loadedTemplates", data->loaded_count);
+    result.Set("memoryUsage", static_cast<int>(data->gallery->matcher->getMemoryUsage()));
+    return result;
+}
+
+/**
+ * @brief Stop sharing the persistent gallery
+ *
+ * The publisher stops publishing and removes the segment (replicas keep what they
+ * have); an attached environment switches back to an empty private gallery.
+ * @return object - { success, loadedTemplates }
+ */
+Napi::Value DetachSharedGallery(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    AddonData* data = env.GetInstanceData<AddonData>();
+    
+    const bool shared = !data->shared_gallery.empty();
+    if (data->shared_publisher) {
+        {
+            std::unique_lock<std::shared_mutex> lock(data->gallery->mutex);
+            data->gallery->matcher->detachSharedGallery();
+        }
+        std::lock_guard<std::mutex> lock(g_shared_galleries_mutex);
+        g_shared_galleries.erase(data->shared_gallery);
+        data->shared_gallery.clear();
+        data->shared_publisher = false;
+    } else if (shared) {
+        auto gallery = std::make_shared<GalleryState>();
+        gallery->matcher->configureProbeCache(data->probe_cache_capacity, data->probe_cache_ttl);
+        SwitchGallery(*data, std::move(gallery), std::string());
+    }
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("success", shared);
+    result.Set("loadedTemplates", data->loaded_count);
+    return result;
+}
+
+/**
+ * @brief Describe one named gallery as a JS object
+ */
+static Napi::Object GalleryInfoObject(Napi::Env env, const openafis::GalleryInfo& info) {
+    Napi::Object gallery = Napi::Object::New(env);
+    gallery.Set("name", info.name);
+    gallery.Set("resident", info.resident);
+    gallery.Set("templates", static_cast<double>(info.templates));
+    gallery.Set("memoryUsage", static_cast<double>(info.memory_bytes));
+    gallery.Set("quotaBytes", static_cast<double>(info.quota_bytes));
+    gallery.Set("evictions", static_cast<double>(info.evictions));
+    gallery.Set("reloads", static_cast<double>(info.reloads));
+    return gallery;
+}
+
+/**
+ * @brief Build the { success, error } result of a named gallery operation
+ */
+static Napi::Object GalleryStatusResult(Napi::Env env, openafis::GalleryStatus status) {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("success", status == openafis::GalleryStatus::Ok);
+    if (status != openafis::GalleryStatus::Ok) {
+        result.Set("error", openafis::galleryStatusMessage(status));
+    }
+    return result;
+}
+
+/**
+ * @brief Fetch the gallery registry, throwing if configureGalleries() has not been called
+ */
+static openafis::GalleryRegistry* RequireRegistry(Napi::Env env) {
+    AddonData* data = env.GetInstanceData<AddonData>();
+    if (!data->registry) {
+        Napi::Error::New(env, "Named galleries are not configured; call configureGalleries({ spillDirectory }) first")
+            .ThrowAsJavaScriptException();
+        return nullptr;
+    }
+    return data->registry.get();
+}
+
+/**
+ * @brief Async worker for registry-wide changes, which can evict galleries and write their snapshots
+ */
+class GalleryRegistryWorker : public Napi::AsyncWorker {
+public:
+    enum class Operation { Configure, Drop };
+    
+    GalleryRegistryWorker(Napi::Env env, openafis::GalleryRegistry* registry, Operation operation)
+        : Napi::AsyncWorker(env), registry_(registry), operation_(operation), memory_budget_(-1),
+          cache_capacity_(-1), cache_ttl_(0), status_(openafis::GalleryStatus::Ok),
+          deferred_(Napi::Promise::Deferred::New(env)) {}
+    
+    Napi::Promise GetPromise() { return deferred_.Promise(); }
+    
+    void SetMemoryBudget(int64_t memory_budget) { memory_budget_ = memory_budget; }
+    
+    void SetProbeCache(int64_t capacity, std::chrono::milliseconds ttl) {
+        cache_capacity_ = capacity;
+        cache_ttl_ = ttl;
+    }
+    
+    void SetGallery(std::string gallery) { gallery_ = std::move(gallery); }
+    
+    void Execute() override {
+        switch (operation_) {
+            case Operation::Configure:
+                if (memory_budget_ >= 0) {
+                    registry_->setMemoryBudget(static_cast<size_t>(memory_budget_));
+                }
+                if (cache_capacity_ >= 0) {
+                    registry_->configureProbeCache(static_cast<size_t>(cache_capacity_), cache_ttl_);
+                }
+                stats_ = registry_->stats();
+                galleries_ = registry_->list();
+                break;
+            case Operation::Drop:
+                status_ = registry_->dropGallery(gallery_);
+                break;
+        }
+    }
+    
+    void OnOK() override {
+        Napi::Env env = Env();
+        if (operation_ == Operation::Drop) {
+            deferred_.Resolve(GalleryStatusResult(env, status_));
+            return;
+        }
+        
+        Napi::Object result = Napi::Object::New(env);
+        result.Set("memoryBudgetBytes", static_cast<double>(stats_.memory_budget));
+        result.Set("residentBytes", static_cast<double>(stats_.resident_bytes));
+        result.Set("residentGalleries", static_cast<double>(stats_.resident_galleries));
+        result.Set("evictions", static_cast<double>(stats_.evictions));
+        result.Set("reloads", static_cast<double>(stats_.reloads));
+        Napi::Array list = Napi::Array::New(env, galleries_.size());
+        for (size_t i = 0; i < galleries_.size(); i++) {
+            list.Set(static_cast<uint32_t>(i), GalleryInfoObject(env, galleries_[i]));
+        }
+        result.Set("galleries", list);
+        deferred_.Resolve(result);
+    }
+    
+    void OnError(const Napi::Error& e) override {
+        deferred_.Reject(e.Value());
+    }
+
+private:
+    openafis::GalleryRegistry* registry_;
+    Operation operation_;
+    int64_t memory_budget_;
+    int64_t cache_capacity_;
+    std::chrono::milliseconds cache_ttl_;
+    std::string gallery_;
+    openafis::GalleryStatus status_;
+    openafis::RegistryStats stats_ = openafis::RegistryStats();
+    std::vector<openafis::GalleryInfo> galleries_;
+    Napi::Promise::Deferred deferred_;
+};
+
+/**
+ * @brief Configure the registry of named galleries
+ * @param info - Node.js function arguments:
+ *   - arg[0]: object (optional) - { spillDirectory?: string, memoryBudgetBytes?: number,
+ *     probeCache?: { capacity?: number, ttlMs?: number } }
+ *     spillDirectory is required on the first call and cannot change afterwards; named
+ *     galleries have no probe cache unless probeCache is given
+ * @return Promise<object> - Registry counters and every gallery, most recently used first,
+ *     once a lower budget has been enforced
+ */
+Napi::Value ConfigureGalleries(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    AddonData* data = env.GetInstanceData<AddonData>();
+    
+    if (info.Length() > 0 && !info[0].IsObject()) {
+        Napi::TypeError::New(env, "Expected an options object: { spillDirectory, memoryBudgetBytes }")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    int64_t budget = -1;
+    int64_t cache_capacity = -1;
+    int64_t cache_ttl_ms = -1;
+    if (info.Length() > 0) {
+        Napi::Object options = info[0].As<Napi::Object>();
+        
+        if (options.Has("memoryBudgetBytes")) {
+            budget = options.Get("memoryBudgetBytes").As<Napi::Number>().Int64Value();
+            if (budget < 0) {
+                Napi::TypeError::New(env, "memoryBudgetBytes must be non-negative").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+        }
+        
+        if (options.Has("probeCache")) {
+            if (!options.Get("probeCache").IsObject()) {
+                Napi::TypeError::New(env, "probeCache must be an object: { capacity, ttlMs }").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            Napi::Object cache = options.Get("probeCache").As<Napi::Object>();
+            cache_capacity = cache.Has("capacity") ? cache.Get("capacity").As<Napi::Number>().Int64Value() : 0;
+            cache_ttl_ms = cache.Has("ttlMs") ? cache.Get("ttlMs").As<Napi::Number>().Int64Value()
+                                              : data->probe_cache_ttl.count();
+            if (cache_capacity < 0 || cache_ttl_ms < 0) {
+                Napi::TypeError::New(env, "probeCache capacity and ttlMs must be non-negative").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+        }
+        
+        if (options.Has("spillDirectory")) {
+            if (!options.Get("spillDirectory").IsString()) {
+                Napi::TypeError::New(env, "spillDirectory must be a string").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            // In-flight gallery workers hold on to the registry, so it is created once
+            if (data->registry) {
+                Napi::Error::New(env, "spillDirectory can only be set once").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            data->registry = std::make_unique<openafis::GalleryRegistry>(
+                options.Get("spillDirectory").As<Napi::String>().Utf8Value(), budget < 0 ? 0 : static_cast<size_t>(budget));
+            budget = -1; // Already applied by the constructor
+        }
+    }
+    
+    openafis::GalleryRegistry* registry = RequireRegistry(env);
+    if (registry == nullptr) {
+        return env.Undefined();
+    }
+    
+    // A lower budget or a new cache size can spill galleries, which writes their snapshots
+    auto* worker = new GalleryRegistryWorker(env, registry, GalleryRegistryWorker::Operation::Configure);
+    worker->SetMemoryBudget(budget);
+    worker->SetProbeCache(cache_capacity, std::chrono::milliseconds(cache_ttl_ms));
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue();
+    return promise;
+}
+
+/**
+ * @brief Create an empty named gallery
+ * @param info - Node.js function arguments:
+ *   - arg[0]: string - Gallery name ([A-Za-z0-9._-], also its snapshot file name)
+ *   - arg[1]: object (optional) - { quotaBytes?: number, threshold?: number }
+ * @return object - { success, error? }
+ */
+Napi::Value CreateGallery(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString() || (info.Length() > 1 && !info[1].IsObject())) {
+        Napi::TypeError::New(env, "Expected (name[, { quotaBytes, threshold }])").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    openafis::GalleryOptions options;
+    if (info.Length() > 1) {
+        Napi::Object settings = info[1].As<Napi::Object>();
+        if (settings.Has("quotaBytes")) {
+            int64_t quota = settings.Get("quotaBytes").As<Napi::Number>().Int64Value();
+            if (quota < 0) {
+                Napi::TypeError::New(env, "quotaBytes must be non-negative").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            options.quota_bytes = static_cast<size_t>(quota);
+        }
+        if (settings.Has("threshold")) {
+            int threshold = settings.Get("threshold").As<Napi::Number>().Int32Value();
+            if (threshold < 0 || threshold > 255) {
+                Napi::TypeError::New(env, "Threshold must be between 0 and 255").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            options.threshold = static_cast<uint8_t>(threshold);
+        }
+    }
+    
+    openafis::GalleryRegistry* registry = RequireRegistry(env);
+    if (registry == nullptr) {
+        return env.Undefined();
+    }
+    return GalleryStatusResult(env, registry->createGallery(info[0].As<Napi::String>().Utf8Value(), options));
+}
+
+/**
+ * @brief Drop a named gallery and its snapshot
+ * @param info - Node.js function arguments:
+ *   - arg[0]: string - Gallery name
+ * @return Promise<object> - { success, error? } once in-flight operations on the gallery have finished
+ */
+Napi::Value DropGallery(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() != 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "Expected (name: string)").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    openafis::GalleryRegistry* registry = RequireRegistry(env);
+    if (registry == nullptr) {
+        return env.Undefined();
+    }
+    
+    auto* worker = new GalleryRegistryWorker(env, registry, GalleryRegistryWorker::Operation::Drop);
+    worker->SetGallery(info[0].As<Napi::String>().Utf8Value());
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue();
+    return promise;
+}
+
+/**
+ * @brief Async worker running one operation on a named gallery (which may first be reloaded from disk)
+ */
+class NamedGalleryWorker : public Napi::AsyncWorker {
+public:
+    enum class Operation { Enroll, Remove, Match };
+    
+    NamedGalleryWorker(Napi::Env env, openafis::GalleryRegistry* registry, Operation operation, std::string gallery,
+                       std::string template_id, std::vector<uint8_t> record)
+        : Napi::AsyncWorker(env), registry_(registry), operation_(operation), gallery_(std::move(gallery)),
+          template_id_(std::move(template_id)), record_(std::move(record)),
+          status_(openafis::GalleryStatus::Ok), deferred_(Napi::Promise::Deferred::New(env)) {}
+    
+    Napi::Promise GetPromise() { return deferred_.Promise(); }
+    
+    void Execute() override {
+        switch (operation_) {
+            case Operation::Enroll:
+                status_ = registry_->enroll(gallery_, template_id_, record_.data(), record_.size());
+                break;
+            case Operation::Remove:
+                status_ = registry_->remove(gallery_, template_id_);
+                break;
+            case Operation::Match:
+                status_ = registry_->match(gallery_, record_.data(), record_.size(), result_);
+                break;
+        }
+        registry_->describe(gallery_, info_);
+    }
+    
+    void OnOK() override {
+        Napi::Env env = Env();
+        Napi::Object result = GalleryStatusResult(env, status_);
+        result.Set("gallery", gallery_);
+        if (status_ == openafis::GalleryStatus::Ok && operation_ == Operation::Match) {
+            result.Set("isMatch", result_.is_match);
+            result.Set("bestMatch", result_.matched_template_id.str());
+            result.Set("similarityScore", static_cast<int>(result_.similarity_score));
+            result.Set("similarityPercentage", (static_cast<float>(result_.similarity_score) / 255.0f) * 100.0f);
+            result.Set("matchingTimeMs", static_cast<int>(result_.match_time.count()));
+            result.Set("cached", result_.from_cache);
+        }
+        result.Set("loadedTemplates", static_cast<double>(info_.templates));
+        result.Set("memoryUsage", static_cast<double>(info_.memory_bytes));
+        deferred_.Resolve(result);
+    }
+    
+    void OnError(const Napi::Error& e) override {
+        deferred_.Reject(e.Value());
+    }
+
+private:
+    openafis::GalleryRegistry* registry_;
+    Operation operation_;
+    std::string gallery_;
+    std::string template_id_;
+    std::vector<uint8_t> record_;
+    openafis::GalleryStatus status_;
+    openafis::MatchResult result_;
+    openafis::GalleryInfo info_ = openafis::GalleryInfo();
+    Napi::Promise::Deferred deferred_;
+};
+
+/**
+ * @brief Queue a named gallery operation and return its promise
+ */
+static Napi::Value QueueNamedGalleryWorker(Napi::Env env, NamedGalleryWorker::Operation operation, std::string gallery,
+                                           std::string template_id, std::vector<uint8_t> record) {
+    openafis::GalleryRegistry* registry = RequireRegistry(env);
+    if (registry == nullptr) {
+        return env.Undefined();
+    }
+    auto* worker = new NamedGalleryWorker(env, registry, operation, std::move(gallery), std::move(template_id),
+                                          std::move(record));
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue();
+    return promise;
+}
+
+/**
+ * @brief Enroll one fingerprint into a named gallery
+ * @param info - Node.js function arguments:
+ *   - arg[0]: string - Gallery name
+ *   - arg[1]: string - Template ID
+ *   - arg[2]: string - Base64 encoded ISO template
+ * @return Promise<object> - { success, gallery, loadedTemplates, memoryUsage, error? }
+ */
+Napi::Value EnrollGalleryFingerprint(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() != 3 || !info[0].IsString() || !info[1].IsString() || !info[2].IsString()) {
+        Napi::TypeError::New(env, "Expected (gallery: string, templateId: string, fingerprint: string)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    return QueueNamedGalleryWorker(env, NamedGalleryWorker::Operation::Enroll, info[0].As<Napi::String>().Utf8Value(),
+                                   info[1].As<Napi::String>().Utf8Value(),
+                                   base64_decode(info[2].As<Napi::String>().Utf8Value()));
+}
+
+/**
+ * @brief Remove one template from a named gallery
+ * @param info - Node.js function arguments:
+ *   - arg[0]: string - Gallery name
+ *   - arg[1]: string - Template ID
+ * @return Promise<object> - { success, gallery, loadedTemplates, memoryUsage, error? }
+ */
+Napi::Value RemoveGalleryFingerprint(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() != 2 || !info[0].IsString() || !info[1].IsString()) {
+        Napi::TypeError::New(env, "Expected (gallery: string, templateId: string)").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    return QueueNamedGalleryWorker(env, NamedGalleryWorker::Operation::Remove, info[0].As<Napi::String>().Utf8Value(),
+                                   info[1].As<Napi::String>().Utf8Value(), std::vector<uint8_t>());
+}
+
+/**
+ * @brief Match a fingerprint against a named gallery, reloading it from its snapshot if it was evicted
+ * @param info - Node.js function arguments:
+ *   - arg[0]: string - Gallery name
+ *   - arg[1]: string - Base64 encoded fingerprint to compare
+ * @return Promise<object> - { success, gallery, isMatch, bestMatch, similarityScore, ... }
+ */
+Napi::Value MatchGallery(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() != 2 || !info[0].IsString() || !info[1].IsString()) {
+        Napi::TypeError::New(env, "Expected (gallery: string, fingerprint: string)").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    return QueueNamedGalleryWorker(env, NamedGalleryWorker::Operation::Match, info[0].As<Napi::String>().Utf8Value(),
+                                   std::string(), base64_decode(info[1].As<Napi::String>().Utf8Value()));
+}
+
+/**
+ * @brief Enable or disable per-phase match tracing in this environment
+ * @param info - Node.js function arguments:
+ *   - arg[0]: object - { enabled: boolean, bufferSpans?: number }
+ * @return object - { enabled, spans, droppedSpans }
+ */
+Napi::Value ConfigureTracing(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    AddonData* data = env.GetInstanceData<AddonData>();
+    openafis::TraceRecorder& recorder = openafis::TraceRecorder::instance();
+    
+    if (info.Length() > 0) {
+        if (!info[0].IsObject()) {
+            Napi::TypeError::New(env, "Expected an options object: { enabled, bufferSpans }")
+                .ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        Napi::Object options = info[0].As<Napi::Object>();
+        
+        int64_t buffer_spans = 100000;
+        if (options.Has("bufferSpans")) {
+            buffer_spans = options.Get("bufferSpans").As<Napi::Number>().Int64Value();
+            if (buffer_spans < 1) {
+                Napi::TypeError::New(env, "bufferSpans must be at least 1").ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+        }
+        
+        if (options.Has("enabled")) {
+            const bool enabled = options.Get("enabled").ToBoolean().Value();
+            // Other environments (worker threads) may be tracing into the same recorder
+            if (enabled && !data->tracing) {
+                recorder.acquire(static_cast<size_t>(buffer_spans));
+            } else if (!enabled && data->tracing) {
+                recorder.release();
+            }
+            data->tracing = enabled;
+        }
+    }
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("enabled", data->tracing);
+    result.Set("spans", static_cast<double>(recorder.spanCount()));
+    result.Set("droppedSpans", static_cast<double>(recorder.droppedCount()));
+    return result;
+}
+
+/**
+ * @brief Export recorded spans as Chrome trace-event JSON (chrome://tracing, Perfetto)
+ * @param info - Node.js function arguments:
+ *   - arg[0]: object (optional) - { clear?: boolean } (default true)
+ * @return string - Trace JSON
+ */
+Napi::Value ExportTrace(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    bool clear = true;
+    if (info.Length() > 0 && info[0].IsObject()) {
+        Napi::Object options = info[0].As<Napi::Object>();
+        if (options.Has("clear")) {
+            clear = options.Get("clear").ToBoolean().Value();
+        }
+    }
+    return Napi::String::New(env, openafis::TraceRecorder::instance().exportChromeTrace(clear));
+}
+
+#ifdef OPENAFIS_COUNT_ALLOCATIONS
+/**
+ * @brief Number of operator new calls made by native code since the addon was loaded
+ * @return number - Allocation count (allocation-counting builds only)
+ */
+Napi::Value GetAllocationCount(const Napi::CallbackInfo& info) {
+    return Napi::Number::New(info.Env(), static_cast<double>(openafis::allocationCount()));
+}
+#endif
+
+/**
+ * @brief Initialize the Node.js addon
+ */
+Napi::Object Init(Napi::Env env, Napi::Object exports) {
+    env.SetInstanceData(new AddonData());
+    
     exports.Set(Napi::String::New(env, "matchFingerprint"), 
                 Napi::Function::New(env, MatchFingerprint));
     exports.Set(Napi::String::New(env, "setThreshold"), 
                 Napi::Function::New(env, SetThreshold));
+    exports.Set(Napi::String::New(env, "loadGallery"), 
+                Napi::Function::New(env, LoadGallery));
+    exports.Set(Napi::String::New(env, "openGalleryStore"), 
+                Napi::Function::New(env, OpenGalleryStore));
+    exports.Set(Napi::String::New(env, "enrollFingerprint"), 
+                Napi::Function::New(env, EnrollFingerprint));
+    exports.Set(Napi::String::New(env, "removeFingerprint"), 
+                Napi::Function::New(env, RemoveFingerprint));
+    exports.Set(Napi::String::New(env, "matchFingerprintAsync"), 
+                Napi::Function::New(env, MatchFingerprintAsync));
+    exports.Set(Napi::String::New(env, "matchFingerprintBatched"), 
+                Napi::Function::New(env, MatchFingerprintBatched));
+    exports.Set(Napi::String::New(env, "matchFingerprintStream"), 
+                Napi::Function::New(env, MatchFingerprintStream));
+    exports.Set(Napi::String::New(env, "configureCoalescing"), 
+                Napi::Function::New(env, ConfigureCoalescing));
+    exports.Set(Napi::String::New(env, "configureProbeCache"), 
+                Napi::Function::New(env, ConfigureProbeCache));
+    exports.Set(Napi::String::New(env, "getBuildInfo"), 
+                Napi::Function::New(env, GetBuildInfo));
+    exports.Set(Napi::String::New(env, "scorePackedDescriptors"), 
+                Napi::Function::New(env, ScorePackedDescriptors));
+    exports.Set(Napi::String::New(env, "configureFingerPositions"), 
+                Napi::Function::New(env, ConfigureFingerPositions));
+    exports.Set(Napi::String::New(env, "configureScanEngine"), 
+                Napi::Function::New(env, ConfigureScanEngine));
+    exports.Set(Napi::String::New(env, "verifyScanEngine"), 
+                Napi::Function::New(env, VerifyScanEngine));
+    exports.Set(Napi::String::New(env, "publishSharedGallery"), 
+                Napi::Function::New(env, PublishSharedGallery));
+    exports.Set(Napi::String::New(env, "attachSharedGallery"), 
+                Napi::Function::New(env, AttachSharedGallery));
+    exports.Set(Napi::String::New(env, "detachSharedGallery"), 
+                Napi::Function::New(env, DetachSharedGallery));
+    exports.Set(Napi::String::New(env, "configureGalleries"), 
+                Napi::Function::New(env, ConfigureGalleries));
+    exports.Set(Napi::String::New(env, "createGallery"), 
+                Napi::Function::New(env, CreateGallery));
+    exports.Set(Napi::String::New(env, "dropGallery"), 
+                Napi::Function::New(env, DropGallery));
+    exports.Set(Napi::String::New(env, "enrollGalleryFingerprint"), 
+                Napi::Function::New(env, EnrollGalleryFingerprint));
+    exports.Set(Napi::String::New(env, "removeGalleryFingerprint"), 
+                Napi::Function::New(env, RemoveGalleryFingerprint));
+    exports.Set(Napi::String::New(env, "matchGallery"), 
+                Napi::Function::New(env, MatchGallery));
+    exports.Set(Napi::String::New(env, "configureTracing"), 
+                Napi::Function::New(env, ConfigureTracing));
+    exports.Set(Napi::String::New(env, "exportTrace"), 
+                Napi::Function::New(env, ExportTrace));
+#ifdef OPENAFIS_COUNT_ALLOCATIONS
+    exports.Set(Napi::String::New(env, "getAllocationCount"), 
+                Napi::Function::New(env, GetAllocationCount));
+#endif
     return exports;
 }
 
@@ -1,37 +1,151 @@
 #include "base64.h"
+#include "CpuDispatch.h"
 #include <algorithm>
-#include <cctype>
+#include <array>
 #include <cstdint>
 #include <vector>
 #include <string>
 
-std::vector<uint8_t> base64_decode(const std::string& encoded_string) {
+#if OPENAFIS_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace {
+
+using DecodeKernel = size_t (*)(const uint8_t* in, size_t length, uint8_t* out);
+
+// Maps a character to its 6-bit value, or -1 when it is not in the alphabet
+const std::array<int8_t, 256> kDecodeTable = [] {
     const std::string chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-    std::vector<uint8_t> decoded;
+    std::array<int8_t, 256> table;
+    table.fill(-1);
+    for (size_t i = 0; i < chars.size(); i++) {
+        table[static_cast<uint8_t>(chars[i])] = static_cast<int8_t>(i);
+    }
+    return table;
+}();
+
+/**
+ * @brief Decode alphabet-only input four characters at a time; a trailing partial quad yields its full bytes
+ */
+size_t decodeScalar(const uint8_t* in, size_t length, uint8_t* out) {
+    uint8_t* start = out;
+    size_t i = 0;
     
-    // Clean the input string (remove whitespace and newlines)
-    std::string cleaned;
-    for (char c : encoded_string) {
-        if (chars.find(c) != std::string::npos || c == '=') {
-            cleaned += c;
+    for (; i + 4 <= length; i += 4) {
+        uint32_t quad = (kDecodeTable[in[i]] << 18) | (kDecodeTable[in[i + 1]] << 12) |
+                        (kDecodeTable[in[i + 2]] << 6) | kDecodeTable[in[i + 3]];
+        *out++ = static_cast<uint8_t>(quad >> 16);
+        *out++ = static_cast<uint8_t>(quad >> 8);
+        *out++ = static_cast<uint8_t>(quad);
+    }
+    
+    uint32_t val = 0;
+    int bits = 0;
+    for (; i < length; i++) {
+        val = (val << 6) | static_cast<uint32_t>(kDecodeTable[in[i]]);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            *out++ = static_cast<uint8_t>(val >> bits);
         }
     }
     
-    if (cleaned.empty()) {
-        return decoded;
+    return static_cast<size_t>(out - start);
+}
+
+#if OPENAFIS_X86_DISPATCH
+/**
+ * @brief AVX2 decode of 32 characters into 24 bytes per step (nibble-lookup translation)
+ *
+ * Needs 8 bytes of slack after the output, as each step stores a full 32-byte vector.
+ */
+__attribute__((target("avx2")))
+size_t decodeAvx2(const uint8_t* in, size_t length, uint8_t* out) {
+    const __m256i lut_roll = _mm256_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+    const __m256i pack_bytes = _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i pack_lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+    
+    uint8_t* start = out;
+    size_t i = 0;
+    
+    // Input is already restricted to the alphabet, so only translation is needed
+    for (; i + 32 <= length; i += 32) {
+        __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(chars, 4), mask_2f);
+        __m256i eq_2f = _mm256_cmpeq_epi8(chars, mask_2f);
+        __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+        __m256i values = _mm256_add_epi8(chars, roll);
+        
+        // Merge 4x6 bits into 24-bit groups, then drop the empty byte of each group
+        __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        merged = _mm256_shuffle_epi8(merged, pack_bytes);
+        merged = _mm256_permutevar8x32_epi32(merged, pack_lanes);
+        
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), merged);
+        out += 24;
     }
     
-    int val = 0, valb = -8;
-    for (char c : cleaned) {
-        if (chars.find(c) != std::string::npos) {
-            val = (val << 6) + static_cast<int>(chars.find(c));
-            valb += 6;
-            if (valb >= 0) {
-                decoded.push_back(static_cast<uint8_t>((val >> valb) & 0xFF));
-                valb -= 8;
-            }
+    out += decodeScalar(in + i, length - i, out);
+    return static_cast<size_t>(out - start);
+}
+#endif
+
+struct SelectedKernel {
+    DecodeKernel decode;
+    const char* name;
+};
+
+const SelectedKernel& selectedKernel() {
+    static const SelectedKernel kernel = [] {
+#if OPENAFIS_X86_DISPATCH
+        if (openafis::selectedIsaLevel() >= openafis::IsaLevel::AVX2) {
+            return SelectedKernel{decodeAvx2, "avx2"};
+        }
+#endif
+        return SelectedKernel{decodeScalar, "scalar"};
+    }();
+    return kernel;
+}
+
+} // namespace
+
+size_t base64_decode(const char* encoded, size_t length, std::vector<uint8_t>& decoded) {
+    // Clean the input (remove whitespace, newlines and padding) into a per-thread buffer
+    thread_local std::string cleaned;
+    cleaned.clear();
+    cleaned.reserve(length);
+    for (size_t i = 0; i < length; i++) {
+        if (kDecodeTable[static_cast<uint8_t>(encoded[i])] >= 0) {
+            cleaned += encoded[i];
         }
     }
     
+    if (cleaned.empty()) {
+        decoded.clear();
+        return 0;
+    }
+    
+    // Slack for the vector kernels' full-width stores; resize() keeps the capacity
+    decoded.resize(cleaned.size() / 4 * 3 + 3 + 32);
+    size_t decoded_length = selectedKernel().decode(reinterpret_cast<const uint8_t*>(cleaned.data()),
+                                                    cleaned.size(), decoded.data());
+    decoded.resize(decoded_length);
+    return decoded_length;
+}
+
+std::vector<uint8_t> base64_decode(const std::string& encoded_string) {
+    std::vector<uint8_t> decoded;
+    base64_decode(encoded_string.data(), encoded_string.size(), decoded);
     return decoded;
 }
+
+const char* base64_kernel_name() {
+    return selectedKernel().name;
+}
@@ -0,0 +1,30 @@
+#ifndef BASE64_H
+#define BASE64_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Decode Base64 text, ignoring whitespace, padding and other non-alphabet characters
+ * @param encoded_string Base64 encoded data
+ * @return Decoded bytes
+ */
+std::vector<uint8_t> base64_decode(const std::string& encoded_string);
+
+/**
+ * @brief Decode Base64 text into a caller-owned buffer, reusing its capacity
+ * @param encoded Base64 encoded data
+ * @param length Number of characters
+ * @param decoded Receives the decoded bytes (resized to fit)
+ * @return Number of decoded bytes
+ */
+size_t base64_decode(const char* encoded, size_t length, std::vector<uint8_t>& decoded);
+
+/**
+ * @brief Name of the decode kernel selected for this CPU ("scalar" or "avx2")
+ */
+const char* base64_kernel_name();
+
+#endif // BASE64_H
@@ -0,0 +1,181 @@
+// Synthetic ISO 19794-2:2005 gallery generator for benchmarks and PGO training runs
+//
+// Templates are structurally valid records (one view, 30-50 minutiae) built from a
+// seeded PRNG, so runs are reproducible. Probes are distorted re-captures of an
+// enrolled finger: rotated, translated, jittered, with some minutiae dropped and
+// a few spurious ones added.
+
+const WIDTH = 256;
+const HEIGHT = 360;
+const RESOLUTION = 197; // pixels per cm (500 dpi)
+
+/**
+ * Small deterministic PRNG (mulberry32)
+ * @param {number} seed
+ * @returns {() => number} Uniform generator in [0, 1)
+ */
+function createRandom(seed) {
+    let state = seed >>> 0;
+    return function () {
+        state = (state + 0x6D2B79F5) >>> 0;
+        let t = state;
+        t = Math.imul(t ^ (t >>> 15), t | 1);
+        t ^= t + Math.imul(t ^ (t >>> 7), t | 61);
+        return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+    };
+}
+
+/**
+ * Generate the minutiae of a synthetic finger
+ * @param {() => number} random
+ * @returns {Array<{type: number, x: number, y: number, angle: number, quality: number}>}
+ */
+function makeMinutiae(random) {
+    const count = 30 + Math.floor(random() * 21);
+    const minutiae = [];
+    for (let i = 0; i < count; i++) {
+        minutiae.push({
+            type: random() < 0.5 ? 1 : 2, // ridge ending / bifurcation
+            x: 16 + Math.floor(random() * (WIDTH - 32)),
+            y: 16 + Math.floor(random() * (HEIGHT - 32)),
+            angle: Math.floor(random() * 256),
+            quality: 60 + Math.floor(random() * 40)
+        });
+    }
+    return minutiae;
+}
+
+/**
+ * Encode minutiae as a single-view ISO 19794-2:2005 record
+ * @param {Array} minutiae
+ * @param {number} [fingerPosition=0] ISO finger position code (0 = unknown)
+ * @returns {Buffer}
+ */
+function encodeIsoRecord(minutiae, fingerPosition = 0) {
+    const length = 24 + 4 + minutiae.length * 6 + 2;
+    const record = Buffer.alloc(length);
+
+    record.write('FMR\0', 0, 'latin1');
+    record.write(' 20\0', 4, 'latin1');
+    record.writeUInt32BE(length, 8);
+    record.writeUInt16BE(0, 12); // capture equipment
+    record.writeUInt16BE(WIDTH, 14);
+    record.writeUInt16BE(HEIGHT, 16);
+    record.writeUInt16BE(RESOLUTION, 18);
+    record.writeUInt16BE(RESOLUTION, 20);
+    record.writeUInt8(1, 22); // number of views
+    record.writeUInt8(0, 23);
+
+    record.writeUInt8(fingerPosition, 24);
+    record.writeUInt8(0, 25); // view 0, live-scan plain impression
+    record.writeUInt8(90, 26); // finger quality
+    record.writeUInt8(minutiae.length, 27);
+
+    let offset = 28;
+    for (const m of minutiae) {
+        record.writeUInt16BE(((m.type & 0x3) << 14) | (m.x & 0x3fff), offset);
+        record.writeUInt16BE(m.y & 0x3fff, offset + 2);
+        record.writeUInt8(m.angle & 0xff, offset + 4);
+        record.writeUInt8(m.quality, offset + 5);
+        offset += 6;
+    }
+    record.writeUInt16BE(0, offset); // no extended data
+
+    return record;
+}
+
+/**
+ * Simulate a new capture of an enrolled finger
+ * @param {Array} minutiae Enrolled minutiae
+ * @param {() => number} random
+ * @returns {Array} Distorted minutiae
+ */
+function distortMinutiae(minutiae, random) {
+    const rotation = (random() - 0.5) * (Math.PI / 9); // +/- 10 degrees
+    const dx = Math.round((random() - 0.5) * 30);
+    const dy = Math.round((random() - 0.5) * 30);
+    const cx = WIDTH / 2;
+    const cy = HEIGHT / 2;
+    const cos = Math.cos(rotation);
+    const sin = Math.sin(rotation);
+    const angleShift = Math.round((rotation / (2 * Math.PI)) * 256);
+
+    const distorted = [];
+    for (const m of minutiae) {
+        if (random() < 0.15) {
+            continue; // missed by the sensor
+        }
+        const x = Math.round(cx + (m.x - cx) * cos - (m.y - cy) * sin + dx + (random() - 0.5) * 6);
+        const y = Math.round(cy + (m.x - cx) * sin + (m.y - cy) * cos + dy + (random() - 0.5) * 6);
+        if (x < 0 || y < 0 || x >= WIDTH || y >= HEIGHT) {
+            continue;
+        }
+        distorted.push({
+            type: m.type,
+            x,
+            y,
+            angle: (m.angle + angleShift + Math.round((random() - 0.5) * 8) + 256) & 0xff,
+            quality: m.quality
+        });
+    }
+
+    const spurious = Math.floor(random() * 4);
+    return distorted.concat(makeMinutiae(random).slice(0, spurious));
+}
+
+/**
+ * Build a synthetic gallery of users
+ * @param {number} size Number of users
+ * @param {number} [seed=1]
+ * @returns {Array<{id: string, name: string, fingerprint: string, minutiae: Array}>}
+ */
+function makeGallery(size, seed = 1) {
+    const random = createRandom(seed);
+    const users = [];
+    for (let i = 0; i < size; i++) {
+        const minutiae = makeMinutiae(random);
+        users.push({
+            id: `user_${i}`,
+            name: `Synthetic User ${i}`,
+            fingerprint: encodeIsoRecord(minutiae).toString('base64'),
+            minutiae
+        });
+    }
+    return users;
+}
+
+/**
+ * Build probes: re-captures of enrolled users plus unenrolled fingers
+ * @param {Array} users Gallery from makeGallery()
+ * @param {number} count Number of probes
+ * @param {object} [options]
+ * @param {number} [options.genuineRatio=0.8] Share of probes taken from enrolled users
+ * @param {number} [options.seed=2]
+ * @returns {Array<{fingerprint: string, expectedId: string|null}>}
+ */
+function makeProbes(users, count, { genuineRatio = 0.8, seed = 2 } = {}) {
+    const random = createRandom(seed);
+    const probes = [];
+    for (let i = 0; i < count; i++) {
+        if (users.length > 0 && random() < genuineRatio) {
+            const user = users[Math.floor(random() * users.length)];
+            probes.push({
+                fingerprint: encodeIsoRecord(distortMinutiae(user.minutiae, random)).toString('base64'),
+                expectedId: user.id
+            });
+        } else {
+            probes.push({
+                fingerprint: encodeIsoRecord(makeMinutiae(random)).toString('base64'),
+                expectedId: null
+            });
+        }
+    }
+    return probes;
+}
+
+module.exports = {
+    createRandom,
+    encodeIsoRecord,
+    makeGallery,
+    makeProbes
+};
@@ -0,0 +1,86 @@
+// Allocation-counting test for the match hot path
+//
+// Requires an allocation-counting build of the addon:
+//   OPENAFIS_COUNT_ALLOCATIONS=true node-gyp rebuild
+//
+// Matches synthetic probes against a persistent gallery through the synchronous
+// gallery path and checks that, once warmed up, a match performs no native heap
+// allocations: with the probe cache disabled, with a small cache that evicts on
+// every probe, and with repeated probes answered from cached results.
+
+const {
+    matchFingerprint,
+    loadGallery,
+    configureProbeCache,
+    getBuildInfo,
+    getAllocationCount
+} = require('./index');
+const { makeGallery, makeProbes } = require('./synthetic-gallery');
+
+const GALLERY_SIZE = 500;
+const PROBE_COUNT = 64;
+const WARMUP_MATCHES = 64 * 20;
+const MEASURED_MATCHES = 2000;
+
+const scenarios = [
+    { name: 'probe cache disabled', capacity: 0 },
+    { name: 'probe cache evicting (16 entries)', capacity: 16 },
+    { name: 'cached results (1024 entries)', capacity: 1024 }
+];
+
+function measure(probes, capacity) {
+    configureProbeCache({ capacity, ttlMs: 60000 });
+
+    // One running index, so the measured window continues the warm-up rotation
+    let index = 0;
+    const next = () => probes[index++ % probes.length].fingerprint;
+
+    for (let i = 0; i < WARMUP_MATCHES; i++) {
+        matchFingerprint(next());
+    }
+
+    let failures = 0;
+    const before = getAllocationCount();
+    for (let i = 0; i < MEASURED_MATCHES; i++) {
+        const result = matchFingerprint(next());
+        if (!result.success) {
+            failures++;
+        }
+    }
+    const allocations = getAllocationCount() - before;
+
+    return { allocations, perMatch: allocations / MEASURED_MATCHES, failures };
+}
+
+function main() {
+    console.log('🧪 Match hot path allocation test\n');
+
+    if (!getBuildInfo().allocationCounter || typeof getAllocationCount !== 'function') {
+        console.log('⏭️  Skipped: rebuild with OPENAFIS_COUNT_ALLOCATIONS=true node-gyp rebuild');
+        return;
+    }
+
+    const users = makeGallery(GALLERY_SIZE);
+    const loaded = loadGallery(users);
+    console.log(`📚 Gallery: ${loaded.loadedTemplates} templates, ${PROBE_COUNT} distinct probes`);
+
+    const probes = makeProbes(users, PROBE_COUNT);
+    let failed = false;
+
+    for (const scenario of scenarios) {
+        const { allocations, perMatch, failures } = measure(probes, scenario.capacity);
+        const ok = allocations === 0 && failures === 0;
+        failed = failed || !ok;
+        console.log(`${ok ? '✅' : '❌'} ${scenario.name}: ${allocations} allocations over ` +
+                    `${MEASURED_MATCHES} matches (${perMatch.toFixed(3)} per match)` +
+                    (failures > 0 ? `, ${failures} failed matches` : ''));
+    }
+
+    if (failed) {
+        console.log('\n💥 Steady-state matches are allocating');
+        process.exit(1);
+    }
+    console.log('\n🎉 No steady-state allocations on the match hot path');
+}
+
+main();
@@ -0,0 +1,404 @@
+// Crash recovery test for the durable gallery store
+//
+// Builds store directories the way a crash leaves them - a torn journal tail, a
+// corrupt entry, a sequence gap, a retired journal from an interrupted compaction
+// (including one that two rotations folded together), a snapshot plus journal tail -
+// reopens each with openGalleryStore and checks the recovered gallery: the template
+// count, that surviving users still match, that removed users do not, and what was
+// left on disk. A live store whose compaction cannot retire its journal must keep
+// journaling and still close and reopen, and a gallery loaded before any store was
+// attached must not be silently replaced by one.
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const {
+    loadGallery,
+    openGalleryStore,
+    enrollFingerprint,
+    removeFingerprint,
+    matchFingerprintAsync,
+    configureProbeCache
+} = require('./index');
+const { makeGallery } = require('./synthetic-gallery');
+
+const ENROLL = 1;
+const REMOVE = 2;
+
+// Large enough that the background compactor never runs during a scenario
+const STORE_OPTIONS = { compactionBytes: 1 << 30, compactionIntervalMs: 3600 * 1000 };
+
+const users = makeGallery(12);
+const byId = new Map(users.map(user => [user.id, user]));
+
+const CRC_TABLE = (() => {
+    const table = new Uint32Array(256);
+    for (let i = 0; i < 256; i++) {
+        let c = i;
+        for (let k = 0; k < 8; k++) {
+            c = (c & 1) ? (0xEDB88320 ^ (c >>> 1)) : (c >>> 1);
+        }
+        table[i] = c >>> 0;
+    }
+    return table;
+})();
+
+function crc32(buffer) {
+    let crc = 0xFFFFFFFF;
+    for (const byte of buffer) {
+        crc = CRC_TABLE[(crc ^ byte) & 0xFF] ^ (crc >>> 8);
+    }
+    return (crc ^ 0xFFFFFFFF) >>> 0;
+}
+
+function u32(value) {
+    const out = Buffer.alloc(4);
+    out.writeUInt32LE(value);
+    return out;
+}
+
+function u64(value) {
+    const out = Buffer.alloc(8);
+    out.writeBigUInt64LE(BigInt(value));
+    return out;
+}
+
+function sized(buffer) {
+    return Buffer.concat([u32(buffer.length), buffer]);
+}
+
+function recordOf(id) {
+    return Buffer.from(byId.get(id).fingerprint, 'base64');
+}
+
+/**
+ * Encode one journal frame: u32 payload length, u32 CRC-32, then
+ * u64 sequence, u8 operation, u32 id length, id, u32 data length, data
+ */
+function frame(sequence, operation, id) {
+    const data = operation === ENROLL ? recordOf(id) : Buffer.alloc(0);
+    const payload = Buffer.concat([u64(sequence), Buffer.from([operation]), sized(Buffer.from(id)), sized(data)]);
+    return Buffer.concat([u32(payload.length), u32(crc32(payload)), payload]);
+}
+
+/**
+ * Encode a journal from [sequence, operation, id] entries
+ */
+function journal(entries) {
+    return Buffer.concat(entries.map(([sequence, operation, id]) => frame(sequence, operation, id)));
+}
+
+/**
+ * Encode a snapshot: "OAFSNAP1", u64 sequence, u32 count, records, trailing CRC-32
+ */
+function snapshot(sequence, ids) {
+    const body = Buffer.concat([
+        Buffer.from('OAFSNAP1'),
+        u64(sequence),
+        u32(ids.length),
+        ...ids.map(id => Buffer.concat([sized(Buffer.from(id)), sized(recordOf(id))]))
+    ]);
+    return Buffer.concat([body, u32(crc32(body))]);
+}
+
+function delay(ms) {
+    return new Promise(resolve => setTimeout(resolve, ms));
+}
+
+function enrollments(first, ids) {
+    return ids.map((id, i) => [first + i, ENROLL, id]);
+}
+
+const scratch = fs.mkdtempSync(path.join(os.tmpdir(), 'openafis-journal-'));
+let storeCount = 0;
+
+function newStore(files) {
+    const directory = path.join(scratch, `store-${storeCount++}`);
+    fs.mkdirSync(directory);
+    for (const [name, contents] of Object.entries(files)) {
+        fs.writeFileSync(path.join(directory, name), contents);
+    }
+    return directory;
+}
+
+function storeFile(directory, name) {
+    return path.join(directory, name);
+}
+
+/**
+ * Close the open store by switching the gallery to an empty one
+ */
+function closeStore() {
+    openGalleryStore(newStore({}), STORE_OPTIONS);
+}
+
+async function checkGallery(opened, expected, removed) {
+    const problems = [];
+    if (!opened.success) {
+        return [`store failed to open: ${opened.error}`];
+    }
+    if (opened.loadedTemplates !== expected.length) {
+        problems.push(`recovered ${opened.loadedTemplates} templates, expected ${expected.length}`);
+    }
+    for (const id of expected) {
+        const result = await matchFingerprintAsync(byId.get(id).fingerprint);
+        if (!result.isMatch || result.bestMatch !== id) {
+            problems.push(`${id} did not match itself (best: ${result.bestMatch})`);
+        }
+    }
+    for (const id of removed) {
+        const result = await matchFingerprintAsync(byId.get(id).fingerprint);
+        if (result.success && result.bestMatch === id) {
+            problems.push(`removed ${id} still matches`);
+        }
+    }
+    return problems;
+}
+
+const scenarios = [
+    {
+        // Runs first: every later scenario leaves a store attached
+        name: 'store refuses to replace a gallery loaded without one',
+        async run() {
+            const problems = [];
+            const loaded = ['user_4', 'user_5'];
+            loadGallery(loaded.map(id => byId.get(id)));
+            const directory = newStore({ 'gallery.snapshot': snapshot(1, ['user_0']) });
+            const refused = openGalleryStore(directory, STORE_OPTIONS);
+            if (refused.success || !refused.error) {
+                problems.push('store opened over templates it does not hold');
+            }
+            for (const id of loaded) {
+                const result = await matchFingerprintAsync(byId.get(id).fingerprint);
+                if (!result.isMatch || result.bestMatch !== id) {
+                    problems.push(`loaded ${id} no longer matches after the refused open`);
+                }
+            }
+            // Once cleared, the same store opens
+            loadGallery([]);
+            problems.push(...await checkGallery(openGalleryStore(directory, STORE_OPTIONS), ['user_0'], loaded));
+            return problems;
+        }
+    },
+    {
+        name: 'clean journal',
+        async run() {
+            const directory = newStore({
+                'gallery.journal': journal([...enrollments(1, ['user_0', 'user_1', 'user_2']), [4, REMOVE, 'user_1']])
+            });
+            return checkGallery(openGalleryStore(directory, STORE_OPTIONS), ['user_0', 'user_2'], ['user_1']);
+        }
+    },
+    {
+        name: 'torn tail is discarded and truncated',
+        async run() {
+            const intact = journal(enrollments(1, ['user_0', 'user_1', 'user_2']));
+            const torn = frame(4, ENROLL, 'user_3');
+            const directory = newStore({
+                'gallery.journal': Buffer.concat([intact, torn.subarray(0, torn.length - 7)])
+            });
+            const problems = await checkGallery(openGalleryStore(directory, STORE_OPTIONS),
+                                                ['user_0', 'user_1', 'user_2'], ['user_3']);
+            closeStore();
+            const size = fs.statSync(storeFile(directory, 'gallery.journal')).size;
+            if (size !== intact.length) {
+                problems.push(`journal is ${size} bytes after recovery, expected ${intact.length}`);
+            }
+            return problems;
+        }
+    },
+    {
+        name: 'corrupt entry ends the replay',
+        async run() {
+            const kept = journal(enrollments(1, ['user_0', 'user_1']));
+            const bad = frame(3, ENROLL, 'user_2');
+            bad[bad.length - 5] ^= 0x40; // Inside the record, so only the CRC catches it
+            const contents = Buffer.concat([kept, bad, journal(enrollments(4, ['user_3']))]);
+            const directory = newStore({ 'gallery.journal': contents });
+            const problems = await checkGallery(openGalleryStore(directory, STORE_OPTIONS),
+                                                ['user_0', 'user_1'], ['user_2', 'user_3']);
+            closeStore();
+            const size = fs.statSync(storeFile(directory, 'gallery.journal')).size;
+            if (size !== kept.length) {
+                problems.push(`journal is ${size} bytes after recovery, expected ${kept.length}`);
+            }
+            return problems;
+        }
+    },
+    {
+        name: 'sequence gap is refused',
+        async run() {
+            const contents = journal([...enrollments(1, ['user_0', 'user_1']), [4, ENROLL, 'user_3']]);
+            const directory = newStore({ 'gallery.journal': contents });
+            const opened = openGalleryStore(directory, STORE_OPTIONS);
+            const problems = [];
+            if (opened.success) {
+                problems.push(`store opened with ${opened.loadedTemplates} templates despite the gap`);
+            }
+            closeStore();
+            if (!fs.readFileSync(storeFile(directory, 'gallery.journal')).equals(contents)) {
+                problems.push('journal was modified');
+            }
+            return problems;
+        }
+    },
+    {
+        name: 'retired journal from an interrupted compaction',
+        async run() {
+            const directory = newStore({
+                'gallery.journal.old': journal(enrollments(1, ['user_0', 'user_1', 'user_2'])),
+                'gallery.journal': journal([[4, REMOVE, 'user_0'], [5, ENROLL, 'user_3']])
+            });
+            const expected = ['user_1', 'user_2', 'user_3'];
+            const problems = await checkGallery(openGalleryStore(directory, STORE_OPTIONS), expected, ['user_0']);
+
+            // Opening finishes the compaction: the retired journal is folded into a snapshot
+            if (fs.existsSync(storeFile(directory, 'gallery.journal.old'))) {
+                problems.push('retired journal was not removed');
+            }
+            if (!fs.existsSync(storeFile(directory, 'gallery.snapshot'))) {
+                problems.push('no snapshot was written');
+            }
+            closeStore();
+            problems.push(...await checkGallery(openGalleryStore(directory, STORE_OPTIONS), expected, ['user_0']));
+            return problems;
+        }
+    },
+    {
+        name: 'retired journal folded by two rotations',
+        async run() {
+            // A second compaction failed too and appended its journal to the first one's
+            const first = journal(enrollments(1, ['user_0', 'user_1']));
+            const second = journal([[3, REMOVE, 'user_1'], [4, ENROLL, 'user_2']]);
+            const directory = newStore({
+                'gallery.snapshot': snapshot(0, []),
+                'gallery.journal.old': Buffer.concat([first, second]),
+                'gallery.journal': journal(enrollments(5, ['user_3', 'user_4']))
+            });
+            return checkGallery(openGalleryStore(directory, STORE_OPTIONS),
+                                ['user_0', 'user_2', 'user_3', 'user_4'], ['user_1']);
+        }
+    },
+    {
+        name: 'snapshot plus journal tail',
+        async run() {
+            // The snapshot covers sequences 1-6; the retired journal it came from was not yet deleted
+            const history = [...enrollments(1, ['user_0', 'user_1', 'user_2', 'user_3', 'user_4']), [6, REMOVE, 'user_4']];
+            const directory = newStore({
+                'gallery.snapshot': snapshot(6, ['user_0', 'user_1', 'user_2', 'user_3']),
+                'gallery.journal.old': journal(history),
+                'gallery.journal': journal([[7, ENROLL, 'user_5'], [8, REMOVE, 'user_0']])
+            });
+            return checkGallery(openGalleryStore(directory, STORE_OPTIONS),
+                                ['user_1', 'user_2', 'user_3', 'user_5'], ['user_0', 'user_4']);
+        }
+    },
+    {
+        name: 'journal tail that does not continue the snapshot is refused',
+        async run() {
+            const directory = newStore({
+                'gallery.snapshot': snapshot(2, ['user_0', 'user_1']),
+                'gallery.journal': journal(enrollments(5, ['user_2']))
+            });
+            const opened = openGalleryStore(directory, STORE_OPTIONS);
+            return opened.success ? ['store opened although sequences 3-4 are missing'] : [];
+        }
+    },
+    {
+        name: 'corrupt snapshot is refused',
+        async run() {
+            const contents = snapshot(2, ['user_0', 'user_1']);
+            contents[20] ^= 0x01;
+            const directory = newStore({ 'gallery.snapshot': contents });
+            const opened = openGalleryStore(directory, STORE_OPTIONS);
+            return opened.success ? [`store opened with ${opened.loadedTemplates} templates`] : [];
+        }
+    },
+    {
+        name: 'live store survives a torn tail and keeps journaling',
+        async run() {
+            const directory = newStore({});
+            const problems = [];
+            openGalleryStore(directory, STORE_OPTIONS);
+            for (const id of ['user_6', 'user_7', 'user_8', 'user_9']) {
+                const result = await enrollFingerprint(id, byId.get(id).fingerprint);
+                if (!result.durable) {
+                    problems.push(`enrollment of ${id} was not durable`);
+                }
+            }
+            await removeFingerprint('user_7');
+            closeStore();
+
+            // Crash in the middle of the next append
+            const journalPath = storeFile(directory, 'gallery.journal');
+            fs.appendFileSync(journalPath, frame(6, ENROLL, 'user_10').subarray(0, 20));
+            problems.push(...await checkGallery(openGalleryStore(directory, STORE_OPTIONS),
+                                                ['user_6', 'user_8', 'user_9'], ['user_7', 'user_10']));
+
+            // New entries continue the recovered sequence, so the next start replays them
+            await enrollFingerprint('user_11', byId.get('user_11').fingerprint);
+            closeStore();
+            problems.push(...await checkGallery(openGalleryStore(directory, STORE_OPTIONS),
+                                                ['user_6', 'user_8', 'user_9', 'user_11'], ['user_7']));
+            return problems;
+        }
+    },
+    {
+        name: 'failed compaction keeps journaling and the store reopens',
+        async run() {
+            const directory = newStore({});
+            const problems = [];
+            // Compact after every append, so each enrollment tries to retire the journal
+            openGalleryStore(directory, { compactionBytes: 1, compactionIntervalMs: 20 });
+            // A directory where the retired journal belongs makes every retirement fail
+            fs.mkdirSync(storeFile(directory, 'gallery.journal.old'));
+            const enrolled = ['user_0', 'user_1', 'user_2', 'user_3'];
+            for (const id of enrolled) {
+                const result = await enrollFingerprint(id, byId.get(id).fingerprint);
+                if (!result.durable) {
+                    problems.push(`enrollment of ${id} after a failed compaction was not durable: ${result.error}`);
+                }
+                await delay(60);
+            }
+            await removeFingerprint('user_1');
+
+            // Closing must stop the journal writer even though compaction failed
+            closeStore();
+            fs.rmdirSync(storeFile(directory, 'gallery.journal.old'));
+            problems.push(...await checkGallery(openGalleryStore(directory, STORE_OPTIONS),
+                                                ['user_0', 'user_2', 'user_3'], ['user_1']));
+            return problems;
+        }
+    }
+];
+
+async function main() {
+    console.log('🧪 Gallery store crash recovery test\n');
+    configureProbeCache({ capacity: 0 });
+
+    let failed = false;
+    try {
+        for (const scenario of scenarios) {
+            const problems = await scenario.run();
+            failed = failed || problems.length > 0;
+            console.log(`${problems.length === 0 ? '✅' : '❌'} ${scenario.name}`);
+            for (const problem of problems) {
+                console.log(`   - ${problem}`);
+            }
+        }
+    } finally {
+        closeStore();
+        fs.rmSync(scratch, { recursive: true, force: true });
+    }
+
+    if (failed) {
+        console.log('\n💥 Gallery store recovery is broken');
+        process.exit(1);
+    }
+    console.log('\n🎉 Every crash state recovered as expected');
+}
+
+main().catch(error => {
+    console.error(error);
+    process.exit(1);
+});
@@ -0,0 +1,157 @@
+// Cross-check of the packed pre-filter kernels
+//
+// The packed scan engine picks its pre-filter kernel (scalar, AVX2 or AVX-512) once
+// at load time, so each level runs in its own child process with OPENAFIS_ISA forcing
+// it. Every child scores seeded random descriptors with scorePackedDescriptors():
+// galleries that fill whole 16-candidate blocks and galleries whose last block is
+// partial, sparse, dense and all-ones bit sets. Scores must equal a JavaScript
+// popcount of probe AND candidate, padding lanes must score 0, and every kernel must
+// return exactly what the scalar kernel returns.
+
+const { execFileSync } = require('child_process');
+const crypto = require('crypto');
+const { createRandom } = require('./synthetic-gallery');
+
+const DESCRIPTOR_BYTES = 256;
+const LANES = 16;
+const LEVELS = ['scalar', 'avx2', 'avx512'];
+
+// Candidate counts: empty, a lone candidate, partial and whole blocks, several blocks
+const GALLERY_SIZES = [0, 1, 15, 16, 17, 31, 64, 100, 257];
+
+/**
+ * Random descriptor with roughly density * 2048 bits set
+ */
+function randomDescriptor(random, density) {
+    const descriptor = Buffer.alloc(DESCRIPTOR_BYTES);
+    for (let byte = 0; byte < DESCRIPTOR_BYTES; byte++) {
+        for (let bit = 0; bit < 8; bit++) {
+            if (random() < density) {
+                descriptor[byte] |= 1 << bit;
+            }
+        }
+    }
+    return descriptor;
+}
+
+function popcount(byte) {
+    let count = 0;
+    for (; byte; byte &= byte - 1) {
+        count++;
+    }
+    return count;
+}
+
+function referenceScore(probe, candidate) {
+    let score = 0;
+    for (let byte = 0; byte < DESCRIPTOR_BYTES; byte++) {
+        score += popcount(probe[byte] & candidate[byte]);
+    }
+    return score;
+}
+
+/**
+ * Seeded cases, identical in every child
+ */
+function makeCases() {
+    const random = createRandom(7);
+    const cases = [];
+    for (const size of GALLERY_SIZES) {
+        for (const density of [0.05, 0.5, 0.95]) {
+            const descriptors = [];
+            for (let i = 0; i < size; i++) {
+                descriptors.push(randomDescriptor(random, density * (0.5 + random())));
+            }
+            cases.push({ name: `${size} candidates, density ${density}`, descriptors,
+                         probe: randomDescriptor(random, density) });
+        }
+    }
+    // Every bit set: the largest possible score (2048) in every lane
+    const full = Buffer.alloc(DESCRIPTOR_BYTES, 0xff);
+    cases.push({ name: '40 all-ones candidates', descriptors: new Array(40).fill(full), probe: full });
+    return cases;
+}
+
+// ---------------------------------------------------------------------------
+// Child: score every case with the kernel this process selected
+
+function runChild() {
+    const { getBuildInfo, scorePackedDescriptors } = require('./index');
+    const problems = [];
+    const digest = crypto.createHash('sha256');
+
+    for (const testCase of makeCases()) {
+        const scores = scorePackedDescriptors(testCase.descriptors, testCase.probe);
+        const blocks = Math.ceil(testCase.descriptors.length / LANES);
+        if (scores.length !== blocks * LANES) {
+            problems.push(`${testCase.name}: ${scores.length} scores for ${blocks} blocks`);
+            continue;
+        }
+        testCase.descriptors.forEach((candidate, lane) => {
+            const expected = referenceScore(testCase.probe, candidate);
+            if (scores[lane] !== expected) {
+                problems.push(`${testCase.name}: candidate ${lane} scored ${scores[lane]}, expected ${expected}`);
+            }
+        });
+        for (let lane = testCase.descriptors.length; lane < scores.length; lane++) {
+            if (scores[lane] !== 0) {
+                problems.push(`${testCase.name}: padding lane ${lane} scored ${scores[lane]}`);
+            }
+        }
+        digest.update(Buffer.from(scores.buffer, scores.byteOffset, scores.byteLength));
+    }
+
+    process.stdout.write(JSON.stringify({
+        kernel: getBuildInfo().kernels.packedMinutiae,
+        problems: problems.slice(0, 10),
+        digest: digest.digest('hex')
+    }));
+}
+
+// ---------------------------------------------------------------------------
+// Parent: one child per ISA level the CPU supports
+
+function main() {
+    console.log('🧪 Packed pre-filter kernel test\n');
+    const { getBuildInfo } = require('./index');
+    const detected = LEVELS.indexOf(getBuildInfo().detectedIsa);
+
+    let failed = false;
+    let scalarDigest = null;
+    LEVELS.forEach((level, index) => {
+        if (index > detected) {
+            console.log(`⏭️  ${level}: not supported by this CPU`);
+            return;
+        }
+        const output = execFileSync(process.execPath, [__filename, '--child'], {
+            env: { ...process.env, OPENAFIS_ISA: level },
+            stdio: ['ignore', 'pipe', 'inherit']
+        });
+        const { kernel, problems, digest } = JSON.parse(output.toString());
+        if (kernel !== level) {
+            problems.unshift(`OPENAFIS_ISA=${level} selected the ${kernel} kernel`);
+        }
+        if (scalarDigest === null) {
+            scalarDigest = digest;
+        } else if (digest !== scalarDigest) {
+            problems.push('scores differ from the scalar kernel');
+        }
+        failed = failed || problems.length > 0;
+        console.log(`${problems.length === 0 ? '✅' : '❌'} ${level}`);
+        for (const problem of problems) {
+            console.log(`   - ${problem}`);
+        }
+    });
+
+    if (failed) {
+        console.log('\n💥 A packed pre-filter kernel disagrees with the reference popcount');
+        process.exit(1);
+    }
+    console.log('\n🎉 Every packed pre-filter kernel matches the reference popcount');
+}
+
+if (process.argv[2] === '--child') {
+    runChild();
+} else {
+    main();
+}
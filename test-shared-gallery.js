@@ -0,0 +1,295 @@
+// Cross-process test for shared galleries
+//
+// Forks a writer process that publishes the gallery to a file-backed segment and a
+// reader process that attaches a replica, then drives both over IPC: the writer
+// enrolls and removes past the log's capacity so it is rewritten, dies with a
+// publication left half-done, and a new writer takes the segment over with a larger
+// capacity so the reader has to remap it. After each step the replica must converge
+// on the writer's gallery: the same template count, every live user matching itself
+// and no removed user matching at all.
+
+const { fork } = require('child_process');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const { makeGallery } = require('./synthetic-gallery');
+
+const users = makeGallery(40);
+const byId = new Map(users.map(user => [user.id, user]));
+
+// Header: magic[8], u64 capacity, u64 generation, u64 epoch, u64 used
+const GENERATION_OFFSET = 16;
+const EPOCH_OFFSET = 24;
+
+// Room for about a dozen enrollments, so the log fills up quickly
+const SMALL_CAPACITY = 3584;
+const LARGE_CAPACITY = 64 * 1024;
+
+function ids(first, last) {
+    const out = [];
+    for (let i = first; i <= last; i++) {
+        out.push(`user_${i}`);
+    }
+    return out;
+}
+
+// ---------------------------------------------------------------------------
+// Child processes: run one command per IPC message and reply with its result
+
+async function runChild() {
+    const {
+        enrollFingerprint,
+        removeFingerprint,
+        matchFingerprintAsync,
+        publishSharedGallery,
+        attachSharedGallery,
+        configureProbeCache
+    } = require('./index');
+
+    // Every match must reach the replica, not a cached answer from before a change
+    configureProbeCache({ capacity: 0 });
+
+    const commands = {
+        async enroll({ ids: enrolled }) {
+            for (const id of enrolled) {
+                await enrollFingerprint(id, byId.get(id).fingerprint);
+            }
+            return {};
+        },
+        async remove({ ids: removed }) {
+            for (const id of removed) {
+                await removeFingerprint(id);
+            }
+            return {};
+        },
+        async publish({ name, capacityBytes }) {
+            return publishSharedGallery(name, { capacityBytes });
+        },
+        async attach({ name }) {
+            return attachSharedGallery(name);
+        },
+        async match({ ids: probed }) {
+            const matched = [];
+            let loadedTemplates = 0;
+            for (const id of probed) {
+                const result = await matchFingerprintAsync(byId.get(id).fingerprint);
+                loadedTemplates = result.loadedTemplates;
+                if (result.isMatch && result.bestMatch === id) {
+                    matched.push(id);
+                }
+            }
+            return { matched, loadedTemplates };
+        }
+    };
+
+    process.on('message', async ({ command, args }) => {
+        try {
+            process.send({ result: await commands[command](args) });
+        } catch (error) {
+            process.send({ error: String(error && error.stack || error) });
+        }
+    });
+    process.send({ ready: true });
+}
+
+// ---------------------------------------------------------------------------
+// Parent: drives a writer and a reader through the scenarios
+
+function spawn(role) {
+    const child = fork(__filename, ['--child', role], { stdio: ['ignore', 'ignore', 'inherit', 'ipc'] });
+    const pending = [];
+    child.on('message', message => {
+        if (message.ready) {
+            return;
+        }
+        const next = pending.shift();
+        if (message.error) {
+            next.reject(new Error(`${role}: ${message.error}`));
+        } else {
+            next.resolve(message.result);
+        }
+    });
+    const ready = new Promise(resolve => child.once('message', resolve));
+    return {
+        child,
+        ready,
+        call(command, args = {}) {
+            return new Promise((resolve, reject) => {
+                pending.push({ resolve, reject });
+                child.send({ command, args });
+            });
+        },
+        kill() {
+            return new Promise(resolve => {
+                if (child.exitCode !== null || child.signalCode !== null) {
+                    resolve();
+                    return;
+                }
+                child.once('exit', resolve);
+                child.kill('SIGKILL');
+            });
+        }
+    };
+}
+
+function readWord(file, offset) {
+    const fd = fs.openSync(file, 'r');
+    try {
+        const word = Buffer.alloc(8);
+        fs.readSync(fd, word, 0, 8, offset);
+        return word.readBigUInt64LE();
+    } finally {
+        fs.closeSync(fd);
+    }
+}
+
+function writeWord(file, offset, value) {
+    const fd = fs.openSync(file, 'r+');
+    try {
+        const word = Buffer.alloc(8);
+        word.writeBigUInt64LE(value);
+        fs.writeSync(fd, word, 0, 8, offset);
+    } finally {
+        fs.closeSync(fd);
+    }
+}
+
+/**
+ * Check that the replica holds exactly the live users
+ */
+async function checkReplica(reader, live, removed) {
+    const problems = [];
+    const { matched, loadedTemplates } = await reader.call('match', { ids: [...live, ...removed] });
+    if (loadedTemplates !== live.length) {
+        problems.push(`replica holds ${loadedTemplates} templates, expected ${live.length}`);
+    }
+    for (const id of live) {
+        if (!matched.includes(id)) {
+            problems.push(`${id} did not match itself on the replica`);
+        }
+    }
+    for (const id of removed) {
+        if (matched.includes(id)) {
+            problems.push(`removed ${id} still matches on the replica`);
+        }
+    }
+    return problems;
+}
+
+async function main() {
+    console.log('🧪 Shared gallery cross-process test\n');
+    if (process.platform === 'win32') {
+        console.log('⏭️  Shared galleries are not supported on Windows');
+        return;
+    }
+
+    const scratch = fs.mkdtempSync(path.join(os.tmpdir(), 'openafis-shared-'));
+    const segment = path.join(scratch, 'gallery.segment');
+    let writer = spawn('writer');
+    const reader = spawn('reader');
+    await Promise.all([writer.ready, reader.ready]);
+
+    let live = ids(0, 5);
+    let removed = [];
+    let failed = false;
+
+    const scenarios = [
+        {
+            name: 'replica attaches the published gallery',
+            async run() {
+                await writer.call('enroll', { ids: live });
+                const published = await writer.call('publish', { name: segment, capacityBytes: SMALL_CAPACITY });
+                if (!published.success) {
+                    return [`publish failed: ${published.error}`];
+                }
+                const attached = await reader.call('attach', { name: segment });
+                if (!attached.success || !attached.replica) {
+                    return [`attach failed: ${attached.error}`];
+                }
+                return checkReplica(reader, live, removed);
+            }
+        },
+        {
+            name: 'full log is rewritten and the replica follows',
+            async run() {
+                const epoch = readWord(segment, EPOCH_OFFSET);
+                await writer.call('enroll', { ids: ids(6, 9) });
+                await writer.call('remove', { ids: ['user_0', 'user_1'] });
+                await writer.call('enroll', { ids: ids(10, 13) });
+                await writer.call('remove', { ids: ['user_6', 'user_7', 'user_8'] });
+                live = [...ids(2, 5), ...ids(9, 13)];
+                removed = ['user_0', 'user_1', 'user_6', 'user_7', 'user_8'];
+
+                const problems = [];
+                if (readWord(segment, EPOCH_OFFSET) === epoch) {
+                    problems.push('the log never filled up, so it was not rewritten');
+                }
+                problems.push(...await checkReplica(reader, live, removed));
+                return problems;
+            }
+        },
+        {
+            name: 'replica keeps serving after the writer dies mid-publication',
+            async run() {
+                await writer.kill();
+                // Leave the generation odd, as a writer killed between beginPublish and endPublish does
+                writeWord(segment, GENERATION_OFFSET, readWord(segment, GENERATION_OFFSET) | 1n);
+                return checkReplica(reader, live, removed);
+            }
+        },
+        {
+            name: 'new writer takes over and the replica remaps the grown segment',
+            async run() {
+                const before = fs.statSync(segment).size;
+                writer = spawn('writer');
+                await writer.ready;
+                await writer.call('enroll', { ids: live });
+                const published = await writer.call('publish', { name: segment, capacityBytes: LARGE_CAPACITY });
+                if (!published.success) {
+                    return [`takeover publish failed: ${published.error}`];
+                }
+                // Past the old mapping: the replica can only read these after remapping
+                await writer.call('enroll', { ids: ids(14, 39) });
+                await writer.call('remove', { ids: ['user_2'] });
+                live = [...ids(3, 5), ...ids(9, 39)];
+                removed = [...removed, 'user_2'];
+
+                const problems = [];
+                if (fs.statSync(segment).size <= before) {
+                    problems.push('the segment did not grow');
+                }
+                if (readWord(segment, GENERATION_OFFSET) & 1n) {
+                    problems.push('the generation is still odd after the takeover');
+                }
+                problems.push(...await checkReplica(reader, live, removed));
+                return problems;
+            }
+        }
+    ];
+
+    try {
+        for (const scenario of scenarios) {
+            const problems = await scenario.run();
+            failed = failed || problems.length > 0;
+            console.log(`${problems.length === 0 ? '✅' : '❌'} ${scenario.name}`);
+            for (const problem of problems) {
+                console.log(`   - ${problem}`);
+            }
+        }
+    } finally {
+        await Promise.all([writer.kill(), reader.kill()]);
+        fs.rmSync(scratch, { recursive: true, force: true });
+    }
+
+    if (failed) {
+        console.log('\n💥 Shared gallery replicas diverged from their writer');
+        process.exit(1);
+    }
+    console.log('\n🎉 The replica converged on its writer at every step');
+}
+
+const entry = process.argv[2] === '--child' ? runChild : main;
+entry().catch(error => {
+    console.error(error);
+    process.exit(1);
+});